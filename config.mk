@@ -65,7 +65,7 @@ UPDATE_METHOD = afs
 # A list of the test programs you want compiled in from the user/progs
 # directory.
 #
-STUDENTTESTS = test_exec1 test_readline test_sleep test_thr_create test_cyclone test_agility_drill test_paraguay test_startle test_div0
+STUDENTTESTS = test_exec1 test_readline test_sleep test_thr_create test_cyclone test_agility_drill test_paraguay test_startle test_div0 test_spawn test_shm test_map_file test_priority test_sleep_stress test_tid_reuse test_stack_thr
 
 ###########################################################################
 # Data files provided by course staff to build into the RAM disk
@@ -98,7 +98,7 @@ THREAD_OBJS = malloc.o panic.o mutex.o cond.o asm_helpers.o thread.o ll.o sem.o
 ###########################################################################
 # Object files for your syscall wrappers
 ###########################################################################
-SYSCALL_OBJS = syscall_fork.o syscall_exec.o syscall_set_status.o syscall_vanish.o syscall_wait.o syscall_task_vanish.o syscall_gettid.o syscall_yield.o syscall_deschedule.o syscall_make_runnable.o syscall_get_ticks.o syscall_sleep.o syscall_swexn.o syscall_new_pages.o syscall_remove_pages.o syscall_getchar.o syscall_readline.o syscall_print.o syscall_set_term_color.o syscall_set_cursor_pos.o syscall_get_cursor_pos.o syscall_readfile.o syscall_halt.o syscall_misbehave.o
+SYSCALL_OBJS = syscall_fork.o syscall_exec.o syscall_set_status.o syscall_vanish.o syscall_wait.o syscall_task_vanish.o syscall_gettid.o syscall_yield.o syscall_deschedule.o syscall_make_runnable.o syscall_get_ticks.o syscall_sleep.o syscall_swexn.o syscall_new_pages.o syscall_remove_pages.o syscall_getchar.o syscall_readline.o syscall_print.o syscall_set_term_color.o syscall_set_cursor_pos.o syscall_get_cursor_pos.o syscall_readfile.o syscall_halt.o syscall_misbehave.o syscall_spawn.o syscall_shm_attach.o syscall_shm_detach.o syscall_map_file.o syscall_set_priority.o
 
 ###########################################################################
 # Object files for your automatic stack handling
@@ -115,10 +115,10 @@ AUTOSTACK_OBJS = autostack.o
 #
 # Kernel object files you provide in from kern/
 #
-KERNEL_OBJS = console.o kernel.o loader/loader.o malloc_wrappers.o install_handlers.o debug.o asm_helpers.o keyboard.o \
+KERNEL_OBJS = console.o kernel.o loader/loader.o malloc_wrappers.o install_handlers.o debug.o asm_helpers.o keyboard.o timer.o \
 handlers/syscall_handler_wrappers.o handlers/exception_handler_wrappers.o handlers/thr_mgmt_handlers.o handlers/life_cycle_handlers.o handlers/exception_handlers.o handlers/console_io_handlers.o handlers/misc_handlers.o handlers/peripheral_handler_wrappers.o handlers/peripheral_handlers.o handlers/mem_mgmt_handlers.o \
-virtual_mem_mgmt/page_directory.o virtual_mem_mgmt/frame_manager.o virtual_mem_mgmt/mem_section.o virtual_mem_mgmt/virtual_mem_mgmt.o\
-data_structures/ll.o data_structures/queue.o data_structures/circ_buffer.o data_structures/ht.o data_structures/stack.o  \
+virtual_mem_mgmt/page_directory.o virtual_mem_mgmt/frame_manager.o virtual_mem_mgmt/mem_section.o virtual_mem_mgmt/virtual_mem_mgmt.o virtual_mem_mgmt/page_cache.o virtual_mem_mgmt/vm_area.o virtual_mem_mgmt/frame_set.o virtual_mem_mgmt/pt_pool.o virtual_mem_mgmt/shm.o virtual_mem_mgmt/compact.o\
+data_structures/ll.o data_structures/queue.o data_structures/circ_buffer.o data_structures/ht.o data_structures/id_table.o data_structures/stack.o  \
 special_register_cntrl/spec_reg_wrappers.o special_register_cntrl/asm_functions.o \
 scheduler/pcb.o scheduler/scheduler.o scheduler/tcb.o scheduler/tcb_pool.o scheduler/thr_helpers.o scheduler/thr_helpers_wrappers.o \
 dispatcher/dispatcher.o dispatcher/asm_helpers.o \
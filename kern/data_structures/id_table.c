@@ -0,0 +1,237 @@
+/**
+ * @file id_table.c
+ *
+ * @brief Implementation of a direct indexed table that hands out ids
+ *
+ * Every id in use has a slot of its own, found by its low bits in two array
+ * lookups. Leaves of slots are only allocated the first time an id reaches
+ * them, by id_table_alloc, so storing and removing a value never allocates.
+ * Freed slots are handed out again oldest first, which keeps ids compact
+ * while leaving a freed id unused for as long as possible. A slot's id also
+ * moves on by ID_TABLE_MAX_IDS every time it is freed, so a stale id does
+ * not find the value of whoever got the slot next.
+ *
+ * id_table_alloc and id_table_free must be serialized by the caller, but
+ * may run alongside id_table_set, id_table_get and id_table_clear, which
+ * never touch a free slot.
+ *
+ * @author Aatish Nayak (aatishn)
+ * @bug No known bugs
+ */
+
+#include <stdint.h>
+#include <id_table.h>
+#include <malloc.h>
+
+/**
+ * @brief Initializes an empty id table
+ *
+ * @param t id table to init
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int id_table_init(id_table_t *t) {
+    if (t == NULL) return -1;
+
+    int i;
+    for (i = 0; i < ID_TABLE_NUM_LEAVES; i++) {
+        t->leaves[i] = NULL;
+    }
+    t->num_slots = 0;
+    t->size = 0;
+    t->free_head = -1;
+    t->free_tail = -1;
+
+    return 0;
+}
+
+/**
+ * @brief Gets the slot at an index
+ *
+ * @param t id table to access
+ * @param idx index of a slot that was handed out before
+ *
+ * @return the slot
+ *
+ */
+id_slot_t *id_table_slot_at(id_table_t *t, uint32_t idx) {
+    return &(t->leaves[idx >> ID_TABLE_LEAF_BITS]
+            [idx & (ID_TABLE_LEAF_SIZE - 1)]);
+}
+
+/**
+ * @brief Gets the slot of an id in use
+ *
+ * @param t id table to access
+ * @param id id to look for
+ *
+ * @return the slot, NULL if the id is not in use
+ *
+ */
+id_slot_t *id_table_slot(id_table_t *t, int id) {
+    if (id < 0) return NULL;
+    uint32_t idx = (uint32_t) id & (ID_TABLE_MAX_IDS - 1);
+    if (idx >= t->num_slots) return NULL;
+
+    id_slot_t *s = id_table_slot_at(t, idx);
+    if (s->id != id || s->next != ID_SLOT_USED) return NULL;
+    return s;
+}
+
+/**
+ * @brief Hands out an id that is not in use, with no value stored
+ *
+ * @param t id table to take an id from
+ *
+ * @return the id on success, negative error code otherwise
+ *
+ */
+int id_table_alloc(id_table_t *t) {
+    if (t == NULL) return -1;
+
+    id_slot_t *s;
+    /* Hand out the slot freed longest ago */
+    if (t->free_head >= 0) {
+        s = id_table_slot_at(t, t->free_head);
+        t->free_head = s->next;
+        if (t->free_head < 0) t->free_tail = -1;
+    } else {
+        /* Otherwise hand out a new slot */
+        if (t->num_slots == ID_TABLE_MAX_IDS) return -2;
+
+        /* Allocate its leaf first if it is the first slot of one */
+        uint32_t leaf = t->num_slots >> ID_TABLE_LEAF_BITS;
+        if (t->leaves[leaf] == NULL) {
+            id_slot_t *slots = malloc(ID_TABLE_LEAF_SIZE * sizeof(id_slot_t));
+            if (slots == NULL) return -3;
+            t->leaves[leaf] = slots;
+        }
+
+        s = id_table_slot_at(t, t->num_slots);
+        s->id = t->num_slots;
+        t->num_slots++;
+    }
+
+    s->val = NULL;
+    s->next = ID_SLOT_USED;
+    t->size++;
+    return s->id;
+}
+
+/**
+ * @brief Returns an id to the table to be handed out again
+ *
+ * @param t id table the id came from
+ * @param id id to free
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int id_table_free(id_table_t *t, int id) {
+    if (t == NULL) return -1;
+
+    id_slot_t *s = id_table_slot(t, id);
+    if (s == NULL) return -2;
+    uint32_t idx = (uint32_t) id & (ID_TABLE_MAX_IDS - 1);
+
+    /* Move on to the next id of the slot, or wrap around */
+    if (id > ID_TABLE_MAX_ID - ID_TABLE_MAX_IDS) {
+        s->id = idx;
+    } else {
+        s->id = id + ID_TABLE_MAX_IDS;
+    }
+    s->val = NULL;
+
+    /* Queue it behind the other free slots */
+    s->next = -1;
+    if (t->free_tail >= 0) {
+        id_table_slot_at(t, t->free_tail)->next = idx;
+    } else {
+        t->free_head = idx;
+    }
+    t->free_tail = idx;
+    t->size--;
+
+    return 0;
+}
+
+/**
+ * @brief Stores a value under an id in use
+ *
+ * @param t id table to store into
+ * @param id id to store the value under
+ * @param val value to store
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int id_table_set(id_table_t *t, int id, void *val) {
+    if (t == NULL) return -1;
+
+    id_slot_t *s = id_table_slot(t, id);
+    if (s == NULL) return -2;
+    s->val = val;
+
+    return 0;
+}
+
+/**
+ * @brief Gets the value stored under an id
+ *
+ * @param t id table to access
+ * @param id id to look for
+ * @param valp Address to store value
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int id_table_get(id_table_t *t, int id, void **valp) {
+    if (t == NULL || valp == NULL) return -1;
+
+    id_slot_t *s = id_table_slot(t, id);
+    if (s == NULL || s->val == NULL) return -2;
+    *valp = s->val;
+
+    return 0;
+}
+
+/**
+ * @brief Removes and reports the value stored under an id, which stays in
+ * use until it is freed
+ *
+ * @param t id table to access
+ * @param id id to look for
+ * @param valp Address to store value (optional)
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int id_table_clear(id_table_t *t, int id, void **valp) {
+    if (t == NULL) return -1;
+
+    id_slot_t *s = id_table_slot(t, id);
+    if (s == NULL || s->val == NULL) return -2;
+    if (valp != NULL) *valp = s->val;
+    s->val = NULL;
+
+    return 0;
+}
+
+/**
+ * @brief Destroys the specified id table and frees its leaves
+ *
+ * @param t id table to destroy
+ *
+ * @return Void
+ *
+ */
+void id_table_destroy(id_table_t *t) {
+    if (t == NULL) return;
+
+    int i;
+    for (i = 0; i < ID_TABLE_NUM_LEAVES; i++) {
+        free(t->leaves[i]);
+        t->leaves[i] = NULL;
+    }
+}
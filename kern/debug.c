@@ -12,6 +12,8 @@
 #include <page_directory.h>
 #include <constants.h>
 #include <tcb.h>
+#include <kern_internals.h>
+#include <virtual_mem_mgmt.h>
 
 #include <simics.h>
 
@@ -112,3 +114,32 @@ void print_elf(simple_elf_t *elf) {
 
 }
 
+/** @brief Prints the counters the frame manager, page table pool,
+ *         scheduler and compaction keep about themselves
+ *  @return Void
+ */
+void print_kernel_stats(void) {
+    uint32_t a, b, c;
+    fm_frag_t before, after;
+    lprintf("----- Kernel Statistics -----");
+    fm_magazine_stats(&fm, &a, &b);
+    lprintf("frame magazine: %d hits, %d misses", (int)a, (int)b);
+    fm_clean_stats(&fm, &a, &b);
+    lprintf("clean frames: %d hits, %d misses", (int)a, (int)b);
+    ptp_stats(&ptpool, &a, &b);
+    lprintf("page table pool: %d used, %d free", (int)a, (int)b);
+    scheduler_switch_stats(&sched, &a, &b, &c);
+    lprintf("switches: %d cr3 loads, %d skipped, %d threads run early",
+            (int)a, (int)b, (int)c);
+    scheduler_prio_stats(&sched, &a, &b);
+    lprintf("priorities: %d boosts, %d decays", (int)a, (int)b);
+    scheduler_timer_stats(&sched, &a, &b);
+    lprintf("timer: %d one-shots, %d ticks skipped", (int)a, (int)b);
+    a = vmm_compact_stats(&before, &after, &b);
+    if (a > 0){
+        lprintf("compaction: %d runs, last moved %d pages, "
+                "unusable index %d -> %d", (int)a, (int)b,
+                (int)before.unusable, (int)after.unusable);
+    }
+    lprintf("----- End Kernel Statistics -----");
+}
@@ -17,6 +17,9 @@
 /* access to mutex */
 #include <mutex.h>
 
+/* access to vmm_check_user_range */
+#include <virtual_mem_mgmt.h>
+
 /* access to KH functions */
 #include <x86/keyhelp.h>
 
@@ -34,10 +37,9 @@ int syscall_readline_c_handler(int len, char *buf){
     if (buf == NULL || len < 0 || (uint32_t)len > max_len) return -1;
     pcb_t *pcb;
     if (scheduler_get_current_pcb(&sched, &pcb) < 0 ) return -2;
-    uint32_t priv, access;
     /* Ensure the buffer we are writing to is user rw */
-    if (pd_get_permissions(&pcb->pd, (uint32_t)buf, &priv, &access) < 0) return -3;
-    if (priv != PRIV_USER && access != ACC_RW) return -4;
+    if (len > 0 && vmm_check_user_range(&pcb->pd, (uint32_t)buf, len,
+                true) < 0) return -3;
     /* attempt to lock the keyboard. only continues when there is an entire
      * line to be read from the keyboard */
     return keyboard_read(&keyboard, len, buf);
@@ -20,6 +20,7 @@
 #include <kern_internals.h>
 
 #include <special_reg_cntrl.h>
+#include <virtual_mem_mgmt.h>
 
 #include <tcb.h>
 #include <ureg.h>
@@ -220,6 +221,13 @@ void print_cr2(){
  *  @return Void
  */
 void page_fault_c_handler(uint32_t *stack){
+    /* attempt to resolve the fault ourselves (e.g. copy-on-write) */
+    pcb_t *cur_pcb;
+    if (scheduler_get_current_pcb(&sched, &cur_pcb) == 0
+            && vmm_resolve_fault(&(cur_pcb->pd), get_cr2(),
+                stack[ERRCODE_IDX]) == 0)
+        return;
+
     /* attempt to execute swexn */
     if (swexn_execute(SWEXN_CAUSE_PAGEFAULT, stack, true) == 0)
         return;
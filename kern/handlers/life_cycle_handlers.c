@@ -92,6 +92,36 @@ int syscall_thread_fork_c_handler(uint32_t *saved_regs) {
 }
 
 
+/**
+ * @brief Counts the args of an argument vector passed to exec or spawn,
+ * checking that the vector and the start of every arg may be read
+ *
+ * @param pd Page directory of the invoking process
+ * @param argvec Null-terminated array of string args
+ *
+ * @return number of args on success, negative error code otherwise
+ */
+int count_exec_args(page_directory_t *pd, char **argvec) {
+    char **argp = argvec;
+    int argc = 0;
+    /* Check validity in argp */
+    while((vmm_check_user_range(pd, (uint32_t) argp,
+                    sizeof(char *), false) == 0) && *argp != NULL) {
+        /* Check if each string is a valid pointer */
+        if (vmm_check_user_range(pd, (uint32_t) *argp, 1, false) < 0) {
+            return -1;
+        }
+        argc++;
+        argp += 1;
+    }
+    /* Check if failed due to bad mapping */
+    if (vmm_check_user_range(pd, (uint32_t) argp,
+                sizeof(char *), false) < 0) {
+        return -2;
+    }
+    return argc;
+}
+
 /**
  * @brief Handles the exec syscall. Loads a new pcb and immediately starts
  * running it
@@ -133,22 +163,8 @@ int syscall_exec_c_handler(char *execname, char **argvec) {
     mutex_unlock(&(cur_pcb->m));
 
     /* Parse args and get argc*/
-    char **argp = argvec;
-    int argc = 0;
-    /* Check validity in argp */
-    while((pd_get_mapping(&(cur_pcb->pd), (uint32_t) argp, NULL) == 0)
-            && *argp != NULL) {
-        /* Check if each string is a valid pointer */
-        if (pd_get_mapping(&(cur_pcb->pd), (uint32_t) *argp, NULL) < 0) {
-            return -7;
-        }
-        argc++;
-        argp += 1;
-    }
-    /* Check if failed due to bad mapping */
-    if (pd_get_mapping(&(cur_pcb->pd), (uint32_t) argp, NULL) < 0) {
-        return -8;
-    }
+    int argc = count_exec_args(&(cur_pcb->pd), argvec);
+    if (argc < 0) return -7;
 
     /* Make local copy of execname */
     int len = strlen(execname);
@@ -198,6 +214,96 @@ int syscall_exec_c_handler(char *execname, char **argvec) {
 }
 
 
+/**
+ * @brief Handles the spawn syscall. Creates a child process running a new
+ * program, as fork followed by exec in the child would, but without ever
+ * copying the invoking process
+ *
+ * The program is loaded straight into the child's page directory, which the
+ * invoking thread borrows for the duration of the load.
+ *
+ * @param execname Name of program to run
+ * @param argvec Null-terminated array of string args to pass to program
+ *
+ * @return tid of the thread running the new process on success, negative
+ * error code otherwise
+ */
+int syscall_spawn_c_handler(char *execname, char **argvec) {
+    if (execname == NULL || argvec == NULL) return -1;
+
+    /* Get current pcb */
+    pcb_t *cur_pcb;
+    if (scheduler_get_current_pcb(&sched, &cur_pcb) < 0) return -2;
+
+    /* Check if elf filename exists */
+    if (vmm_check_user_range(&(cur_pcb->pd), (uint32_t) execname, 1,
+                false) < 0 || !load_elf_exists(execname)) {
+        return -3;
+    }
+
+    /* Parse args and get argc*/
+    int argc = count_exec_args(&(cur_pcb->pd), argvec);
+    if (argc < 0) return -4;
+
+    /* Make local copies of execname and argv, the invoking process is not
+     * mapped while loading */
+    int len = strlen(execname);
+    char name_copy[len+1];
+    memcpy(name_copy, execname, len);
+    name_copy[len] = '\0';
+    char *local_argv[argc];
+    int i;
+    for (i = 0; i < argc ; i++) {
+        int len = strlen(argvec[i])+1;
+        if ((local_argv[i] = malloc(sizeof(char) * len)) == NULL) break;
+        memcpy(local_argv[i], argvec[i], len);
+    }
+
+    int ret = 0;
+    pcb_t *child_pcb = NULL;
+    if (i < argc) {
+        ret = -5;
+    } else if ((child_pcb = malloc(sizeof(pcb_t))) == NULL) {
+        ret = -5;
+    } else if (pcb_init(child_pcb) < 0) {
+        free(child_pcb);
+        child_pcb = NULL;
+        ret = -6;
+    } else {
+        child_pcb->ppid = cur_pcb->pid;
+        /* Load in new program from inside the child's address space */
+        scheduler_loan_pd(&sched, &(child_pcb->pd));
+        if (pcb_load_prog(child_pcb, name_copy, argc, local_argv) < 0)
+            ret = -7;
+        scheduler_loan_pd(&sched, NULL);
+    }
+
+    /* Free all allocated local_argv args */
+    int j;
+    for (j = 0; j < i ; j++) {
+        free(local_argv[j]);
+    }
+
+    int tid;
+    if (ret == 0 && (tid = scheduler_add_process(&sched, child_pcb,
+                    NULL)) < 0) {
+        ret = -8;
+    }
+    if (ret < 0) {
+        /* Cleanup on failure */
+        if (child_pcb != NULL) {
+            pcb_destroy_s(child_pcb);
+            free(child_pcb);
+        }
+        return ret;
+    }
+
+    /* Inc children count safely in current process */
+    pcb_inc_children_s(cur_pcb);
+
+    return tid;
+}
+
 /** @brief Implements the set_status system call
  *  @param status The status to set the current tcb's exit status to
  *  @return Void
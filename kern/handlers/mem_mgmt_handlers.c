@@ -10,6 +10,8 @@
 #include <kern_internals.h>
 #include <common_kern.h>
 #include <virtual_mem_mgmt.h>
+/* getfile */
+#include <loader.h>
 
 /** @brief Implements the new_pages system call
  *  @param base The virtual address of the base for the new page
@@ -50,3 +52,71 @@ int syscall_remove_pages_c_handler(void *base){
     if (vmm_remove_user_page(pd, (uint32_t)base) < 0) return -1;
     return 0;
 }
+
+/** @brief Implements the shm_attach system call
+ *  @param key The key of the segment
+ *  @param base The virtual address to map the segment at
+ *  @param len The length of the segment
+ *  @return 0 on success, negative integer code on failure
+ */
+int syscall_shm_attach_c_handler(int key, void *base, int len){
+    /* check for invalid base address */
+    if ((uint32_t)base < USER_MEM_START) return -1;
+    /* check for non-positive and non-page aligned lengths */
+    if (len <= 0 || (len % PAGE_SIZE) != 0) return -1;
+
+    /* Get current running pcb */
+    pcb_t *cur_pcb;
+    if(scheduler_get_current_pcb(&sched, &cur_pcb) < 0) {
+        return -2;
+    }
+    page_directory_t *pd = &(cur_pcb->pd);
+    if (vmm_shm_attach(pd, key, (uint32_t)base,
+                (uint32_t)(len/PAGE_SIZE)) < 0){
+        return -2;
+    }
+    return 0;
+}
+
+/** @brief Implements the shm_detach system call
+ *  @param base The virtual address the segment was attached at
+ *  @return 0 on success, negative integer code on failure
+ */
+int syscall_shm_detach_c_handler(void *base){
+    /* Get current running pcb */
+    pcb_t *cur_pcb;
+    if(scheduler_get_current_pcb(&sched, &cur_pcb) < 0) {
+        return -2;
+    }
+    page_directory_t *pd = &(cur_pcb->pd);
+    if (vmm_shm_detach(pd, (uint32_t)base) < 0) return -1;
+    return 0;
+}
+
+/** @brief Implements the map_file system call
+ *  @param filename The name of the RAM disk file to map
+ *  @param base The virtual address to map the file at
+ *  @return The length of the file on success, negative integer code on
+ *          failure
+ */
+int syscall_map_file_c_handler(char *filename, void *base){
+    if (filename == NULL || (uint32_t)base < USER_MEM_START) return -1;
+
+    /* Get current running pcb */
+    pcb_t *cur_pcb;
+    if(scheduler_get_current_pcb(&sched, &cur_pcb) < 0) {
+        return -2;
+    }
+    page_directory_t *pd = &(cur_pcb->pd);
+
+    const char *bytes;
+    int len;
+    if (vmm_check_user_range(pd, (uint32_t)filename, 1, false) < 0
+            || getfile(filename, &bytes, &len) < 0 || len <= 0){
+        return -3;
+    }
+    if (vmm_map_file(pd, (uint32_t)base, bytes, (uint32_t)len) < 0){
+        return -4;
+    }
+    return len;
+}
@@ -8,16 +8,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <loader.h>
+#include <debug.h>
 
 #include <simics.h>
 /** @brief Implements the halt system call
  *
- *  For non simics this does nothing, the halt comes after in the assembly
- *  wrapper
+ *  Reports the kernel's statistics first. For non simics the halt itself
+ *  comes after in the assembly wrapper
  *
  *  @return Does not return
  */
 void syscall_halt_c_handler(){
+    print_kernel_stats();
     /* ends simics simulation */
     sim_halt();
 }
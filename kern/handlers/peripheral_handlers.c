@@ -11,6 +11,8 @@
 #include <stdio.h>
 #include <scheduler.h>
 #include <dispatcher.h>
+#include <virtual_mem_mgmt.h>
+#include <timer.h>
 
 /* access to buffer */
 #include <kern_internals.h>
@@ -25,15 +27,26 @@
  *  scheduler
  */
 uint32_t c_timer_handler(uint32_t old_esp) {
-    sched.num_ticks++;
+    /* Wake up any sleeping threads on each tick that went by, more than one
+     * if the timer was armed to fire once */
+    uint32_t ticks = timer_fired();
+    scheduler_advance_ticks(&sched, ticks);
 
-    /* Wake up any sleeping threads */
-    scheduler_wakeup(&sched);
+    /* The current thread used up its quantum */
+    scheduler_expire_quantum(&sched);
+
+    /* Spend idle time zeroing free frames for later allocations */
+    if (sched.cur_tcb == sched.idle_tcb){
+        vmm_zero_idle_frames(VMM_ZERO_PER_TICK * ticks);
+    }
 
     /* Context switch into scheduler determined tcb,
      * possibly into a thread that was just woken up */
     uint32_t new_esp = context_switch(old_esp, -1);
 
+    /* Stop ticking if nothing needs to be preempted */
+    scheduler_program_timer(&sched);
+
     outb(INT_CTL_PORT, INT_ACK_CURRENT);
     return new_esp;
 }
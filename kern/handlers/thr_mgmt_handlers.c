@@ -52,11 +52,21 @@ int syscall_make_runnable_c_handler(int tid){
     return thr_make_runnable(tid);
 }
 
+/** @brief Implements the set_priority system call
+ *  @param prio The new base priority of the invoking process, from 0 (runs
+ *         first) to SCHED_NUM_PRIOS - 1
+ *  @return The old base priority on success, negative integer code on
+ *          failure
+ */
+int syscall_set_priority_c_handler(int prio){
+    return scheduler_set_priority(&sched, prio);
+}
+
 /** @brief Implements the get_ticks system call
  *  @return Number of clock ticks
  */
 unsigned int syscall_get_ticks_c_handler(){
-    return sched.num_ticks;
+    return scheduler_get_ticks(&sched);
 }
 
 /** @brief Implements the sleep system call
@@ -24,5 +24,6 @@ void print_context(unsigned int *stack);
 void print_control_regs(void);
 void translate_addr(page_directory_t *pd, uint32_t addr);
 void print_elf(simple_elf_t *elf);
+void print_kernel_stats(void);
 
 #endif /* DEBUG_H_ */
@@ -11,28 +11,133 @@
 
 #include <stdbool.h>
 #include <mutex.h>
-#include <ht.h>
+#include <stdint.h>
+
+/** @brief maximum number of bins (block sizes) a frame manager can have */
+#define FM_MAX_BINS 20
+
+/** @brief number of single frames a magazine can hold */
+#define FM_MAGAZINE_SIZE 32
+/** @brief number of frames moved between a magazine and the buddy allocator
+ * on a refill or drain */
+#define FM_MAGAZINE_BATCH (FM_MAGAZINE_SIZE / 2)
+/** @brief number of pre-zeroed single frames kept in the clean pool */
+#define FM_CLEAN_SIZE FM_MAGAZINE_SIZE
+
+/** @brief defines a cache of free single frames that can be handed out
+ * without taking the frame manager's mutex */
+typedef struct fm_magazine {
+    /** @brief addresses of the cached frames */
+    uint32_t frames[FM_MAGAZINE_SIZE];
+    /** @brief number of cached frames */
+    uint32_t count;
+    /** @brief number of single frame allocations served from the cache */
+    uint32_t hits;
+    /** @brief number of single frame allocations that had to refill */
+    uint32_t misses;
+} fm_magazine_t;
 
 /** @brief defines a frame manager struct */
 typedef struct frame_manager{
     /** @brief internal mutex */
     mutex_t m;
-    /** @brief hash table for allocated frames */
-    ht_t *allocated;
-    /** @brief hash table for deallocated frames */
-    ht_t *deallocated;
-    /** @brief hash table for parent frames */
-    ht_t *parents;
-    /** @brief array of linked lists that store deallocated frames of various
-     * sizes */
-    ll_t **frame_bins;
-    /** @brief length of frame_bins */
+    /** @brief per frame metadata, indexed by frame number */
+    struct frame *frames;
+    /** @brief number of frames tracked by the frame manager */
+    uint32_t num_frames;
+    /** @brief index of the first deallocated block of each size */
+    uint32_t free_lists[FM_MAX_BINS];
+    /** @brief number of deallocated blocks of each size */
+    uint32_t num_free[FM_MAX_BINS];
+    /** @brief number of bins in use */
     uint32_t num_bins;
+    /** @brief single frame cache, one per cpu (we only run on one) */
+    fm_magazine_t mag;
+    /** @brief cache of single frames that are known to be zeroed */
+    fm_magazine_t clean;
+    /** @brief one bit per frame set by fm_compact_mark */
+    uint32_t *seen;
+    /** @brief one bit per frame set once fm_compact_mark marks it twice */
+    uint32_t *pinned;
+    /** @brief index of the first frame of the range being compacted */
+    uint32_t compact_lo;
+    /** @brief index just past the range being compacted, equal to
+     * compact_lo when no compaction is going on */
+    uint32_t compact_hi;
 } frame_manager_t;
 
+/** @brief defines the fragmentation statistics of a frame manager */
+typedef struct fm_frag {
+    /** @brief number of free frames, cached single frames included */
+    uint32_t free_frames;
+    /** @brief number of free blocks, cached single frames included */
+    uint32_t free_blocks;
+    /** @brief order of the largest free block, -1 if nothing is free */
+    int largest_order;
+    /** @brief per mille of the free frames that lie in blocks too small for
+     * the order the statistics were taken for */
+    uint32_t unusable;
+} fm_frag_t;
+
+/** @brief defines a run of physically contiguous frames */
+typedef struct frame_run {
+    /** @brief The base address of the run */
+    uint32_t p_addr;
+    /** @brief The number of pages in the run */
+    uint32_t num_pages;
+} frame_run_t;
+
+/** @brief defines a list of blocks handed out by fm_alloc_list, linked
+ * through the frame manager's metadata of each block's head */
+typedef struct frame_list {
+    /** @brief The index of the first block's head */
+    uint32_t first;
+    /** @brief The index of the last block's head */
+    uint32_t last;
+    /** @brief The number of blocks in the list */
+    uint32_t size;
+    /** @brief The number of blocks at the front of the list that are known
+     * to be zeroed */
+    uint32_t num_zeroed;
+} frame_list_t;
+
+/** @brief defines an iterator over the frames of a list of blocks */
+typedef struct frame_iter {
+    /** @brief The frame manager the blocks came from */
+    frame_manager_t *fm;
+    /** @brief The index of the current block's head */
+    uint32_t idx;
+    /** @brief The index of the next frame in the current block */
+    uint32_t offset;
+    /** @brief The number of blocks left that are known to be zeroed */
+    uint32_t num_zeroed;
+} frame_iter_t;
+
 int fm_alloc(frame_manager_t *fm, uint32_t num_pages, uint32_t *addr);
+void fm_list_init(frame_list_t *list);
+int fm_alloc_list(frame_manager_t *fm, uint32_t num_pages, frame_list_t *runs);
+void fm_dealloc_list(frame_manager_t *fm, frame_list_t *runs);
+void fm_iter_init(frame_iter_t *it, frame_manager_t *fm, frame_list_t *runs);
+int fm_iter_next(frame_iter_t *it, uint32_t *p_addr, bool *zeroed);
+int fm_iter_next_run(frame_iter_t *it, uint32_t *p_addr, uint32_t *num_pages,
+        bool *zeroed);
+int fm_alloc_list_zeroed(frame_manager_t *fm, uint32_t num_pages,
+        frame_list_t *runs);
+int fm_get_dirty_frame(frame_manager_t *fm, uint32_t *p_addr);
+void fm_put_clean_frame(frame_manager_t *fm, uint32_t p_addr);
 int fm_dealloc(frame_manager_t *fm, uint32_t addr);
 int fm_init(frame_manager_t *fm, uint32_t num_bins);
+int fm_ref(frame_manager_t *fm, uint32_t addr, uint32_t num_pages);
+int fm_unref(frame_manager_t *fm, uint32_t addr, uint32_t num_pages);
+int fm_refcount(frame_manager_t *fm, uint32_t addr);
+void fm_magazine_stats(frame_manager_t *fm, uint32_t *hits,
+        uint32_t *misses);
+void fm_clean_stats(frame_manager_t *fm, uint32_t *hits, uint32_t *misses);
+void fm_frag_stats(frame_manager_t *fm, uint32_t order, fm_frag_t *frag);
+void fm_compact_clear(frame_manager_t *fm);
+void fm_compact_mark(frame_manager_t *fm, uint32_t p_addr);
+int fm_compact_begin(frame_manager_t *fm, uint32_t order, uint32_t *p_addr);
+void fm_compact_end(frame_manager_t *fm);
 void fm_print(frame_manager_t *fm);
 
 #endif /* _FRAME_MANAGER_H_ */
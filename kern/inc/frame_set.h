@@ -0,0 +1,43 @@
+/** @file frame_set.h
+ *  @brief Interface for the set of frames owned by an address space
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _FRAME_SET_H_
+#define _FRAME_SET_H_
+
+#include <stdint.h>
+/* PAGE_SIZE */
+#include <x86/page.h>
+#include <frame_manager.h>
+
+/** @brief number of runs a set has room for before it first grows */
+#define FRAME_SET_INIT_CAP 16
+
+/** @brief defines a set of non overlapping frame runs kept sorted by
+ * address */
+typedef struct frame_set {
+    /** @brief the runs in increasing order of address */
+    frame_run_t *runs;
+    /** @brief the number of runs in the set */
+    uint32_t size;
+    /** @brief the number of runs runs has room for */
+    uint32_t cap;
+} frame_set_t;
+
+/** @brief gets the address of the last byte of a run, which does not
+ * overflow for a run that ends at the top of physical memory */
+#define FRAME_RUN_LAST(run) \
+    ((run)->p_addr + ((run)->num_pages * PAGE_SIZE - 1))
+
+int frame_set_init(frame_set_t *set);
+int frame_set_reserve(frame_set_t *set, uint32_t num_runs);
+int frame_set_insert(frame_set_t *set, uint32_t p_addr, uint32_t num_pages);
+int frame_set_remove(frame_set_t *set, uint32_t p_addr, uint32_t num_pages);
+void frame_set_clear(frame_set_t *set);
+void frame_set_destroy(frame_set_t *set);
+
+#endif /* _FRAME_SET_H_ */
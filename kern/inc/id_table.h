@@ -0,0 +1,63 @@
+/**
+ * @file id_table.h
+ *
+ * @brief Interface to a direct indexed table that hands out ids
+ *
+ * @author Aatish Nayak (aatishn)
+ * @bug No known bugs
+ */
+
+#ifndef _ID_TABLE_H_
+#define _ID_TABLE_H_
+
+#include <stdint.h>
+
+/** @brief log2 of the number of slots per leaf */
+#define ID_TABLE_LEAF_BITS 10
+/** @brief number of slots per leaf */
+#define ID_TABLE_LEAF_SIZE (1 << ID_TABLE_LEAF_BITS)
+/** @brief number of leaves, a power of two */
+#define ID_TABLE_NUM_LEAVES 64
+/** @brief max number of ids in use at once */
+#define ID_TABLE_MAX_IDS (ID_TABLE_LEAF_SIZE * ID_TABLE_NUM_LEAVES)
+/** @brief largest id handed out */
+#define ID_TABLE_MAX_ID 0x7FFFFFFF
+/** @brief next index of a slot that is handed out */
+#define ID_SLOT_USED (-2)
+
+/**
+ * @brief defines a slot of an id table
+ */
+typedef struct id_slot {
+    /** @brief id the slot was handed out as, or will be handed out as next
+     * while it is free */
+    int id;
+    /** @brief index of the next free slot, -1 if none, ID_SLOT_USED if the
+     * slot is handed out */
+    int next;
+    /** @brief value stored, NULL if none */
+    void *val;
+} id_slot_t;
+
+typedef struct id_table {
+    /** @brief leaves of slots, allocated as ids reach them */
+    id_slot_t *leaves[ID_TABLE_NUM_LEAVES];
+    /** @brief number of slots ever handed out */
+    uint32_t num_slots;
+    /** @brief number of ids in use */
+    uint32_t size;
+    /** @brief index of the slot freed longest ago, -1 if none */
+    int free_head;
+    /** @brief index of the slot freed last, -1 if none */
+    int free_tail;
+} id_table_t;
+
+int id_table_init(id_table_t *t);
+int id_table_alloc(id_table_t *t);
+int id_table_free(id_table_t *t, int id);
+int id_table_set(id_table_t *t, int id, void *val);
+int id_table_get(id_table_t *t, int id, void **valp);
+int id_table_clear(id_table_t *t, int id, void **valp);
+void id_table_destroy(id_table_t *t);
+
+#endif /* _ID_TABLE_H_ */
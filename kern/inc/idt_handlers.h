@@ -57,6 +57,8 @@ int syscall_yield_handler(int);
 int syscall_deschedule_handler(int *);
 /** @brief syscall wrapper for make runnable*/
 int syscall_make_runnable_handler(int);
+/** @brief syscall wrapper for set priority */
+int syscall_set_priority_handler(int prio);
 /** @brief syscall wrapper for get ticks*/
 int syscall_get_ticks_handler(void);
 /** @brief syscall wrapper for sleep */
@@ -78,6 +80,8 @@ void syscall_set_status_handler(int);
 int syscall_exec_handler(char *execname, char **argvec);
 /** @brief syscall wrapper for thread fork */
 int syscall_thread_fork_handler(void);
+/** @brief syscall wrapper for spawn */
+int syscall_spawn_handler(char *execname, char **argvec);
 
 /* Console IO handlers */
 
@@ -98,6 +102,12 @@ int syscall_get_cursor_pos_handler(int *row, int *col);
 int syscall_new_pages_handler(void *base, int len);
 /** @brief syscall wrapper for remove pages */
 int syscall_remove_pages_handler(void *base);
+/** @brief syscall wrapper for shm attach */
+int syscall_shm_attach_handler(int key, void *base, int len);
+/** @brief syscall wrapper for shm detach */
+int syscall_shm_detach_handler(void *base);
+/** @brief syscall wrapper for map file */
+int syscall_map_file_handler(char *filename, void *base);
 
 /* Misc handlers */
 
@@ -11,6 +11,9 @@
 
 #include <scheduler.h>
 #include <frame_manager.h>
+#include <page_cache.h>
+#include <pt_pool.h>
+#include <shm.h>
 #include <mutex.h>
 #include <sched_mutex.h>
 #include <keyboard.h>
@@ -20,6 +23,21 @@
  */
 extern frame_manager_t fm;
 
+/**
+ * @brief Extern of the cache of read only executable pages
+ */
+extern page_cache_t pcache;
+
+/**
+ * @brief Extern of the pool that page tables and directories come from
+ */
+extern pt_pool_t ptpool;
+
+/**
+ * @brief Extern of the table of shared memory segments
+ */
+extern shm_table_t shmtab;
+
 /**
  * @brief Extern of global scheduler that manages all kernel PCBs and TCBs
  */
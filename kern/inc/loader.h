@@ -20,9 +20,17 @@
 
 #define USER_STACK_SIZE (USER_STACK_TOP - USER_STACK_BOTTOM)
 
+/** @brief the lowest address the user stack may grow down to */
+#define USER_STACK_LIMIT 0xff000000
+
+/** @brief page in .text, .data and .rodata from the RAM disk on first touch
+ * instead of copying them at exec time, comment out to load eagerly */
+#define LAZY_EXEC
+
 /* --- Prototypes --- */
 
 int getbytes( const char *filename, int offset, int size, char *buf );
+int getfile(const char *filename, const char **bytes, int *len);
 
 int load_elf_sections(simple_elf_t *elf, pcb_t *pcb);
 int load_elf_exists(const char *filename);
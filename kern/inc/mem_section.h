@@ -29,4 +29,6 @@ int ms_get_bounding_addr(mem_section_t *secs, uint32_t num_secs,
         uint32_t *addr_low, uint32_t *addr_high);
 int ms_get_bounding_section(mem_section_t *secs, uint32_t num_secs,
         uint32_t addr_low, uint32_t addr_high, mem_section_t **result);
+int ms_get_own_pages(mem_section_t *secs, uint32_t num_secs, uint32_t i,
+        uint32_t *first, uint32_t *num_pages);
 #endif /* _MEM_SECTION_H_ */
@@ -18,6 +18,7 @@ typedef struct mutex {
 int mutex_init( mutex_t *mp );
 void mutex_destroy( mutex_t *mp );
 void mutex_lock( mutex_t *mp );
+int mutex_trylock( mutex_t *mp );
 void mutex_unlock( mutex_t *mp );
 
 #endif /* _MUTEX_H */
@@ -0,0 +1,40 @@
+/** @file page_cache.h
+ *  @brief Interface for a cache of read only executable pages
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _PAGE_CACHE_H_
+#define _PAGE_CACHE_H_
+
+#include <stdint.h>
+#include <mutex.h>
+#include <ht.h>
+
+/** @brief number of buckets in each of the page cache's hash tables */
+#define PC_TABLE_SIZE 256
+
+/** @brief defines a page cache */
+typedef struct page_cache {
+    /** @brief serializes lookups with the release of cached frames */
+    mutex_t m;
+    /** @brief cached pages keyed by their file position */
+    ht_t by_pos;
+    /** @brief cached pages keyed by their frame */
+    ht_t by_frame;
+    /** @brief number of pages found in the cache */
+    uint32_t hits;
+    /** @brief number of pages that had to be read from the file */
+    uint32_t misses;
+} page_cache_t;
+
+int pc_init(page_cache_t *pc);
+int pc_get(page_cache_t *pc, const char *src, uint32_t pos,
+        uint32_t *p_addr);
+int pc_put(page_cache_t *pc, const char *src, uint32_t pos,
+        uint32_t p_addr);
+int pc_unref(page_cache_t *pc, uint32_t p_addr, uint32_t num_pages);
+
+#endif /* _PAGE_CACHE_H_ */
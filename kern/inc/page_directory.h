@@ -18,6 +18,9 @@
 #include <frame_manager.h>
 #include <stdbool.h>
 #include <queue.h>
+#include <mutex.h>
+#include <vm_area.h>
+#include <frame_set.h>
 
 /** @brief the bit flag representing the present flag */
 #define PRESENT_FLAG_BIT 0
@@ -27,18 +30,17 @@
 #define MODE_FLAG_BIT 2
 /** @brief the write through flag bit */
 #define WRITE_THROUGH_FLAG_BIT 3
+/** @brief the page size flag bit, set in a page directory entry that maps a
+ * large page instead of pointing at a page table */
+#define PAGE_SIZE_FLAG_BIT 7
 /** @brief the global flag bit */
 #define GLOBAL_FLAG_BIT 8
 
 /* custom non-x86 flag bits */
 
-/** @brief defines the flag bit that we use to denote the beginning of a user
- * allocated memory space */
-#define USER_START_FLAG_BIT 9
-
-/** @brief defines the flag bit that we use to denote the end of a user
- * allocated memory space */
-#define USER_END_FLAG_BIT 10
+/** @brief defines the flag bit that we use to denote a page that is shared
+ * copy-on-write and must be copied before it is written to */
+#define COW_FLAG_BIT 11
 
 /* p - SET implies page is present, UNSET implies page is unpresent
  * rw - SET implies page is read writable, UNSET implies read only
@@ -49,15 +51,13 @@
 #define NEW_FLAGS(p,rw,md,glb) ((p << PRESENT_FLAG_BIT) | (rw << RW_FLAG_BIT)\
     | (md << MODE_FLAG_BIT) | (glb << GLOBAL_FLAG_BIT))
 
-/** @brief adds the user_start flag to a set of flags */
-#define ADD_USER_START_FLAG(flags) (flags | (SET << USER_START_FLAG_BIT))
-/** @brief adds the user_end flag to a set of flags */
-#define ADD_USER_END_FLAG(flags) (flags | (SET << USER_END_FLAG_BIT))
+/** @brief adds the copy-on-write flag to a set of flags */
+#define ADD_COW_FLAG(flags) (flags | (SET << COW_FLAG_BIT))
+/** @brief removes the copy-on-write flag from a set of flags */
+#define REMOVE_COW_FLAG(flags) (flags & ~(SET << COW_FLAG_BIT))
 
-/** @brief checks if a page table entry is user start */
-#define IS_USER_START(pte) ((pte >> USER_START_FLAG_BIT) & 1)
-/** @brief checks if a page table entry is user end */
-#define IS_USER_END(pte) ((pte >> USER_END_FLAG_BIT) & 1)
+/** @brief checks if a page table entry is copy-on-write */
+#define IS_COW(pte) ((pte >> COW_FLAG_BIT) & 1)
 
 /** @brief defines a user read only flags */
 #define USER_RO NEW_FLAGS(SET, UNSET, SET, UNSET)
@@ -80,6 +80,18 @@
 /** @brief defines the number of entries in a page table */
 #define PT_NUM_ENTRIES (PT_SIZE / sizeof(uint32_t))
 
+/** @brief defines the size of a large page, which a single page directory
+ * entry maps */
+#define LARGE_PAGE_SIZE (PT_NUM_ENTRIES * PAGE_SIZE)
+/** @brief defines the number of pages in a large page */
+#define LARGE_PAGE_PAGES PT_NUM_ENTRIES
+/** @brief checks whether an address is large page aligned */
+#define IS_LARGE_PAGE_ALIGNED(a) (a % LARGE_PAGE_SIZE == 0)
+/** @brief checks if a page directory entry maps a large page */
+#define IS_LARGE(pde) ((pde >> PAGE_SIZE_FLAG_BIT) & 1)
+/** @brief removes the flags from a large page directory entry */
+#define REMOVE_LARGE_FLAGS(v) ((uint32_t)v & ~(LARGE_PAGE_SIZE - 1))
+
 /** @brief checks whether an address is page aligned */
 #define IS_PAGE_ALIGNED(a) (a % PAGE_SIZE == 0)
 
@@ -112,22 +124,36 @@ typedef struct page_directory {
     uint32_t *directory;
     /** @brief the number of pages in the directory */
     uint32_t num_pages;
-    /** @brief the list of physical addresses given to the directory */
-    ll_t *p_addr_list;
-    /** @brief the list of mapping tasks that are to be committed or aborted */
-    ll_t *mapping_tasks;
-    /** @brief denotes whether or not we should be mapping tasks immediately or
-     * during commits only */
-    bool batch_enabled;
+    /** @brief the number of present entries of each user page table */
+    uint16_t *pt_live;
+    /** @brief the runs of frames given to the directory */
+    frame_set_t frames;
+    /** @brief the areas of user memory the directory's pages may belong to */
+    vma_set_t vmas;
+    /** @brief serializes copy-on-write resolution and sharing of the
+     * directory's frames */
+    mutex_t m;
 } page_directory_t;
 
 int pd_init(page_directory_t *pd);
 int pd_init_kernel(void);
+int pd_zero_frame(uint32_t p_addr);
+int pd_copy_frame(uint32_t dest, uint32_t src);
+uint32_t pd_get_zero_frame(void);
 int pd_get_mapping(page_directory_t *pd, uint32_t v_addr, uint32_t *pte);
 
-int pd_begin_mapping(page_directory_t *pd);
-void pd_abort_mapping(page_directory_t *pd);
-void pd_commit_mapping(page_directory_t *pd);
+int pd_map_range(page_directory_t *pd, uint32_t v_addr, uint32_t num_pages,
+        uint32_t p_addr, frame_iter_t *it, uint32_t pte_flags,
+        uint32_t pde_flags);
+int pd_unmap_range(page_directory_t *pd, uint32_t v_addr, uint32_t num_pages);
+int pd_map_large(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr,
+        uint32_t flags);
+int pd_get_large_mapping(page_directory_t *pd, uint32_t v_addr,
+        uint32_t *pde);
+int pd_remove_large(page_directory_t *pd, uint32_t v_addr);
+int pd_split_large(page_directory_t *pd, uint32_t v_addr);
+int pd_protect_range(page_directory_t *pd, uint32_t v_addr,
+        uint32_t num_pages, uint32_t pte_flags);
 
 
 int pd_create_mapping(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr, uint32_t pte_flags, uint32_t pde_flags);
@@ -137,16 +163,25 @@ int pd_is_user_read_write(page_directory_t *pd, uint32_t v_addr);
 int pd_is_user_readable(page_directory_t *pd, uint32_t v_addr);
 int pd_remove_mapping(page_directory_t *pd, uint32_t v_addr);
 int pd_entry_present(uint32_t v);
-int pd_deep_copy(page_directory_t *pd_dest, page_directory_t *pd_src, uint32_t p_addr_start);
+int pd_deep_copy(page_directory_t *pd_dest, page_directory_t *pd_src,
+        frame_list_t *runs);
+int pd_cow_copy(page_directory_t *pd_dest, page_directory_t *pd_src);
+int pd_break_cow(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr);
+int pd_migrate_page(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr);
+void pd_for_each(void (*f)(page_directory_t *, void *), void *arg);
+int pd_protect_mapping(page_directory_t *pd, uint32_t v_addr,
+        uint32_t pte_flags);
 int pd_map_sections(page_directory_t *pd, mem_section_t *secs,
         uint32_t num_secs);
 void *pd_get_base_addr(page_directory_t *pd);
 
+int pd_fill_file_page(page_directory_t *pd, uint32_t v_addr);
 int pd_alloc_frame(page_directory_t *pd, uint32_t p_addr, uint32_t num_pages);
-int pd_dealloc_frame(page_directory_t *pd, uint32_t p_addr,
-        uint32_t *frame_size);
-int pd_dealloc_all_frames(page_directory_t *pd, uint32_t *addr_list,
-        uint32_t *size_list);
+int pd_reserve_frames(page_directory_t *pd, frame_list_t *runs);
+int pd_alloc_frames(page_directory_t *pd, frame_list_t *runs);
+int pd_release_frames(page_directory_t *pd, uint32_t p_addr,
+        uint32_t num_pages);
+int pd_dealloc_all_frames(page_directory_t *pd);
 int pd_num_frames(page_directory_t *pd);
 int pd_clear_user_space(page_directory_t *pd);
 void pd_destroy(page_directory_t *pd);
@@ -33,6 +33,8 @@ typedef struct pcb{
     uint32_t num_threads;
     /** @brief Number of child processes this pcb has */
     uint32_t num_child_proc;
+    /** @brief Base priority of this pcb's threads, level 0 runs first */
+    int prio;
     /** @brief Number of arguments to pcb's program entry point */
     int argc;
     /** @brief Array of string args to pcb's program entry point */
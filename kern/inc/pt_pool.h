@@ -0,0 +1,48 @@
+/** @file pt_pool.h
+ *  @brief Interface for a pool of pages used as page tables and directories
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _PT_POOL_H_
+#define _PT_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** @brief number of pages reserved for the pool at boot */
+#define PTP_INIT_PAGES 256
+/** @brief number of pages the pool grows by once it runs out */
+#define PTP_SLAB_PAGES 32
+
+/** @brief defines a free page of the pool, the link lives in the page */
+typedef struct ptp_page {
+    /** @brief the next free page of the same list */
+    struct ptp_page *next;
+} ptp_page_t;
+
+/** @brief defines a pool of page aligned kernel pages */
+typedef struct pt_pool {
+    /** @brief free pages that are all zeroes apart from their link */
+    ptp_page_t *clean;
+    /** @brief free pages with unknown contents */
+    ptp_page_t *dirty;
+    /** @brief number of pages in the clean list */
+    uint32_t num_clean;
+    /** @brief number of pages in the dirty list */
+    uint32_t num_dirty;
+    /** @brief number of pages handed out */
+    uint32_t num_used;
+    /** @brief number of slabs taken from the kernel heap */
+    uint32_t num_slabs;
+} pt_pool_t;
+
+int ptp_init(pt_pool_t *pool, uint32_t num_pages);
+int ptp_alloc(pt_pool_t *pool, void **page);
+void ptp_free(pt_pool_t *pool, void *page, bool zeroed);
+int ptp_zero_idle(pt_pool_t *pool, uint32_t num_pages);
+void ptp_stats(pt_pool_t *pool, uint32_t *num_used, uint32_t *num_free);
+
+#endif /* _PT_POOL_H_ */
@@ -20,10 +20,6 @@ typedef struct scheduler{
 
     /** @brief the number of ticks since the scheduler has started */
     int num_ticks;
-    /** @brief the next tid to create */
-    int next_tid;
-    /** @brief the next pid to create */
-    int next_pid;
     /** @brief the stack bot of a reaper thread */
     void *reaper_stack_bot;
     /** @brief the stack top of a reaper thread */
@@ -40,6 +36,15 @@ typedef struct scheduler{
     tcb_pool_t thr_pool;
     /** @brief the current running tcb */
     tcb_t *cur_tcb;
+
+    /** @brief number of context switches that loaded a new page directory */
+    uint32_t num_pdbr_loads;
+    /** @brief number of context switches that kept the page directory */
+    uint32_t num_pdbr_skips;
+    /** @brief number of times the timer was armed to interrupt once */
+    uint32_t num_oneshots;
+    /** @brief number of ticks counted without an interrupt of their own */
+    uint32_t num_skipped_ticks;
 } scheduler_t;
 
 extern uint32_t scheduler_num_ticks;
@@ -68,6 +73,7 @@ int scheduler_check_is_runnable(scheduler_t *sched, int target_tid);
 
 int scheduler_set_running_tcb(scheduler_t *sched,
                                 tcb_t *tcb, uint32_t *new_esp);
+int scheduler_loan_pd(scheduler_t *sched, page_directory_t *pd);
 
 int scheduler_get_current_tcb(scheduler_t *sched, tcb_t **tcb);
 
@@ -80,11 +86,25 @@ int scheduler_make_current_zombie_safe(scheduler_t *sched);
 int scheduler_cleanup_current_safe(scheduler_t *sched);
 
 int scheduler_wakeup(scheduler_t *sched);
+int scheduler_advance_ticks(scheduler_t *sched, uint32_t ticks);
+int scheduler_resume_ticks(scheduler_t *sched);
+int scheduler_resume_ticks_safe(scheduler_t *sched);
+int scheduler_program_timer(scheduler_t *sched);
+int scheduler_get_ticks(scheduler_t *sched);
+int scheduler_expire_quantum(scheduler_t *sched);
+int scheduler_set_priority(scheduler_t *sched, int prio);
 int scheduler_reap(scheduler_t *sched);
 
 int scheduler_defer_current_tcb(scheduler_t *sched, uint32_t old_esp);
 
 int scheduler_get_current_tid(scheduler_t *sched, int *tidp);
 
+void scheduler_switch_stats(scheduler_t *sched, uint32_t *num_loads,
+        uint32_t *num_skips, uint32_t *num_grouped);
+void scheduler_prio_stats(scheduler_t *sched, uint32_t *num_boosts,
+        uint32_t *num_decays);
+void scheduler_timer_stats(scheduler_t *sched, uint32_t *num_oneshots,
+        uint32_t *num_skipped);
+
 #endif /* _SCHEDULER_H_ */
 
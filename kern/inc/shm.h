@@ -0,0 +1,50 @@
+/** @file shm.h
+ *  @brief Interface for shared memory segments
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <stdint.h>
+#include <mutex.h>
+#include <ll.h>
+#include <frame_manager.h>
+
+/** @brief maximum number of pages of a single segment */
+#define SHM_MAX_PAGES 0xFFFF
+
+/** @brief defines a segment of memory shared between address spaces */
+typedef struct shm_seg {
+    /** @brief the name processes attach the segment by */
+    int key;
+    /** @brief the number of pages of the segment */
+    uint32_t num_pages;
+    /** @brief the blocks backing the segment, in address order */
+    frame_list_t runs;
+    /** @brief number of areas that map the segment */
+    uint32_t refcount;
+} shm_seg_t;
+
+/** @brief defines the table of every live segment */
+typedef struct shm_table {
+    /** @brief serializes lookups with the creation and teardown of
+     * segments */
+    mutex_t m;
+    /** @brief the live segments */
+    ll_t segs;
+    /** @brief number of segments ever created */
+    uint32_t num_created;
+    /** @brief number of segments torn down */
+    uint32_t num_destroyed;
+} shm_table_t;
+
+int shm_init(shm_table_t *t);
+int shm_get(shm_table_t *t, int key, uint32_t num_pages, shm_seg_t **seg);
+void shm_ref(shm_table_t *t, shm_seg_t *seg);
+void shm_put(shm_table_t *t, shm_seg_t *seg);
+
+#endif /* _SHM_H_ */
@@ -23,6 +23,8 @@ void enable_paging(void);
 
 void enable_pge(void);
 
+void enable_pse(void);
+
 uint32_t get_user_eflags(void);
 
 /** @brief flushes tlb containing address
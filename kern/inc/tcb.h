@@ -11,6 +11,7 @@
 #include <frame_manager.h>
 
 #include <pcb.h>
+#include <ll.h>
 
 #include <ureg.h>
 /** @brief possible tcb statuses */
@@ -67,11 +68,27 @@ typedef struct tcb{
      * at. Measured in number of ticks
      */
     uint32_t t_wakeup;
+    /**
+     * @brief Priority level of the run queue this tcb is in while it is
+     * runnable, level 0 runs first
+     */
+    int prio;
+    /**
+     * @brief Links this tcb into the run queue, waiting pool, sleep wheel
+     * bucket or zombie pool of the tcb pool that it is in. Holds the tcb
+     * itself while it is in a tcb pool, NULL otherwise
+     */
+    ll_node_t pool_node;
     /**
      * @brief The pcb that this tcb is running under. Multiple tcbs can have
      * the same pcb (multi-threaded)
      */
     pcb_t *pcb;
+    /**
+     * @brief The page directory this tcb runs in instead of its pcb's while
+     * it loads a program into another process, NULL otherwise
+     */
+    page_directory_t *loaned_pd;
 
     /**
      * @brief Bottom of this tcb's k_stack
@@ -123,7 +140,6 @@ typedef struct tcb{
 int tcb_init(tcb_t *tcb, int tid, pcb_t *pcb, uint32_t *regs);
 int tcb_get_pcb(tcb_t *tcb, pcb_t **pcb);
 int tcb_get_init_stack(tcb_t *tcb, void **stack);
-int tcb_t_wakeup_cmp(void *a, void *b);
 int tcb_reload(tcb_t *tcb, pcb_t *pcb);
 void tcb_destroy(tcb_t *tcb);
 int tcb_get_exit_status(tcb_t *tcb, int *status);
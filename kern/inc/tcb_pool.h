@@ -11,49 +11,106 @@
 #ifndef _TCB_POOL_H_
 #define _TCB_POOL_H_
 
+#include <stdlib.h>
 #include <ll.h>
-#include <ht.h>
+#include <id_table.h>
+#include <mutex.h>
 #include <tcb.h>
 #include <circ_buffer.h>
 
-#define TABLE_SIZE 64
+/** @brief number of priority levels, threads of level 0 run first */
+#define SCHED_NUM_PRIOS 8
+/** @brief base priority of a process that never set one */
+#define SCHED_DEFAULT_PRIO 4
+/** @brief number of levels above its base a thread is boosted to when it
+ * wakes up */
+#define SCHED_WAKE_BOOST 1
+/** @brief max number of levels below its base a thread sinks to by using up
+ * its quanta */
+#define SCHED_MAX_DECAY 2
+
+/** @brief number of buckets of the sleep wheel, a power of two. A thread
+ * sleeping for fewer ticks is woken up the first time its bucket comes up */
+#define SLEEP_WHEEL_SIZE 256
+
+/** @brief tcb_pool_get_next_tcb runs the runnable threads of a process back
+ * to back so that switching between them needs no page directory switch,
+ * comment out for plain round robin */
+#define SCHED_GROUP_PROCESSES
+/** @brief max number of threads of one process run back to back before
+ * every other runnable thread gets its turn again */
+#define SCHED_GROUP_MAX_RUN 4
+
 /**
  * @brief Struct representing a thread pool
  */
 typedef struct tcb_pool {
-    /** @brief hash table for thread */
-    ht_t threads;
-    /** @brief hash table for processes */
-    ht_t processes;
+    /** @brief table of tcbs indexed by tid */
+    id_table_t tids;
+    /** @brief table of pcbs indexed by pid */
+    id_table_t pids;
+    /** @brief serializes handing out and freeing tids and pids */
+    mutex_t ids_lock;
 
-    /** @brief linked list of runnable threads */
-    ll_t runnable_pool;
+    /** @brief runnable threads, one linked list per priority level */
+    ll_t run_queues[SCHED_NUM_PRIOS];
+    /** @brief bit i is set when run_queues[i] is not empty */
+    uint32_t run_bitmap;
+    /** @brief number of tcbs in the run queues */
+    uint32_t num_runnable;
     /** @brief linked list of waiting threads */
     ll_t waiting_pool;
-    /** @brief linke dlist of sleeping threads */
-    ll_t sleeping_pool;
+    /** @brief sleeping threads, hashed by wakeup tick into buckets of which
+     * one comes up every tick */
+    ll_t sleep_wheel[SLEEP_WHEEL_SIZE];
+    /** @brief number of sleeping threads */
+    uint32_t num_sleeping;
     /** @brief linked list of zombie threads */
     ll_t zombie_pool;
 
     /** @brief semaphore for signaling reaper thread */
     sem_t zombies_sem;
 
+    /** @brief the pcb of the tcb last handed out by tcb_pool_get_next_tcb,
+     * only ever compared against */
+    pcb_t *last_pcb;
+    /** @brief number of tcbs of last_pcb handed out in a row */
+    uint32_t group_run;
+    /** @brief number of tcbs run ahead of their turn to stay in the same
+     * process */
+    uint32_t num_grouped;
+    /** @brief number of times a thread was boosted on wakeup */
+    uint32_t num_boosts;
+    /** @brief number of times a thread sank a level for using up its
+     * quantum */
+    uint32_t num_decays;
+
     } tcb_pool_t;
 
 int tcb_pool_init(tcb_pool_t *tp);
 int tcb_pool_add_runnable_tcb_safe(tcb_pool_t *tp, tcb_t *tcb);
 int tcb_pool_add_pcb_safe(tcb_pool_t *tp, pcb_t *pcb);
-int tcb_pool_remove_pcb(tcb_pool_t *tp, int pid, circ_buf_t *addr_to_free);
+int tcb_pool_remove_pcb(tcb_pool_t *tp, int pid);
+int tcb_pool_alloc_tid(tcb_pool_t *tp);
+int tcb_pool_alloc_pid(tcb_pool_t *tp);
+int tcb_pool_free_tid(tcb_pool_t *tp, int tid);
+int tcb_pool_free_pid(tcb_pool_t *tp, int pid);
 
-int tcb_pool_make_runnable(tcb_pool_t *tp, int tid);
-int tcb_pool_make_waiting(tcb_pool_t *tp, int tid);
-int tcb_pool_make_sleeping(tcb_pool_t *tp, int tid);
-int tcb_pool_make_zombie(tcb_pool_t *tp, int tid);
+int tcb_pool_make_runnable(tcb_pool_t *tp, tcb_t *tcb);
+int tcb_pool_make_waiting(tcb_pool_t *tp, tcb_t *tcb);
+int tcb_pool_make_sleeping(tcb_pool_t *tp, tcb_t *tcb);
+int tcb_pool_make_zombie(tcb_pool_t *tp, tcb_t *tcb);
 int tcb_pool_wakeup(tcb_pool_t *tp, uint32_t curr_time);
+uint32_t tcb_pool_next_wakeup(tcb_pool_t *tp, uint32_t curr_time,
+        uint32_t max);
 int tcb_pool_reap(tcb_pool_t *tp);
 
-int tcb_pool_get_next_tcb(tcb_pool_t *tp, tcb_t **next_tcbp);
-int tcb_pool_remove_tcb(tcb_pool_t *tp, int tid, circ_buf_t *addr_to_free);
+int tcb_pool_get_next_tcb(tcb_pool_t *tp, tcb_t *cur_tcb, tcb_t **next_tcbp);
+int tcb_pool_expire_quantum(tcb_pool_t *tp, tcb_t *tcb);
+void tcb_pool_group_stats(tcb_pool_t *tp, uint32_t *num_grouped);
+void tcb_pool_prio_stats(tcb_pool_t *tp, uint32_t *num_boosts,
+        uint32_t *num_decays);
+int tcb_pool_remove_tcb(tcb_pool_t *tp, tcb_t *tcb);
 int tcb_pool_find_tcb(tcb_pool_t *tp, int tid, tcb_t **tcbp);
 int tcb_pool_find_pcb(tcb_pool_t *tp, int pid, pcb_t **pcbp);
 
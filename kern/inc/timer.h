@@ -0,0 +1,28 @@
+/** @file timer.h
+ *  @brief Defines the interface for the programmable interval timer
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <stdint.h>
+
+/** @brief the timer is stopped in between interrupts when at most one thread
+ * is runnable, comment out to always interrupt every tick */
+#define TIMER_TICKLESS
+
+/** @brief desired period between clock interrupts in milliseconds */
+#define TIMER_PERIOD_MS 10
+
+void timer_init(void);
+uint32_t timer_max_oneshot(void);
+void timer_oneshot(uint32_t ticks);
+uint32_t timer_periodic(void);
+uint32_t timer_fired(void);
+uint32_t timer_sync(void);
+int timer_is_oneshot(void);
+
+#endif /* _TIMER_H_ */
@@ -10,12 +10,72 @@
 #define _VIRTUAL_MEM_MGMT_H_
 
 #include <page_directory.h>
+#include <frame_manager.h>
 #include <mem_section.h>
 
-int vmm_map_sections(page_directory_t *pd, mem_section_t *secs, int num_secs);
+/** @brief fork shares frames copy-on-write instead of deep copying them,
+ * comment out to fall back to vmm_deep_copy */
+#define COW_FORK
+
+/** @brief writes to anonymous memory map a whole 4MB large page at once when
+ * the area covers it. Off by default, since it zeroes 1024 frames and may
+ * compact memory inside a single page fault, and makes the footprint of an
+ * area its size rather than the pages touched. Uncomment to enable */
+//#define LARGE_USER_PAGES
+
+/** @brief page fault error code bit set when the page was present */
+#define PF_ERR_PRESENT 0x1
+/** @brief page fault error code bit set when the access was a write */
+#define PF_ERR_WRITE 0x2
+/** @brief page fault error code bit set when the access was from user mode */
+#define PF_ERR_USER 0x4
+
+/** @brief number of pages a grow-down area grows by at a time */
+#define VMM_STACK_GROWTH_PAGES 8
+/** @brief how many pages below a grow-down area a fault may land and still
+ * grow the area */
+#define VMM_STACK_REACH_PAGES 32
+
+/** @brief max number of free frames zeroed per timer tick spent idle */
+#define VMM_ZERO_PER_TICK 4
+
+/** @brief order of the blocks compaction makes room for, that of a 4MB page */
+#define VMM_COMPACT_ORDER 10
+/** @brief per mille of free frames in blocks smaller than VMM_COMPACT_ORDER
+ * above which vmm_compact_idle compacts */
+#define VMM_COMPACT_UNUSABLE 750
+
+int vmm_map_sections(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs);
+int vmm_map_file_section(page_directory_t *pd, mem_section_t *ms,
+        const char *src, uint32_t src_len);
+int vmm_map_zero_sections(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs);
+int vmm_protect_sections(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs);
+int vmm_set_grows_down(page_directory_t *pd, uint32_t start, uint32_t limit);
+int vmm_grow_stack(page_directory_t *pd, uint32_t addr);
 int vmm_deep_copy(page_directory_t *pd_dest);
+int vmm_cow_copy(page_directory_t *pd_dest);
+int vmm_page_in(page_directory_t *pd, uint32_t v_addr, bool write);
+int vmm_resolve_fault(page_directory_t *pd, uint32_t addr,
+        uint32_t error_code);
 int vmm_new_user_page(page_directory_t *pd, uint32_t base, uint32_t num_pages);
 int vmm_remove_user_page(page_directory_t *pd, uint32_t base);
+int vmm_map_file(page_directory_t *pd, uint32_t base, const char *src,
+        uint32_t len);
+int vmm_shm_attach(page_directory_t *pd, int key, uint32_t base,
+        uint32_t num_pages);
+int vmm_shm_detach(page_directory_t *pd, uint32_t base);
+int vmm_check_user_range(page_directory_t *pd, uint32_t addr, uint32_t len,
+        bool write);
 int vmm_clear_user_space(page_directory_t *pd);
+int vmm_zero_idle_frames(uint32_t num_frames);
+int vmm_compact_init(void);
+int vmm_compact(uint32_t order, page_directory_t *held);
+void vmm_compact_idle(void);
+uint32_t vmm_compact_stats(fm_frag_t *before, fm_frag_t *after,
+        uint32_t *migrated);
+void zero_dirty_runs(frame_list_t *runs);
 
 #endif /* _VIRTUAL_MEM_MGMT_H_ */
@@ -0,0 +1,84 @@
+/** @file vm_area.h
+ *  @brief Interface for the set of virtual memory areas of an address space
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _VM_AREA_H_
+#define _VM_AREA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct shm_seg;
+
+/** @brief an area whose pages start out zeroed and get frames when touched */
+#define VMA_ANON 0
+/** @brief an area whose pages are filled in from a file when touched */
+#define VMA_FILE 1
+/** @brief an area whose pages were given frames when it was created */
+#define VMA_PRIVATE 2
+/** @brief an area that maps a shared memory segment */
+#define VMA_SHARED 3
+
+/** @brief number of areas a set has room for before it first grows */
+#define VMA_SET_INIT_CAP 8
+
+/** @brief defines a range of user memory with uniform permissions and
+ * backing */
+typedef struct vma {
+    /** @brief the virtual address the area starts at */
+    uint32_t start;
+    /** @brief the length of the area in bytes */
+    uint32_t len;
+    /** @brief the page table entry flags of the area's pages */
+    uint32_t pte_f;
+    /** @brief the page directory entry flags of the area's pages */
+    uint32_t pde_f;
+    /** @brief how the area's pages are backed (VMA_ANON, VMA_FILE,
+     * VMA_PRIVATE or VMA_SHARED) */
+    int type;
+    /** @brief whether the area was made by new_pages and may be removed by
+     * remove_pages */
+    bool removable;
+    /** @brief the bytes of the file backing a VMA_FILE area */
+    const char *src;
+    /** @brief the number of bytes available at src, the rest is zeroes */
+    uint32_t src_len;
+    /** @brief the lowest address the area may grow down to when touched
+     * just below its start, or 0 if it does not grow */
+    uint32_t grow_limit;
+    /** @brief the segment a VMA_SHARED area maps */
+    struct shm_seg *seg;
+} vma_t;
+
+/** @brief defines a set of non overlapping areas kept sorted by address */
+typedef struct vma_set {
+    /** @brief the areas in increasing order of address */
+    vma_t *vmas;
+    /** @brief the number of areas in the set */
+    uint32_t size;
+    /** @brief the number of areas vmas has room for */
+    uint32_t cap;
+} vma_set_t;
+
+/** @brief gets the last byte of an area, which does not overflow for an
+ * area that ends at the top of the address space */
+#define VMA_LAST(vma) ((vma)->start + ((vma)->len - 1))
+
+int vma_init(vma_t *vma, uint32_t start, uint32_t len, uint32_t pte_f,
+        uint32_t pde_f, int type);
+int vma_set_init(vma_set_t *set);
+int vma_set_insert(vma_set_t *set, vma_t *vma);
+int vma_set_remove(vma_set_t *set, uint32_t start, vma_t *vma);
+int vma_set_find(vma_set_t *set, uint32_t addr, vma_t **vma);
+int vma_set_first_overlap(vma_set_t *set, uint32_t low, uint32_t high,
+        uint32_t *idx);
+bool vma_set_overlaps(vma_set_t *set, uint32_t low, uint32_t high);
+int vma_set_copy(vma_set_t *dest, vma_set_t *src);
+void vma_set_clear(vma_set_t *set);
+void vma_set_destroy(vma_set_t *set);
+
+#endif /* _VM_AREA_H_ */
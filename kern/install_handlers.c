@@ -12,6 +12,7 @@
 /* some common byte masks and offsets */
 #include <constants.h>
 #include <syscall_int.h>
+#include <ext_syscall_int.h>
 
 /* idt_base() */
 #include <x86/asm.h>
@@ -25,17 +26,11 @@
 #include <circ_buffer.h>
 /* access to keyboard_buffer */
 #include <kern_internals.h>
+#include <timer.h>
 /**
  * CONSTANTS
  */
 
-/** @brief desired period between clock interrupts in milliseconds */
-#define TIMER_PERIOD_MS 10
-/** @brief number of milliseconds per second */
-#define C_MS_PER_SEC 1000
-/** @brief the number of clock cycles to wait per interrupt */
-#define TIMER_CYCLES ((TIMER_RATE * TIMER_PERIOD_MS) / C_MS_PER_SEC)
-
 /** @brief (2 byte) offset of lower 2 bytes of handler from idt entry */
 #define LOFFSET_OFFSET 0
 /** @brief (2 byte) offset of segement selector from idt entry */
@@ -127,6 +122,7 @@ int install_syscall_handlers(){
     INSTALL_SYSCALL(syscall_set_status_handler, SET_STATUS_INT);
     INSTALL_SYSCALL(syscall_vanish_handler, VANISH_INT);
     INSTALL_SYSCALL(syscall_wait_handler, WAIT_INT);
+    INSTALL_SYSCALL(syscall_spawn_handler, SPAWN_INT);
 
     /* thrmgmt */
     INSTALL_SYSCALL(syscall_gettid_handler, GETTID_INT);
@@ -136,10 +132,14 @@ int install_syscall_handlers(){
     INSTALL_SYSCALL(syscall_get_ticks_handler, GET_TICKS_INT);
     INSTALL_SYSCALL(syscall_sleep_handler, SLEEP_INT);
     INSTALL_SYSCALL(syscall_swexn_handler, SWEXN_INT);
+    INSTALL_SYSCALL(syscall_set_priority_handler, SET_PRIORITY_INT);
 
     /* Mem MGMT */
     INSTALL_SYSCALL(syscall_new_pages_handler, NEW_PAGES_INT);
     INSTALL_SYSCALL(syscall_remove_pages_handler, REMOVE_PAGES_INT);
+    INSTALL_SYSCALL(syscall_shm_attach_handler, SHM_ATTACH_INT);
+    INSTALL_SYSCALL(syscall_shm_detach_handler, SHM_DETACH_INT);
+    INSTALL_SYSCALL(syscall_map_file_handler, MAP_FILE_INT);
 
     /* console io*/
     //INSTALL_SYSCALL(syscall_getchar_handler, GETCHAR_INT);
@@ -242,8 +242,6 @@ int install_exception_handlers() {
  *  @return 0
  */
 int install_peripheral_handlers(){
-    char lsb, msb;
-
     /* install IDT entry for timer*/
 
     idt_install_entry((uint32_t)timer_handler, SEGSEL_KERNEL_CS,
@@ -251,11 +249,7 @@ int install_peripheral_handlers(){
 
     /* setup timer */
 
-    outb(TIMER_SQUARE_WAVE, TIMER_MODE_IO_PORT);
-    lsb = TIMER_CYCLES & C_BYTE_MASK;
-    msb = (TIMER_CYCLES >> C_BYTE_WIDTH) & C_BYTE_MASK;
-    outb(lsb, TIMER_PERIOD_IO_PORT);
-    outb(msb, TIMER_PERIOD_IO_PORT);
+    timer_init();
 
     /* install IDT entry for keyboard */
     idt_install_entry((uint32_t)keyboard_handler, SEGSEL_KERNEL_CS,
@@ -29,6 +29,8 @@
 #include <install_handlers.h>
 /* frame manager include */
 #include <frame_manager.h>
+/* vmm_compact_init, vmm_compact_idle */
+#include <virtual_mem_mgmt.h>
 /* process control block include */
 #include <pcb.h>
 /* control for special register wrapper */
@@ -54,6 +56,9 @@
 scheduler_t sched;
 mutex_t heap_lock;
 frame_manager_t fm;
+page_cache_t pcache;
+pt_pool_t ptpool;
+shm_table_t shmtab;
 mutex_t console_lock;
 keyboard_t keyboard;
 sched_mutex_t sched_lock;
@@ -65,6 +70,8 @@ sched_mutex_t sched_lock;
 void reaper_main(){
     while(1){
         scheduler_reap(&sched);
+        /* reaping frees memory, so this is when it is worth compacting */
+        vmm_compact_idle();
     }
 }
 
@@ -101,6 +108,14 @@ int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
     keyboard_init(&keyboard, KEYBOARD_BUFFER_SIZE);
     /* init frame manager */
     fm_init(&fm, 15);
+    /* init the executable page cache */
+    pc_init(&pcache);
+    /* reserve pages for page tables and directories */
+    ptp_init(&ptpool, PTP_INIT_PAGES);
+    /* no shared memory segments exist yet */
+    shm_init(&shmtab);
+    /* nothing is being compacted yet */
+    vmm_compact_init();
     /* initialize pd kernel pages */
     pd_init_kernel();
 
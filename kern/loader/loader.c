@@ -59,6 +59,24 @@ int getbytes( const char *filename, int offset, int size, char *buf )
     return -1;
 }
 
+/** @brief Finds the bytes of a file on the RAM disk
+ *  @param filename The name of the file
+ *  @param bytes Where to store the address of the file's bytes
+ *  @param len Where to store the length of the file
+ *  @return 0 on success, -1 if there is no such file
+ */
+int getfile(const char *filename, const char **bytes, int *len){
+    int i;
+    for (i = 0; i < exec2obj_userapp_count; i++){
+        if (strcmp(exec2obj_userapp_TOC[i].execname, filename) == 0){
+            *bytes = exec2obj_userapp_TOC[i].execbytes;
+            *len = exec2obj_userapp_TOC[i].execlen;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 /** @brief checks if elf file exists
  *  @param filename The filename of the elf
  *  @return whether the elf file exists
@@ -86,8 +104,31 @@ int load_elf_sections(simple_elf_t *elf, pcb_t *pcb){
     ms_init(&secs[3], elf->e_bssstart,
                         elf->e_bsslen, USER_WR, USER_WR);
 
-    /* Map all appropriate elf binary sections into user space */
-    if (vmm_map_sections(&(pcb->pd), secs, NUM_ELF_SECTIONS) < 0) return -1;
+#ifdef LAZY_EXEC
+    const char *bytes;
+    int len, i;
+    if (getfile(elf->e_fname, &bytes, &len) < 0) return -1;
+    unsigned long offs[NUM_ELF_SECTIONS-1] =
+        { elf->e_txtoff, elf->e_datoff, elf->e_rodatoff };
+
+    /* Register the sections backed by the elf binary, their pages are read
+     * straight out of the RAM disk when they are first touched */
+    for (i = 0; i < NUM_ELF_SECTIONS-1; i++){
+        uint32_t avail = offs[i] < (unsigned long)len ? len - offs[i] : 0;
+        if (vmm_map_file_section(&(pcb->pd), &secs[i], bytes + offs[i],
+                    avail) < 0) return -1;
+    }
+
+    /* .bss is demand-zero, except for any page it shares with the sections
+     * above, which are zero filled past the end of the file bytes */
+    if (vmm_map_zero_sections(&(pcb->pd), &secs[3], 1) < 0) return -1;
+#else
+    /* Map the sections backed by the elf binary into user space */
+    if (vmm_map_sections(&(pcb->pd), secs, NUM_ELF_SECTIONS-1) < 0) return -1;
+
+    /* .bss is demand-zero, except for any page it shares with the sections
+     * above, which vmm_map_sections has already zeroed */
+    if (vmm_map_zero_sections(&(pcb->pd), &secs[3], 1) < 0) return -1;
 
     /* Fill in .text section */
     if (getbytes(elf->e_fname, elf->e_txtoff, elf->e_txtlen,
@@ -101,8 +142,10 @@ int load_elf_sections(simple_elf_t *elf, pcb_t *pcb){
     if (getbytes(elf->e_fname, elf->e_rodatoff, elf->e_rodatlen,
                  (char*)elf->e_rodatstart) != elf->e_rodatlen) return -1;
 
-    /* Clear .bss section */
-    memset((void *)elf->e_bssstart, 0, elf->e_bsslen);
+    /* Now that the sections are filled in, write protect .text and .rodata */
+    if (vmm_protect_sections(&(pcb->pd), secs, NUM_ELF_SECTIONS) < 0)
+        return -1;
+#endif
 
     /* Set process entry point */
     pcb->entry_point = elf->e_entry;
@@ -117,14 +160,33 @@ int load_elf_sections(simple_elf_t *elf, pcb_t *pcb){
 int load_user_stack(pcb_t *pcb) {
     if (pcb == NULL) return -1;
 
-    /* Calculate user stack bottom */
-    mem_section_t stack_secs[1];
-
-    ms_init(&stack_secs[0], USER_STACK_BOTTOM,
-                        USER_STACK_SIZE, USER_WR, USER_WR);
+    /* Find out how much of the stack the arguments take up. Those pages are
+     * written to right away, possibly before the scheduler knows which page
+     * directory is active, so they cannot be demand-zero */
+    uint32_t arg_bytes = (pcb->argc + 7) * sizeof(uint32_t);
+    int j;
+    for (j = 0; j < pcb->argc; j++) {
+        arg_bytes += strlen(pcb->argv[j]) + 1;
+    }
+    uint32_t eager_bottom = PAGE_ALIGN_DOWN(USER_STACK_TOP - arg_bytes);
+    if (eager_bottom < USER_STACK_BOTTOM) eager_bottom = USER_STACK_BOTTOM;
 
-    /* Allocate and map space for stack in virtual memory */
-    if (vmm_map_sections(&(pcb->pd), stack_secs, 1) < 0) return -2;
+    /* Calculate user stack bottom */
+    mem_section_t stack_secs[2];
+
+    ms_init(&stack_secs[0], eager_bottom,
+                        USER_STACK_TOP - eager_bottom, USER_WR, USER_WR);
+    ms_init(&stack_secs[1], USER_STACK_BOTTOM,
+                        eager_bottom - USER_STACK_BOTTOM, USER_WR, USER_WR);
+
+    /* Allocate and map space for the arguments in virtual memory, the rest
+     * of the stack gets frames as it is touched */
+    if (vmm_map_sections(&(pcb->pd), &stack_secs[0], 1) < 0) return -2;
+    if (vmm_map_zero_sections(&(pcb->pd), &stack_secs[1], 1) < 0) return -2;
+    /* the kernel grows the stack when it is touched below its bottom */
+    if (vmm_set_grows_down(&(pcb->pd), stack_secs[1].len > 0 ?
+                USER_STACK_BOTTOM : eager_bottom, USER_STACK_LIMIT) < 0)
+        return -2;
 
     /* Setup user stack for entry point */
     uint32_t *stack_top = (uint32_t *) USER_STACK_TOP;
@@ -71,6 +71,21 @@ void mutex_lock( mutex_t *mp ){
     return;
 }
 
+/** @brief Locks a mutex only if it is free
+ *  @param mp Pointer to mutex to be locked
+ *  @return 0 if the mutex was locked, negative code if it is taken
+ */
+int mutex_trylock( mutex_t *mp ){
+    if (!sched.started) return 0;
+    if (!xchng(&mp->lock, 0)) return -1;
+    int cur_tid;
+    if (scheduler_get_current_tid(&sched, &cur_tid) < 0){
+        cur_tid = -1;
+    }
+    mp->owner = cur_tid;
+    return 0;
+}
+
 /** @brief Unlocks a mutex
  *  @param mp Pointer to mutex to be unlocked
  *  @return Void
@@ -49,6 +49,7 @@ int pcb_init(pcb_t *pcb){
     pcb->original_tid = -1;
     pcb->num_child_proc = 0;
     pcb->num_threads = 0;
+    pcb->prio = SCHED_DEFAULT_PRIO;
 
     /* Initialize a pcb's page directory */
     pd_init(&(pcb->pd));
@@ -113,11 +114,19 @@ int pcb_copy(pcb_t *dest_pcb, pcb_t *source_pcb) {
     /* Set parent pid of dest_pcb to pid of source_pcb
      * since source_pcb is the parent */
     dest_pcb->ppid = source_pcb->pid;
+    /* The child inherits the base priority */
+    dest_pcb->prio = source_pcb->prio;
 
     /* Copy current user address space */
+#ifdef COW_FORK
+    if(vmm_cow_copy(&(dest_pcb->pd)) < 0) {
+        return -2;
+    }
+#else
     if(vmm_deep_copy(&(dest_pcb->pd)) < 0) {
         return -2;
     }
+#endif
 
     return 0;
 }
@@ -19,6 +19,7 @@
 #include <special_reg_cntrl.h>
 /* set_esp0 */
 #include <x86/cr.h>
+#include <timer.h>
 
 #include <simics.h>
 
@@ -60,12 +61,17 @@ int scheduler_add_idle_process(scheduler_t *sched, pcb_t *idle_pcb) {
     if (sched == NULL) return -1;
 
     /* Set pid of idle_pcb */
-    idle_pcb->pid = sched->next_pid++;
+    idle_pcb->pid = tcb_pool_alloc_pid(&(sched->thr_pool));
+    if (idle_pcb->pid < 0) return -2;
 
     /* Create idle tcb */
     tcb_t *idle_tcb = malloc(sizeof(tcb_t));
     if (idle_tcb == NULL) return -2;
-    int tid = sched->next_tid++;
+    int tid = tcb_pool_alloc_tid(&(sched->thr_pool));
+    if (tid < 0) {
+        free(idle_tcb);
+        return -2;
+    }
     tcb_init(idle_tcb, tid, idle_pcb, NULL);
 
     /* Save into scheduler */
@@ -116,7 +122,11 @@ int scheduler_add_reaper_proc(scheduler_t *sched,
     /* Create reaper tcb */
     tcb_t *reaper_tcb = malloc(sizeof(tcb_t));
     if (reaper_tcb == NULL) return -2;
-    int tid = sched->next_tid++;
+    int tid = tcb_pool_alloc_tid(&(sched->thr_pool));
+    if (tid < 0) {
+        free(reaper_tcb);
+        return -2;
+    }
 
     /* Init new tcb */
     if (tcb_init(reaper_tcb, tid, reaper_pcb, regs) < 0) {
@@ -151,9 +161,11 @@ int scheduler_init(scheduler_t *sched, void (*reap_func)(void)){
     sched->started = false;
 
     sched->num_ticks = 0;
-    sched->next_tid = 0;
-    sched->next_pid = 0;
     sched->cur_tcb = NULL;
+    sched->num_pdbr_loads = 0;
+    sched->num_pdbr_skips = 0;
+    sched->num_oneshots = 0;
+    sched->num_skipped_ticks = 0;
 
     /* Malloc a cleanup_stack */
     sched->reaper_stack_bot = malloc(4*PAGE_SIZE);
@@ -179,6 +191,7 @@ int scheduler_init(scheduler_t *sched, void (*reap_func)(void)){
     set_pdbr((uint32_t) pd_get_base_addr(&idle_pcb->pd));
 
     enable_pge();
+    enable_pse();
     enable_paging();
 
     /* Load idle program */
@@ -317,7 +330,7 @@ int scheduler_deschedule_current(scheduler_t *sched) {
     if (sched == NULL) return -1;
 
     /* Manipulate tcb_pool*/
-    if (tcb_pool_make_waiting(&(sched->thr_pool), sched->cur_tcb->tid) < 0) {
+    if (tcb_pool_make_waiting(&(sched->thr_pool), sched->cur_tcb) < 0) {
         return -3;
     }
     /* Set current tcb to WAITING */
@@ -330,7 +343,7 @@ int scheduler_deschedule_current(scheduler_t *sched) {
  * @brief Disables interrupts and deschedules the current tcb
  *
  * Context switch must not happen while modifying scheduler
- * data structures i.e. runnable_pool, waiting_pool
+ * data structures i.e. run queues, waiting_pool
  *
  * @param sched Scheduler to manipulate
  *
@@ -355,18 +368,21 @@ int scheduler_deschedule_current_safe(scheduler_t *sched) {
 int scheduler_make_runnable(scheduler_t *sched, int tid) {
     if (sched == NULL) return -1;
 
-    /* Manipulate tcb_pool*/
-    if (tcb_pool_make_runnable(&(sched->thr_pool), tid) < 0) {
-        return -2;
-    }
-
     tcb_t *tcb;
     /* Get specified tcb */
     if (tcb_pool_find_tcb(&(sched->thr_pool), tid, &tcb) < 0) return -3;
 
+    /* Manipulate tcb_pool*/
+    if (tcb_pool_make_runnable(&(sched->thr_pool), tcb) < 0) {
+        return -2;
+    }
+
     /* Set current tcb to RUNNABLE */
     tcb->status = RUNNABLE;
 
+    /* It may need to be preempted */
+    scheduler_resume_ticks(sched);
+
     return -0;
 }
 
@@ -375,7 +391,7 @@ int scheduler_make_runnable(scheduler_t *sched, int tid) {
  * tid runnable
  *
  * Context switch must not happen while modifying scheduler
- * data structures i.e. runnable_pool, waiting_pool
+ * data structures i.e. run queues, waiting_pool
  *
  * @param sched Scheduler to manipulate
  * @param tid tid of tcb to make runnable
@@ -405,6 +421,8 @@ int scheduler_make_current_sleeping(scheduler_t *sched, int ticks) {
 
     /* Somehow already sleeping...?*/
     if (sched->cur_tcb->status == SLEEPING) return -4;
+    /* Count the ticks that went by, it may wake up before the timer fires */
+    scheduler_resume_ticks(sched);
     /* Set current tcb to RUNNABLE */
     sched->cur_tcb->status = SLEEPING;
     /* Check for overflow (should not happen for several years) */
@@ -415,7 +433,7 @@ int scheduler_make_current_sleeping(scheduler_t *sched, int ticks) {
     sched->cur_tcb->t_wakeup = sched->num_ticks+ticks;
 
     /* Manipulate tcb_pool*/
-    if (tcb_pool_make_sleeping(&(sched->thr_pool), sched->cur_tcb->tid) < 0) {
+    if (tcb_pool_make_sleeping(&(sched->thr_pool), sched->cur_tcb) < 0) {
         return -2;
     }
 
@@ -427,7 +445,7 @@ int scheduler_make_current_sleeping(scheduler_t *sched, int ticks) {
  * tid sleeping
  *
  * Context switch must not happen while modifying scheduler
- * data structures i.e. runnable_pool, waiting_pool
+ * data structures i.e. run queues, waiting_pool
  *
  * @param sched Scheduler to manipulate
  * @param tid tid of tcb to make sleeping
@@ -460,7 +478,7 @@ int scheduler_make_current_sleeping_safe(scheduler_t *sched, int ticks) {
  */
 int scheduler_make_current_zombie(scheduler_t *sched) {
     if (sched == NULL) return -1;
-    if (tcb_pool_make_zombie(&(sched->thr_pool), sched->cur_tcb->tid) < 0) {
+    if (tcb_pool_make_zombie(&(sched->thr_pool), sched->cur_tcb) < 0) {
         return -2;
     }
     /* Make current tcb NULL */
@@ -474,7 +492,7 @@ int scheduler_make_current_zombie(scheduler_t *sched) {
  * tid a zombie
  *
  * Context switch must not happen while modifying scheduler
- * data structures i.e. runnable_pool, waiting_pool
+ * data structures i.e. run queues, waiting_pool
  *
  * @param sched Scheduler to manipulate
  * @param tid tid of tcb to make zombie
@@ -520,17 +538,31 @@ int scheduler_add_process(scheduler_t *sched, pcb_t *pcb, uint32_t *regs){
     if (sched == NULL) return -1;
 
     /* Assign next pid */
-    pcb->pid = sched->next_pid++;
+    pcb->pid = tcb_pool_alloc_pid(&(sched->thr_pool));
+    if (pcb->pid < 0) return -2;
 
     /* Get next tid */
-    int tid = sched->next_tid++;
+    int tid = tcb_pool_alloc_tid(&(sched->thr_pool));
+    if (tid < 0) {
+        tcb_pool_free_pid(&(sched->thr_pool), pcb->pid);
+        return -2;
+    }
 
     /* Add a new tcb to run the pcb*/
     tcb_t *new_tcb = malloc(sizeof(tcb_t));
-    if (new_tcb == NULL) return -2;
+    if (new_tcb == NULL) {
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        tcb_pool_free_pid(&(sched->thr_pool), pcb->pid);
+        return -2;
+    }
 
     /* Init new tcb */
-    if (tcb_init(new_tcb, tid, pcb, regs) < 0) return -3;
+    if (tcb_init(new_tcb, tid, pcb, regs) < 0) {
+        free(new_tcb);
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        tcb_pool_free_pid(&(sched->thr_pool), pcb->pid);
+        return -3;
+    }
 
     /* Set the original tid of the pcb */
     pcb_set_original_tid(pcb, tid);
@@ -538,9 +570,28 @@ int scheduler_add_process(scheduler_t *sched, pcb_t *pcb, uint32_t *regs){
     pcb_inc_threads_s(pcb);
 
     /* Add the pcb to the pool */
-    if (tcb_pool_add_pcb_safe(&(sched->thr_pool), pcb) < 0) return -4;
+    if (tcb_pool_add_pcb_safe(&(sched->thr_pool), pcb) < 0) {
+        pcb_dec_threads_s(pcb);
+        tcb_destroy(new_tcb);
+        free(new_tcb);
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        tcb_pool_free_pid(&(sched->thr_pool), pcb->pid);
+        return -4;
+    }
     /* Add a runnable tcb to pool */
-    if (tcb_pool_add_runnable_tcb_safe(&(sched->thr_pool), new_tcb) < 0) return -3;
+    if (tcb_pool_add_runnable_tcb_safe(&(sched->thr_pool), new_tcb) < 0) {
+        pcb_dec_threads_s(pcb);
+        /* Nothing may find the pcb by its pid once the pid is freed */
+        sched_mutex_lock(&sched_lock);
+        tcb_pool_remove_pcb(&(sched->thr_pool), pcb->pid);
+        sched_mutex_unlock(&sched_lock);
+        tcb_destroy(new_tcb);
+        free(new_tcb);
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        tcb_pool_free_pid(&(sched->thr_pool), pcb->pid);
+        return -3;
+    }
+    scheduler_resume_ticks_safe(sched);
 
     /* Return tid of tcb added */
     return tid;
@@ -550,19 +601,34 @@ int scheduler_add_new_thread(scheduler_t *sched, uint32_t *regs) {
     if (sched == NULL) return -1;
 
     /* Get next tid */
-    int tid = sched->next_tid++;
+    int tid = tcb_pool_alloc_tid(&(sched->thr_pool));
+    if (tid < 0) return -2;
 
     /* Add a new tcb to run the pcb*/
     tcb_t *new_tcb = malloc(sizeof(tcb_t));
-    if (new_tcb == NULL) return -2;
+    if (new_tcb == NULL) {
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        return -2;
+    }
 
     /* Init new tcb */
-    if (tcb_init(new_tcb, tid, sched->cur_tcb->pcb, regs) < 0) return -3;
+    if (tcb_init(new_tcb, tid, sched->cur_tcb->pcb, regs) < 0) {
+        free(new_tcb);
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        return -3;
+    }
 
     /* Inc num threads in pcb */
     pcb_inc_threads_s(sched->cur_tcb->pcb);
     /* Safely add a runnable tcb to pool */
-    if (tcb_pool_add_runnable_tcb_safe(&(sched->thr_pool), new_tcb) < 0) return -3;
+    if (tcb_pool_add_runnable_tcb_safe(&(sched->thr_pool), new_tcb) < 0) {
+        pcb_dec_threads_s(sched->cur_tcb->pcb);
+        tcb_destroy(new_tcb);
+        free(new_tcb);
+        tcb_pool_free_tid(&(sched->thr_pool), tid);
+        return -3;
+    }
+    scheduler_resume_ticks_safe(sched);
 
     /* Return tid of tcb added */
     return tid;
@@ -612,10 +678,144 @@ int scheduler_defer_current_tcb(scheduler_t *sched, uint32_t old_esp) {
     return 0;
 }
 
+/**
+ * @brief Lowers the priority of the current tcb for using up its quantum
+ *
+ * SHOULD ONLY BE USED BY THE TIMER HANDLER
+ *
+ * @param sched Scheduler of the current tcb
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_expire_quantum(scheduler_t *sched) {
+    if (sched == NULL || sched->cur_tcb == NULL
+        || sched->cur_tcb == sched->idle_tcb) return -1;
+    return tcb_pool_expire_quantum(&(sched->thr_pool), sched->cur_tcb);
+}
+
+/**
+ * @brief Sets the base priority of the current pcb. Its threads move to
+ * their new levels the next time they are requeued.
+ *
+ * @param sched Scheduler of the current pcb
+ * @param prio New base priority, from 0 (runs first) to SCHED_NUM_PRIOS - 1
+ *
+ * @return The old base priority on success, negative error code otherwise
+ */
+int scheduler_set_priority(scheduler_t *sched, int prio) {
+    if (sched == NULL || sched->cur_tcb == NULL) return -1;
+    if (prio < 0 || prio >= SCHED_NUM_PRIOS) return -2;
+
+    pcb_t *pcb = sched->cur_tcb->pcb;
+    sched_mutex_lock(&sched_lock);
+    int old_prio = pcb->prio;
+    pcb->prio = prio;
+    sched_mutex_unlock(&sched_lock);
+
+    return old_prio;
+}
+
 int scheduler_wakeup(scheduler_t *sched){
     return tcb_pool_wakeup(&(sched->thr_pool), sched->num_ticks);
 }
 
+/**
+ * @brief Counts ticks that went by, waking up the threads due on each
+ *
+ * Must be called with the scheduler locked or from the timer handler
+ *
+ * @param sched Scheduler to advance
+ * @param ticks Number of ticks that went by
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_advance_ticks(scheduler_t *sched, uint32_t ticks) {
+    if (sched == NULL) return -1;
+    if (ticks > 1) sched->num_skipped_ticks += ticks - 1;
+    while (ticks-- > 0) {
+        sched->num_ticks++;
+        if (scheduler_wakeup(sched) < 0) return -2;
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes the timer interrupt every tick again if it was armed once
+ *
+ * Called whenever a thread becomes runnable or goes to sleep while the
+ * timer may be armed once, since the thread may then need to be preempted
+ * or woken up before the timer fires. Must be called with the scheduler
+ * locked.
+ *
+ * @param sched Scheduler to resume ticks for
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_resume_ticks(scheduler_t *sched) {
+    if (sched == NULL) return -1;
+    if (!timer_is_oneshot()) return 0;
+    return scheduler_advance_ticks(sched, timer_periodic());
+}
+
+/**
+ * @brief Locks the scheduler and resumes ticks
+ *
+ * @param sched Scheduler to resume ticks for
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_resume_ticks_safe(scheduler_t *sched) {
+    sched_mutex_lock(&sched_lock);
+    int status = scheduler_resume_ticks(sched);
+    sched_mutex_unlock(&sched_lock);
+    return status;
+}
+
+/**
+ * @brief Programs when the timer interrupts next
+ *
+ * With at most one runnable thread there is nobody to preempt it for, so the
+ * timer is armed to interrupt once, when the first sleeping thread is due.
+ * Otherwise it interrupts every tick.
+ *
+ * SHOULD ONLY BE USED BY THE TIMER HANDLER
+ *
+ * @param sched Scheduler to program the timer for
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_program_timer(scheduler_t *sched) {
+    if (sched == NULL) return -1;
+#ifdef TIMER_TICKLESS
+    if (sched->thr_pool.num_runnable <= 1) {
+        uint32_t ticks = tcb_pool_next_wakeup(&(sched->thr_pool),
+                sched->num_ticks, timer_max_oneshot());
+        if (ticks > 1) {
+            timer_oneshot(ticks);
+            sched->num_oneshots++;
+            return 0;
+        }
+    }
+#endif
+    return scheduler_advance_ticks(sched, timer_periodic());
+}
+
+/**
+ * @brief Gets the number of ticks since the scheduler started, counting
+ * those that went by since the timer was armed once
+ *
+ * @param sched Scheduler to get the ticks of
+ *
+ * @return the number of ticks
+ */
+int scheduler_get_ticks(scheduler_t *sched) {
+    sched_mutex_lock(&sched_lock);
+    scheduler_advance_ticks(sched, timer_sync());
+    int ticks = sched->num_ticks;
+    sched_mutex_unlock(&sched_lock);
+    return ticks;
+}
+
 int scheduler_reap(scheduler_t *sched){
     return tcb_pool_reap(&(sched->thr_pool));
 }
@@ -631,7 +831,7 @@ int scheduler_reap(scheduler_t *sched){
  *
  * Processor Level tasks:
  * Set new esp0
- * Set new pdbr
+ * Set new pdbr, unless it is already loaded
  *
  * SHOULD ONLY BE USED BY CONTEXT_SWITCH
  *
@@ -653,12 +853,104 @@ int scheduler_set_running_tcb(scheduler_t *sched, tcb_t *tcb, uint32_t *new_esp)
     /* Set new esp0 */
     set_esp0((uint32_t)(tcb->orig_k_stack));
 
-    /* Set new page directory */
-    set_pdbr((uint32_t) pd_get_base_addr(&(tcb->pcb->pd)));
+    /* Set new page directory. Threads of the same process share one, and
+     * reloading it would only flush their tlb entries */
+    page_directory_t *pd = (tcb->loaned_pd != NULL) ?
+        tcb->loaned_pd : &(tcb->pcb->pd);
+    uint32_t pdbr = (uint32_t) pd_get_base_addr(pd);
+    if (REMOVE_FLAGS(get_pdbr()) != pdbr) {
+        set_pdbr(pdbr);
+        sched->num_pdbr_loads++;
+    } else {
+        sched->num_pdbr_skips++;
+    }
 
     return 0;
 }
 
+/**
+ * @brief Makes the current tcb run in another page directory than its pcb's
+ * until it is called again with NULL
+ *
+ * This lets a thread load a program straight into a new process. Page faults
+ * are still resolved against the tcb's own pcb, so the other page directory
+ * must only be touched where it is mapped already.
+ *
+ * @param sched Scheduler of the current tcb
+ * @param pd Page directory to run in, or NULL for the pcb's own
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int scheduler_loan_pd(scheduler_t *sched, page_directory_t *pd) {
+    if (sched == NULL || sched->cur_tcb == NULL) return -1;
+
+    /* A context switch in between would load the wrong directory */
+    sched_mutex_lock(&sched_lock);
+    sched->cur_tcb->loaned_pd = pd;
+    if (pd == NULL) pd = &(sched->cur_tcb->pcb->pd);
+    set_pdbr((uint32_t) pd_get_base_addr(pd));
+    sched_mutex_unlock(&sched_lock);
+
+    return 0;
+}
+
+/**
+ * @brief Reports how many context switches loaded a new page directory,
+ * how many kept the one already loaded, and how many threads were run
+ * ahead of their turn to keep it
+ *
+ * @param sched Scheduler to report on
+ * @param num_loads Address to put the number of loads (optional)
+ * @param num_skips Address to put the number of skips (optional)
+ * @param num_grouped Address to put the number of threads run ahead of
+ * their turn (optional)
+ *
+ * @return Void
+ */
+void scheduler_switch_stats(scheduler_t *sched, uint32_t *num_loads,
+        uint32_t *num_skips, uint32_t *num_grouped) {
+    if (sched == NULL) return;
+    if (num_loads != NULL) *num_loads = sched->num_pdbr_loads;
+    if (num_skips != NULL) *num_skips = sched->num_pdbr_skips;
+    if (num_grouped != NULL)
+        tcb_pool_group_stats(&(sched->thr_pool), num_grouped);
+}
+
+/**
+ * @brief Reports how many times threads were boosted on wakeup and how many
+ * times they sank a priority level for using up their quantum
+ *
+ * @param sched Scheduler to report on
+ * @param num_boosts Address to put the number of boosts (optional)
+ * @param num_decays Address to put the number of decays (optional)
+ *
+ * @return Void
+ */
+void scheduler_prio_stats(scheduler_t *sched, uint32_t *num_boosts,
+        uint32_t *num_decays) {
+    if (sched == NULL) return;
+    tcb_pool_prio_stats(&(sched->thr_pool), num_boosts, num_decays);
+}
+
+/**
+ * @brief Reports how often the timer was armed once and how many ticks went
+ * by without an interrupt of their own
+ *
+ * @param sched Scheduler to report on
+ * @param num_oneshots Address to put the number of times the timer was
+ *        armed once (optional)
+ * @param num_skipped Address to put the number of ticks counted without an
+ *        interrupt (optional)
+ *
+ * @return Void
+ */
+void scheduler_timer_stats(scheduler_t *sched, uint32_t *num_oneshots,
+        uint32_t *num_skipped) {
+    if (sched == NULL) return;
+    if (num_oneshots != NULL) *num_oneshots = sched->num_oneshots;
+    if (num_skipped != NULL) *num_skipped = sched->num_skipped_ticks;
+}
+
 /**
  * @brief Reports the next tcb to run/schedule
  *
@@ -670,8 +962,9 @@ int scheduler_set_running_tcb(scheduler_t *sched, tcb_t *tcb, uint32_t *new_esp)
 int scheduler_get_next_tcb(scheduler_t *sched, tcb_t **tcbp) {
     if (sched == NULL || tcbp == NULL) return -1;
 
-    /* Cycle runnable pool and get next tcb to run */
-    if (tcb_pool_get_next_tcb(&(sched->thr_pool), tcbp) < 0) {
+    /* Requeue the current tcb and get the next tcb to run */
+    if (tcb_pool_get_next_tcb(&(sched->thr_pool),
+                sched->cur_tcb, tcbp) < 0) {
         /* Runnable Pool is empty, or some other error occured
          * run the idle tcb */
         *tcbp = sched->idle_tcb;
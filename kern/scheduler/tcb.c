@@ -75,6 +75,10 @@ int tcb_init(tcb_t *tcb, int tid, pcb_t *pcb, uint32_t *regs) {
     /* Set appropriate tid and pcb */
     tcb->tid = tid;
     tcb->pcb = pcb;
+    tcb->loaned_pd = NULL;
+    tcb->prio = pcb->prio;
+    /* Not in any tcb pool yet */
+    ll_node_init(&(tcb->pool_node), NULL);
 
     /* Set tcb to runnable */
     tcb->status = RUNNABLE;
@@ -162,26 +166,6 @@ int tcb_reload(tcb_t *tcb, pcb_t *pcb) {
     return 0;
 }
 
-/**
- * @brief Compares wakeup times of two tcbs.
- *
- * Used in inserting a tcb into a linked list
- *
- * @param a first tcb to compare
- * @param b second tcb to compare
- *
- * @return 0 - a wakeup time = b wakeup time
- *        -1 - a wakeup time > b wakeup time
- *         1 - a wakeup time < b wakeup time
- *
- *
- */
-int tcb_t_wakeup_cmp(void *a, void *b){
-    uint32_t t1 = (uint32_t)((tcb_t *)a)->t_wakeup;
-    uint32_t t2 = (uint32_t)((tcb_t *)b)->t_wakeup;
-    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
-}
-
 /**
  * @brief Gets the exit status of a tcb
  *
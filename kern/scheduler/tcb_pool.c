@@ -1,12 +1,27 @@
 /** @file tcb_pool.h
  *  @brief Implementation for a thread control block pool
  *
- *  The threads hashtable holds linked list nodes that either belong
- *  in the runnable pool, waiting pool, sleeping, or zombie pool.
- *  Keys are tids (int) and values are tcb_t*
+ *  Every tcb carries its own linked list node, which links it into either
+ *  a run queue, the waiting pool, the sleep wheel, or the zombie pool, so
+ *  moving a tcb between them allocates nothing and needs no lookup.
+ *  The tids table is indexed by tid and holds tcb_t*
  *  See README for more info
  *
- *  There is also a seperate hash table that holds pcbs
+ *  There is also a seperate pids table that holds pcbs. Both tables hand
+ *  out the ids too, and take them back once the reaper is done with them.
+ *
+ *  Runnable threads are kept in one queue per priority level, with a bitmap
+ *  of the levels that have any, so the next thread to run is found in
+ *  constant time. A thread's level is its process's base priority, raised
+ *  by SCHED_WAKE_BOOST when it wakes up from waiting or sleeping and lowered
+ *  a level for every quantum it uses up, down to SCHED_MAX_DECAY below its
+ *  base. Threads that mostly wait, such as a shell waiting on readline,
+ *  therefore run ahead of threads that keep the CPU busy.
+ *
+ *  Sleeping threads are kept in a hashed timer wheel. A thread goes into the
+ *  bucket of its wakeup tick modulo SLEEP_WHEEL_SIZE, which takes constant
+ *  time, and every tick only the bucket of that tick is checked. Threads in
+ *  it that are due for a later turn of the wheel stay where they are.
  *
  *  @author Christopher Wei (cjwei)
  *  @author Aatish Nayak (aatishn)
@@ -18,81 +33,129 @@
 /* P3 specific includes */
 #include <x86/asm.h>
 #include <ll.h>
-#include <ht.h>
+#include <id_table.h>
 #include <tcb_pool.h>
 #include <tcb.h>
 #include <kern_internals.h>
 
 
 /**
- * @brief Approximate number of addresses tcb_pool data structures have
- * allocated per tcb. Obtained by looking through tcb_pool code and
- * seeing max number of frees required to remove a tcb and pcb from the
- * thr_pool data structures
+ * @brief Initializes a thread pool
+ *
+ * @param tp thread pool to initialize
+ *
+ * @return 0 on success, negative error code othwerise
  *
- * Used to determine size of circ_buf to store allocated addresses
- * in tcb_pool_reap
  */
-#define NUM_ADDRS 32
+int tcb_pool_init(tcb_pool_t *tp) {
+    if (tp == NULL) return -1;
+
+    /* Initialize the tids and pids tables */
+    if (id_table_init(&(tp->tids)) < 0
+        || id_table_init(&(tp->pids)) < 0
+        || mutex_init(&(tp->ids_lock)) < 0) return -2;
+
+    /* Initialize the run queues, and the waiting, sleeping, and zombie
+     * pools */
+    int i;
+    for (i = 0; i < SCHED_NUM_PRIOS; i++) {
+        if (ll_init(&(tp->run_queues[i])) < 0) return -3;
+    }
+    tp->run_bitmap = 0;
+    tp->num_runnable = 0;
+    for (i = 0; i < SLEEP_WHEEL_SIZE; i++) {
+        if (ll_init(&(tp->sleep_wheel[i])) < 0) return -3;
+    }
+    tp->num_sleeping = 0;
+    if (ll_init(&(tp->waiting_pool)) < 0
+        || ll_init(&(tp->zombie_pool))< 0) return -3;
+
+    /* Initialize the zombie semaphore */
+    if (sem_init(&(tp->zombies_sem), 0) < 0) return -4;
+
+    tp->last_pcb = NULL;
+    tp->group_run = 0;
+    tp->num_grouped = 0;
+    tp->num_boosts = 0;
+    tp->num_decays = 0;
+
+    return 0;
+}
 
 /**
- * @brief Hashing function for tids used in the threads hashtable
+ * @brief Keeps a priority level within reach of the base priority of a
+ * tcb's process
  *
- * @param tid tid to hash
+ * @param tcb tcb whose level it is
+ * @param prio level to keep in reach
  *
- * @return hash of the tid
+ * @return the closest level to prio the tcb may have
  *
  */
-int tid_hash(key_t tid) {
-    return (int) tid;
+int tcb_pool_clamp_prio(tcb_t *tcb, int prio) {
+    int lo = tcb->pcb->prio - SCHED_WAKE_BOOST;
+    int hi = tcb->pcb->prio + SCHED_MAX_DECAY;
+    if (lo < 0) lo = 0;
+    if (hi > SCHED_NUM_PRIOS - 1) hi = SCHED_NUM_PRIOS - 1;
+    return (prio < lo) ? lo : ((prio > hi) ? hi : prio);
 }
 
 /**
- * @brief Hashing function for pids used in the processes hashtable
+ * @brief Checks whether a tcb was added to a tcb pool, which the idle tcb
+ * never is
  *
- * @param pid pid to hash
+ * @param tp tcb pool to check
+ * @param tcb tcb to check
  *
- * @return hash of the pid
+ * @return 1 if it was added and is not removed yet, 0 otherwise
  *
  */
-int pid_hash(key_t pid) {
-    return (int) pid;
+int tcb_pool_holds(tcb_pool_t *tp, tcb_t *tcb) {
+    return tcb->pool_node.e == (void *) tcb;
 }
 
 /**
- * @brief Initializes a thread pool
+ * @brief Links a tcb at the tail of a run queue
  *
- * @param tp thread pool to initialize
+ * @param tp tcb pool to manipulate
+ * @param tcb tcb to enqueue
+ * @param prio level to enqueue the tcb at, kept within reach of its base
  *
- * @return 0 on success, negative error code othwerise
+ * @return 0 on success, negative error code otherwise
  *
  */
-int tcb_pool_init(tcb_pool_t *tp) {
-    if (tp == NULL) return -1;
-
-    /* Initialize the threads and processes hash tables */
-    if (ht_init(&(tp->threads), TABLE_SIZE, tid_hash) < 0
-        || ht_init(&(tp->processes), TABLE_SIZE, pid_hash) < 0) return -2;
-
-    /* Initialize the runnable, waiting, sleeping, and zombie pools */
-    if (ll_init(&(tp->runnable_pool)) < 0
-        || ll_init(&(tp->waiting_pool)) < 0
-        || ll_init(&(tp->sleeping_pool)) < 0
-        || ll_init(&(tp->zombie_pool))< 0) return -3;
-
-    /* Initialize the zombie semaphore */
-    if (sem_init(&(tp->zombies_sem), 0) < 0) return -4;
+int tcb_pool_enqueue(tcb_pool_t *tp, tcb_t *tcb, int prio) {
+    tcb->prio = tcb_pool_clamp_prio(tcb, prio);
+    if (ll_link_node_last(&(tp->run_queues[tcb->prio]),
+                &(tcb->pool_node)) < 0) return -1;
+    tp->run_bitmap |= 1 << tcb->prio;
+    tp->num_runnable++;
+    return 0;
+}
 
+/**
+ * @brief Unlinks a tcb from its run queue
+ *
+ * @param tp tcb pool to manipulate
+ * @param tcb tcb to dequeue
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int tcb_pool_dequeue(tcb_pool_t *tp, tcb_t *tcb) {
+    ll_t *queue = &(tp->run_queues[tcb->prio]);
+    if (ll_unlink_node(queue, &(tcb->pool_node)) < 0) return -1;
+    if (ll_size(queue) == 0) tp->run_bitmap &= ~(1 << tcb->prio);
+    tp->num_runnable--;
     return 0;
 }
 
 
 /**
  * @brief Adds the specified tcb to the runnable pool for the first time.
+ * Its tid must come from tcb_pool_alloc_tid.
  * Utilizes the scheduler lock to ensure no other thread is touching the
- * data structures while they are being modified. To ensure, that the
- * scheduler isn't locked during malloc, since it is a blackbox and may
- * take a long time, all mallocing is done before hand.
+ * data structures while they are being modified. Nothing is allocated.
  *
  * @param tp Thread pool to add to
  * @param tcb Pointer to tcb to add
@@ -103,30 +166,26 @@ int tcb_pool_init(tcb_pool_t *tp) {
 int tcb_pool_add_runnable_tcb_safe(tcb_pool_t *tp, tcb_t *tcb) {
     if (tp == NULL || tcb == NULL) return -1;
 
-    /* Malloc all necessary structures before locking the scheduler */
-
-    /* Create new node to insert into hashtable */
-    ll_node_t *node = malloc(sizeof(ll_node_t));
-    if (ll_node_init(node, (void *) tcb) < 0) return -2;
-
-    /* Create new hash table entry for new tcb node */
-    ht_entry_t *new_e = malloc(sizeof(ht_entry_t));
-    if (new_e == NULL) return -3;
-    new_e->val = (void*)node;
-    new_e->key = (key_t) tcb->tid;
-
-    /* Create node to insert entry into hashtable bucket */
-    ll_node_t *entry_node = malloc(sizeof(ll_node_t));
-    if (ll_node_init(entry_node, (void*) new_e) < 0) return -4;
+    /* The tcb carries its own links, so nothing needs to be allocated */
+    if (ll_node_init(&(tcb->pool_node), (void *) tcb) < 0) return -2;
 
     /* Lock the scheduler while inserting */
     sched_mutex_lock(&sched_lock);
 
-    /* Insert entry and node into hashtable */
-    if (ht_put_entry(&(tp->threads), new_e, entry_node) < 0) return -3;
+    /* Insert tcb into the slot of its tid */
+    if (id_table_set(&(tp->tids), tcb->tid, (void*) tcb) < 0) {
+        ll_node_init(&(tcb->pool_node), NULL);
+        sched_mutex_unlock(&sched_lock);
+        return -3;
+    }
 
-    /* Put same node into runnable pool */
-    if (ll_link_node_last(&(tp->runnable_pool), node) < 0) return -4;
+    /* Put it into the run queue of its process's base priority */
+    if (tcb_pool_enqueue(tp, tcb, tcb->pcb->prio) < 0) {
+        id_table_clear(&(tp->tids), tcb->tid, NULL);
+        ll_node_init(&(tcb->pool_node), NULL);
+        sched_mutex_unlock(&sched_lock);
+        return -4;
+    }
 
     /* Unlock the scheduler and proceed */
     sched_mutex_unlock(&sched_lock);
@@ -135,11 +194,10 @@ int tcb_pool_add_runnable_tcb_safe(tcb_pool_t *tp, tcb_t *tcb) {
 }
 
 /**
- * @brief Adds the specified pcb to the processes hash table.
+ * @brief Adds the specified pcb to the pids table. Its pid must come from
+ * tcb_pool_alloc_pid.
  * Utilizes the scheduler lock to ensure no other thread is touching the
- * data structures while they are being modified. To ensure, that the
- * scheduler isn't locked during malloc, since it is a blackbox and may
- * take a long time, all mallocing is done before hand.
+ * data structures while they are being modified. Nothing is allocated.
  *
  * @param tp Thread pool to add to
  * @param tcb Pointer to tcb to add
@@ -150,100 +208,250 @@ int tcb_pool_add_runnable_tcb_safe(tcb_pool_t *tp, tcb_t *tcb) {
 int tcb_pool_add_pcb_safe(tcb_pool_t *tp, pcb_t *pcb) {
     if (tp == NULL || pcb == NULL) return -1;
 
-    /* Malloc all necessary structures before locking the scheduler */
-
-    /* Create new node to insert into hashtable */
-    ll_node_t *node = malloc(sizeof(ll_node_t));
-    if (ll_node_init(node, (void *) pcb) < 0) return -2;
-
-    /* Create new hash table entry for new pcb node */
-    ht_entry_t *new_e = malloc(sizeof(ht_entry_t));
-    if (new_e == NULL) return -3;
-    new_e->val = (void*)node;
-    new_e->key = (key_t) pcb->pid;
-
-    /* Create node to insert entry into hashtable bucket */
-    ll_node_t *entry_node = malloc(sizeof(ll_node_t));
-    if (ll_node_init(entry_node, (void*) new_e) < 0) return -4;
-
     /* Lock the scheduler while inserting */
     sched_mutex_lock(&sched_lock);
 
-    /* Insert entry and node into hashtable safely */
-    if (ht_put_entry(&(tp->processes), new_e, entry_node) < 0) return -3;
+    /* Insert pcb into the slot of its pid safely */
+    int status = id_table_set(&(tp->pids), pcb->pid, (void*) pcb);
 
     /* Unlock the scheduler and proceed */
     sched_mutex_unlock(&sched_lock);
 
-    return 0;
+    return (status < 0) ? -2 : 0;
 }
 
 
 /**
- * @brief Removes the pcb with the specified pid from the processes
- * hash table. Has an optional circ_buf_t parameter that saves all addresses
- * need to be freed, and does not free them.
+ * @brief Removes the pcb with the specified pid from the pids table. The
+ * pid stays in use until tcb_pool_free_pid.
  *
  * @param tp thr_pool to access
  * @param pid pid of pcb to remove
- * @param addrs_to_free optional parameter that saves all addresses that need
- * to be freed. NULL if addresses should be freed right away
  *
  * @return 0 on success, negative error code otherwise
  *
  *
  */
-int tcb_pool_remove_pcb(tcb_pool_t *tp, int pid, circ_buf_t *addrs_to_free) {
+int tcb_pool_remove_pcb(tcb_pool_t *tp, int pid) {
     if (tp == NULL) return -1;
 
-    ll_node_t *node;
-    /* Get specified node and pcb from hash table */
-    if (ht_remove(&(tp->processes), (key_t) pid, (void**) &node, addrs_to_free) < 0) {
+    /* Remove pcb from its slot */
+    if (id_table_clear(&(tp->pids), pid, NULL) < 0) {
         /* Not found */
         return -2;
     }
+    return 0;
+}
+
+/**
+ * @brief Hands out a tid that is not in use, reusing one freed long ago if
+ * there is any
+ *
+ * @param tp thr_pool to take a tid from
+ *
+ * @return the tid on success, negative error code otherwise
+ *
+ */
+int tcb_pool_alloc_tid(tcb_pool_t *tp) {
+    if (tp == NULL) return -1;
+    mutex_lock(&(tp->ids_lock));
+    int tid = id_table_alloc(&(tp->tids));
+    mutex_unlock(&(tp->ids_lock));
+    return (tid < 0) ? -2 : tid;
+}
+
+/**
+ * @brief Hands out a pid that is not in use, reusing one freed long ago if
+ * there is any
+ *
+ * @param tp thr_pool to take a pid from
+ *
+ * @return the pid on success, negative error code otherwise
+ *
+ */
+int tcb_pool_alloc_pid(tcb_pool_t *tp) {
+    if (tp == NULL) return -1;
+    mutex_lock(&(tp->ids_lock));
+    int pid = id_table_alloc(&(tp->pids));
+    mutex_unlock(&(tp->ids_lock));
+    return (pid < 0) ? -2 : pid;
+}
+
+/**
+ * @brief Returns a tid whose tcb is gone to be handed out again
+ *
+ * @param tp thr_pool the tid came from
+ * @param tid tid to free
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int tcb_pool_free_tid(tcb_pool_t *tp, int tid) {
+    if (tp == NULL) return -1;
+    mutex_lock(&(tp->ids_lock));
+    int status = id_table_free(&(tp->tids), tid);
+    mutex_unlock(&(tp->ids_lock));
+    return (status < 0) ? -2 : 0;
+}
+
+/**
+ * @brief Returns a pid whose pcb is gone to be handed out again
+ *
+ * @param tp thr_pool the pid came from
+ * @param pid pid to free
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int tcb_pool_free_pid(tcb_pool_t *tp, int pid) {
+    if (tp == NULL) return -1;
+    mutex_lock(&(tp->ids_lock));
+    int status = id_table_free(&(tp->pids), pid);
+    mutex_unlock(&(tp->ids_lock));
+    return (status < 0) ? -2 : 0;
+}
 
-    /* Check if node addr needs to be saved */
-    if (addrs_to_free != NULL) {
-        if (circ_buf_write(addrs_to_free, (void*) node) < 0) {
-            free(node);
+/**
+ * @brief Moves the first runnable tcb of a process to the head of a run
+ * queue. The tail, which just had its turn, is not considered.
+ *
+ * @param tp tcb pool to search
+ * @param queue run queue to search
+ * @param pcb pcb whose tcb to look for
+ *
+ * @return 0 if a tcb was moved, negative error code otherwise
+ *
+ */
+int tcb_pool_group_process(tcb_pool_t *tp, ll_t *queue, pcb_t *pcb) {
+    ll_node_t *node, *tail;
+    if (ll_head(queue, &node) < 0 || ll_tail(queue, &tail) < 0) return -1;
+
+    /* The head is not of pcb, or we would not be looking */
+    for (node = node->next; node != NULL && node != tail; node = node->next) {
+        tcb_t *tcb;
+        if (ll_node_get_data(node, (void**) &tcb) < 0) return -2;
+        if (tcb->pcb == pcb) {
+            ll_unlink_node(queue, node);
+            ll_link_node_first(queue, node);
+            return 0;
         }
-    } /* Otherwise free right now */
-    else {
-        free(node);
     }
-    return 0;
+    return -3;
 }
 
 /**
- * @brief Get the next tcb in the runnable pool. First, rotate
- * the runnable pool once and peek at the head.
+ * @brief Get the next tcb to run. First, the tcb that just ran goes to the
+ * tail of its run queue, and then the head of the highest level run queue
+ * that is not empty is picked.
+ *
+ * With SCHED_GROUP_PROCESSES, if the head belongs to another process than
+ * the last tcb handed out, a runnable tcb of the same process and level is
+ * run first so that the switch keeps the same page directory. At most
+ * SCHED_GROUP_MAX_RUN tcbs of a process run in a row this way, after which
+ * the head gets its turn. Finding such a tcb is linear in the number of
+ * runnable tcbs of the level.
  *
  * @param tp tcb pool to get next tcb from
+ * @param cur_tcb tcb that just ran (optional)
  * @param next_tcb address to put the pointer to the next tcb
  *
  * @return 0 on success, negative error code otherwise
  *
  */
-int tcb_pool_get_next_tcb(tcb_pool_t *tp, tcb_t **next_tcb) {
+int tcb_pool_get_next_tcb(tcb_pool_t *tp, tcb_t *cur_tcb, tcb_t **next_tcb) {
     if (tp == NULL || next_tcb == NULL) return -1;
 
-    int ret;
-    /* Rotate runnable pool once */
-    if ((ret = ll_rotate(&(tp->runnable_pool))) == -2) {
-        /* Runnable pool is empty */
-        return -2;
-    } else if (ret < 0) {
-        /* Some other error */
-        return -3;
+    /* The tcb that just ran goes behind the others of its level. This is
+     * also where a new base priority of its process takes effect */
+    if (cur_tcb != NULL && cur_tcb->status == RUNNABLE
+        && tcb_pool_holds(tp, cur_tcb)) {
+        if (tcb_pool_dequeue(tp, cur_tcb) < 0
+            || tcb_pool_enqueue(tp, cur_tcb, cur_tcb->prio) < 0)
+            return -3;
+    }
+
+    /* Every run queue is empty */
+    if (tp->run_bitmap == 0) return -2;
+
+    /* The lowest set bit is the highest level with a runnable tcb */
+    ll_t *queue = &(tp->run_queues[__builtin_ctz(tp->run_bitmap)]);
+    if (ll_peek(queue, (void**) next_tcb) < 0) return -4;
+
+#ifdef SCHED_GROUP_PROCESSES
+    if ((*next_tcb)->pcb != tp->last_pcb
+        && tp->group_run < SCHED_GROUP_MAX_RUN
+        && tcb_pool_group_process(tp, queue, tp->last_pcb) == 0) {
+        if (ll_peek(queue, (void**) next_tcb) < 0) return -4;
+        tp->num_grouped++;
+    }
+#endif
+
+    /* Count how many tcbs of the same process ran in a row */
+    if ((*next_tcb)->pcb == tp->last_pcb) {
+        tp->group_run++;
+    } else {
+        tp->last_pcb = (*next_tcb)->pcb;
+        tp->group_run = 0;
     }
 
-    /* Head of runnable_pool should be next tcb */
-    if (ll_peek(&(tp->runnable_pool), (void**) next_tcb) < 0) return -4;
+    return 0;
+}
+
+/**
+ * @brief Lowers the priority of a running tcb that used up its quantum by a
+ * level, unless it already sank SCHED_MAX_DECAY levels below its base
+ *
+ * @param tp tcb pool holding the tcb
+ * @param tcb running tcb
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ */
+int tcb_pool_expire_quantum(tcb_pool_t *tp, tcb_t *tcb) {
+    if (tp == NULL || tcb == NULL || tcb->status != RUNNING) return -1;
+
+    /* The idle tcb is in no run queue */
+    if (!tcb_pool_holds(tp, tcb)) return -2;
+    int prio = tcb_pool_clamp_prio(tcb, tcb->prio + 1);
+    if (prio == tcb->prio) return 0;
 
+    if (tcb_pool_dequeue(tp, tcb) < 0
+        || tcb_pool_enqueue(tp, tcb, prio) < 0) return -3;
+    tp->num_decays++;
     return 0;
 }
 
+/**
+ * @brief Reports how many times tcbs were boosted on wakeup and how many
+ * times they sank a level for using up their quantum
+ *
+ * @param tp tcb pool to report on
+ * @param num_boosts address to put the number of boosts (optional)
+ * @param num_decays address to put the number of decays (optional)
+ *
+ * @return Void
+ */
+void tcb_pool_prio_stats(tcb_pool_t *tp, uint32_t *num_boosts,
+        uint32_t *num_decays) {
+    if (tp == NULL) return;
+    if (num_boosts != NULL) *num_boosts = tp->num_boosts;
+    if (num_decays != NULL) *num_decays = tp->num_decays;
+}
+
+/**
+ * @brief Reports how many tcbs were run ahead of their turn to stay in
+ * the same process
+ *
+ * @param tp tcb pool to report on
+ * @param num_grouped address to put the count
+ *
+ * @return Void
+ */
+void tcb_pool_group_stats(tcb_pool_t *tp, uint32_t *num_grouped) {
+    if (tp == NULL || num_grouped == NULL) return;
+    *num_grouped = tp->num_grouped;
+}
+
 /**
  * @brief Finds the tcb with the specified tid in the tcb pool
  *
@@ -256,14 +464,10 @@ int tcb_pool_get_next_tcb(tcb_pool_t *tp, tcb_t **next_tcb) {
  */
 int tcb_pool_find_tcb(tcb_pool_t *tp, int tid, tcb_t **tcbp) {
     if (tp == NULL || tcbp == NULL) return -1;
-    ll_node_t *node;
-    if (ht_get(&(tp->threads), (key_t) tid, (void**) &node) < 0) {
+    if (id_table_get(&(tp->tids), tid, (void**) tcbp) < 0) {
         /* Not found */
         return -2;
     }
-    if (ll_node_get_data(node, (void**)tcbp) < 0) {
-        return -3;
-    }
     return 0;
 }
 
@@ -279,56 +483,57 @@ int tcb_pool_find_tcb(tcb_pool_t *tp, int tid, tcb_t **tcbp) {
  */
 int tcb_pool_find_pcb(tcb_pool_t *tp, int pid, pcb_t **pcbp) {
     if (tp == NULL || pcbp == NULL) return -1;
-    ll_node_t *node;
-    if (ht_get(&(tp->processes), (key_t) pid, (void**) &node) < 0) {
+    if (id_table_get(&(tp->pids), pid, (void**) pcbp) < 0) {
         /* Not found */
         return -2;
     }
-    if (ll_node_get_data(node, (void**)pcbp) < 0) {
-        return -3;
-    }
     return 0;
 }
 
 /**
- * @brief Moves the node holding the tcb with the specified tid from the
- * runnable pool to the waiting pool. Returns an error if tcb was already
- * in the runnable pool
+ * @brief Gets the bucket of the sleep wheel a sleeping tcb is in
+ *
+ * @param tp tcb pool holding the tcb
+ * @param tcb sleeping tcb
+ *
+ * @return the bucket
+ */
+ll_t *tcb_pool_sleep_bucket(tcb_pool_t *tp, tcb_t *tcb) {
+    return &(tp->sleep_wheel[tcb->t_wakeup & (SLEEP_WHEEL_SIZE - 1)]);
+}
+
+/**
+ * @brief Moves the specified tcb from its
+ * run queue to the sleep wheel. Its wakeup time must already be set.
  *
  * @param tp tcb pool to manipulate
- * @param tid tid of tcb to make runnable
+ * @param tcb tcb to make sleeping
  *
  * @return 0 on success, negative error code otherwise
  */
-int tcb_pool_make_sleeping(tcb_pool_t *tp, int tid) {
-    if (tp == NULL) return -1;
+int tcb_pool_make_sleeping(tcb_pool_t *tp, tcb_t *tcb) {
+    if (tp == NULL || tcb == NULL) return -1;
 
-    ll_node_t *node;
+    ll_node_t *node = &(tcb->pool_node);
 
-    /* Get specified node and tcb from hash table */
-    if (ht_get(&(tp->threads), (key_t) tid, (void**) &node) < 0) {
-        /* Not found */
-        return -2;
-    }
-    tcb_t *tcb;
-    if (ll_node_get_data(node, (void**)&tcb) < 0) {
-        return -3;
-    }
+    /* Remove from its run queue */
+    if (tcb_pool_dequeue(tp, tcb) < 0) return -5;
 
-    /* Remove from runnable pool */
-    if (ll_unlink_node(&(tp->runnable_pool), node) < 0) return -5;
-
-    /* Add to sleeping pool */
-    if (ll_link_node_sorted(&(tp->sleeping_pool), node, &tcb_t_wakeup_cmp) < 0)
+    /* Add to the bucket of its wakeup tick */
+    if (ll_link_node_last(tcb_pool_sleep_bucket(tp, tcb), node) < 0)
         return -6;
+    tp->num_sleeping++;
 
     return 0;
 
 }
 
 /**
- * @brief Loops through the sleeping pool and wakes up a thread if
- * the its wakeup time is equal to the current time.
+ * @brief Wakes up every thread in the bucket of the sleep wheel of the
+ * current time whose wakeup time has come.
+ *
+ * Must be called on every tick, or threads of the buckets of skipped ticks
+ * oversleep by a turn of the wheel.
  *
  * @param tp thr_pool to check
  * @param curr_time current scheduler tick count
@@ -338,20 +543,56 @@ int tcb_pool_make_sleeping(tcb_pool_t *tp, int tid) {
  */
 int tcb_pool_wakeup(tcb_pool_t *tp, uint32_t curr_time){
     if (tp == NULL) return -1;
-    tcb_t *tcb;
-    while (ll_size(&(tp->sleeping_pool)) > 0){
-        if (ll_peek(&(tp->sleeping_pool), (void **)&tcb) < 0)
-            return -1;
-        if (tcb->t_wakeup == curr_time){
+    if (tp->num_sleeping == 0) return 0;
+
+    ll_t *bucket = &(tp->sleep_wheel[curr_time & (SLEEP_WHEEL_SIZE - 1)]);
+    ll_node_t *node, *next;
+    if (ll_head(bucket, &node) < 0) return -2;
+    while (node != NULL){
+        next = node->next;
+        tcb_t *tcb = (tcb_t *)node->e;
+        /* the others of the bucket are due on a later turn of the wheel */
+        if ((int)(tcb->t_wakeup - curr_time) <= 0){
             /* wakey wakey shrek */
-            tcb_pool_make_runnable(tp, tcb->tid);
-        } else {
-            break;
+            if (tcb_pool_make_runnable(tp, tcb) < 0) return -3;
+            tcb->status = RUNNABLE;
         }
+        node = next;
     }
     return 0;
 }
 
+/**
+ * @brief Finds how many ticks away the first wakeup is, looking no further
+ * than a given number of ticks ahead
+ *
+ * @param tp thr_pool to check
+ * @param curr_time current scheduler tick count
+ * @param max number of ticks to look ahead
+ *
+ * @return the number of ticks until a thread is due to wake up, max if
+ * none is due before then
+ *
+ */
+uint32_t tcb_pool_next_wakeup(tcb_pool_t *tp, uint32_t curr_time,
+        uint32_t max){
+    if (tp == NULL || tp->num_sleeping == 0) return max;
+
+    uint32_t i;
+    for (i = 1; i < max; i++){
+        uint32_t t = curr_time + i;
+        ll_node_t *node;
+        if (ll_head(&(tp->sleep_wheel[t & (SLEEP_WHEEL_SIZE - 1)]),
+                    &node) < 0) continue;
+        while (node != NULL){
+            tcb_t *tcb = (tcb_t *)node->e;
+            if ((int)(tcb->t_wakeup - t) <= 0) return i;
+            node = node->next;
+        }
+    }
+    return max;
+}
+
 /**
  * @brief Reaps zombies in the zombie pool everytime the zombies_sem is
  * signaled. Frees all of a zombies resources and returns it back to the kernel.
@@ -360,8 +601,8 @@ int tcb_pool_wakeup(tcb_pool_t *tp, uint32_t curr_time){
  * zombie threads. While modifying removing a tcb/pcb from their respective
  * pools, the scheduler is locked so nothing can modify the data structures.
  * Additionally, we want to not lock the scheduler while freeing, since
- * it may take a long time or not even have the heap lock. Because of this
- * we save all the addresses in a seperate buffer, and free them after
+ * it may take a long time or not even have the heap lock. Since a tcb
+ * carries its own links, only the tcb and its pcb are left to free after
  * unlocking the scheduler lock. The pcb of a tcb is also removed/destroyed if
  * it contains no more threads. This function should never return.
  *
@@ -372,15 +613,7 @@ int tcb_pool_wakeup(tcb_pool_t *tp, uint32_t curr_time){
 int tcb_pool_reap(tcb_pool_t *tp){
     if (tp == NULL) return -1;
 
-    circ_buf_t addrs_to_free;
-
-    if (circ_buf_init(&addrs_to_free, NUM_ADDRS) < 0) {
-        panic("Cannot allocate space to hold to-be-freed addresses. \
-                Error in ShrekOS.");
-    }
-
     tcb_t *tcb;
-    void *addr;
     while(1) {
         /* Wait on zombies to be available */
         sem_wait(&(tp->zombies_sem));
@@ -394,72 +627,56 @@ int tcb_pool_reap(tcb_pool_t *tp){
         /* Disable Interrupts while modifying tcb pool */
         sched_mutex_lock(&sched_lock);
 
-        /* Remove from tcb hash table and zombie pool */
-        if (tcb_pool_remove_tcb(tp, tcb->tid, &addrs_to_free) < 0) {
+        /* Remove from tids table and zombie pool */
+        if (tcb_pool_remove_tcb(tp, tcb) < 0) {
             continue;
         }
 
         /* Remove if last thread in pcb */
         if (tcb->pcb->num_threads == 0) {
-            tcb_pool_remove_pcb(tp, tcb->pcb->pid, &addrs_to_free);
+            tcb_pool_remove_pcb(tp, tcb->pcb->pid);
         }
 
         /* Enable interrupts before freeing and attempting to acquire heap lock */
         sched_mutex_unlock(&sched_lock);
 
+        /* Nothing can find the tcb anymore, so its tid may be reused */
+        tcb_pool_free_tid(tp, tcb->tid);
+
         /* Check if pcb has no more threads running */
         if (tcb->pcb->num_threads == 0) {
+            tcb_pool_free_pid(tp, tcb->pcb->pid);
             pcb_destroy_s(tcb->pcb);
             free(tcb->pcb);
         }
         /* Destroy tcb itself */
         tcb_destroy(tcb);
         free(tcb);
-
-        /* Free rest of the addresses */
-        while(circ_buf_read(&addrs_to_free, (void**) &addr) >= 0) {
-            free(addr);
-        }
-
     }
 
-    /* For completeness */
-    /* Destroy circ buf containing addresses to free */
-    circ_buf_destroy(&addrs_to_free);
-
     /* To placate the compiler */
     return 0;
 }
 /**
- * @brief Moves the node holding the tcb with the specified tid from the
+ * @brief Moves the specified tcb from the
  * runnable pool to the waiting pool. Returns an error if tcb was already
  * in the runnable pool
  *
  * @param tp tcb pool to manipulate
- * @param tid tid of tcb to make runnable
+ * @param tcb tcb to make waiting
  *
  * @return 0 on success, negative error code otherwise
  */
-int tcb_pool_make_waiting(tcb_pool_t *tp, int tid) {
-    if (tp == NULL) return -1;
-
-    ll_node_t *node;
+int tcb_pool_make_waiting(tcb_pool_t *tp, tcb_t *tcb) {
+    if (tp == NULL || tcb == NULL) return -1;
 
-    /* Get specified node and tcb from hash table */
-    if (ht_get(&(tp->threads), (key_t) tid, (void**) &node) < 0) {
-        /* Not found */
-        return -2;
-    }
-    tcb_t *tcb;
-    if (ll_node_get_data(node, (void**)&tcb) < 0) {
-        return -3;
-    }
+    ll_node_t *node = &(tcb->pool_node);
 
     /* Check if tcb is not already WAITING */
     if (tcb->status == WAITING) return -4;
 
-    /* Remove from runnable pool */
-    if (ll_unlink_node(&(tp->runnable_pool), node) < 0) return -5;
+    /* Remove from its run queue */
+    if (tcb_pool_dequeue(tp, tcb) < 0) return -5;
 
     /* Add to waiting pool */
     if (ll_link_node_last(&(tp->waiting_pool), node) < 0) return -6;
@@ -469,72 +686,59 @@ int tcb_pool_make_waiting(tcb_pool_t *tp, int tid) {
 }
 
 /**
- * @brief Moves the node holding the tcb with the specified tid from the
- * waiting pool or the sleeping pool to the runnable pool.
+ * @brief Moves the specified tcb from the
+ * waiting pool or the sleep wheel to a run queue.
  * Returns an error if tcb was already in the runnable pool
  *
  * @param tp tcb pool to manipulate
- * @param tid tid of tcb to make runnable
+ * @param tcb tcb to make runnable
  *
  * @return 0 on success, negative error code otherwise
  */
-int tcb_pool_make_runnable(tcb_pool_t *tp, int tid) {
-    if (tp == NULL) return -1;
+int tcb_pool_make_runnable(tcb_pool_t *tp, tcb_t *tcb) {
+    if (tp == NULL || tcb == NULL) return -1;
 
-    ll_node_t *node;
-
-    /* Get specified node and tcb from hash table */
-    if (ht_get(&(tp->threads), (key_t) tid, (void**) &node) < 0) {
-        /* Not found */
-        return -2;
-    }
-    tcb_t *tcb;
-    if (ll_node_get_data(node, (void**)&tcb) < 0) {
-        return -3;
-    }
+    ll_node_t *node = &(tcb->pool_node);
 
     /* Check if tcb is not already RUNNABLE */
     if (tcb->status == RUNNABLE) return -4;
 
-    /* Remove from waiting pool */
+    /* Remove from waiting pool or sleep wheel */
     if (tcb->status == WAITING){
         if (ll_unlink_node(&(tp->waiting_pool), node) < 0) return -5;
+    } else if (tcb->status == SLEEPING){
+        if (ll_unlink_node(tcb_pool_sleep_bucket(tp, tcb), node) < 0)
+            return -5;
+        tp->num_sleeping--;
     } else {
-        if (ll_unlink_node(&(tp->sleeping_pool), node) < 0) return -5;
+        /* running or a zombie */
+        return -4;
     }
 
-    /* Add to runnable pool */
-    if (ll_link_node_last(&(tp->runnable_pool), node) < 0) return -6;
+    /* Add to the run queue of its boosted priority */
+    if (tcb_pool_enqueue(tp, tcb,
+                tcb->pcb->prio - SCHED_WAKE_BOOST) < 0) return -6;
+    tp->num_boosts++;
 
     return 0;
 
 }
 
 /**
- * @brief Moves the node holding the tcb with the specified tid from the
+ * @brief Moves the specified tcb from the
  * runnable pool to the zombie pool. Signals the zombie semaphore so the
  * reaper thread can reap its resources.
  * Returns an error if tcb was already a zombie
  *
  * @param tp tcb pool to manipulate
- * @param tid tid of tcb to make runnable
+ * @param tcb tcb to make a zombie
  *
  * @return 0 on success, negative error code otherwise
  */
-int tcb_pool_make_zombie(tcb_pool_t *tp, int tid){
-    if (tp == NULL) return -1;
-
-    ll_node_t *node;
+int tcb_pool_make_zombie(tcb_pool_t *tp, tcb_t *tcb){
+    if (tp == NULL || tcb == NULL) return -1;
 
-    /* Get specified node and tcb from hash table */
-    if (ht_get(&(tp->threads), (key_t) tid, (void**) &node) < 0) {
-        /* Not found */
-        return -2;
-    }
-    tcb_t *tcb;
-    if (ll_node_get_data(node, (void**)&tcb) < 0) {
-        return -3;
-    }
+    ll_node_t *node = &(tcb->pool_node);
 
     /* Signal to reaper to reap zombie */
     sem_signal(&(tp->zombies_sem));
@@ -543,7 +747,7 @@ int tcb_pool_make_zombie(tcb_pool_t *tp, int tid){
     switch(tcb->status){
         case RUNNABLE:
         case RUNNING:
-            if (ll_unlink_node(&(tp->runnable_pool), node) < 0) return -5;
+            if (tcb_pool_dequeue(tp, tcb) < 0) return -5;
             break;
         case WAITING:
             /* hard to concieve a way for this to happen */
@@ -560,40 +764,32 @@ int tcb_pool_make_zombie(tcb_pool_t *tp, int tid){
 }
 
 /**
- * @brief Removes the tcb with the specified tid from the threads
- * hash table. Has an optional circ_buf_t parameter that saves all addresses
- * need to be freed, and does not free them.
+ * @brief Removes the specified tcb from the tids table and whichever pool
+ * it is in. Its tid stays in use until tcb_pool_free_tid. Nothing needs to
+ * be freed but the tcb itself.
  *
  * @param tp thr_pool to access
- * @param pid pid of pcb to remove
- * @param addrs_to_free optional parameter that saves all addresses that need
- * to be freed. NULL if addresses should be freed right away
+ * @param tcb tcb to remove
  *
  * @return 0 on success, negative error code otherwise
  *
  *
  */
-int tcb_pool_remove_tcb(tcb_pool_t *tp, int tid, circ_buf_t *addrs_to_free) {
-    if (tp == NULL) return -1;
+int tcb_pool_remove_tcb(tcb_pool_t *tp, tcb_t *tcb) {
+    if (tp == NULL || tcb == NULL) return -1;
 
-    ll_node_t *node;
-    /* Get specified node and tcb from hash table */
-    if (ht_remove(&(tp->threads), (key_t) tid,
-                    (void**) &node, addrs_to_free) < 0) {
+    ll_node_t *node = &(tcb->pool_node);
+    /* Clear the slot of its tid */
+    if (id_table_clear(&(tp->tids), tcb->tid, NULL) < 0) {
         /* Not found */
         return -2;
     }
 
-    tcb_t *tcb;
-    if (ll_node_get_data(node, (void**)&tcb) < 0) {
-        return -3;
-    }
-
     /* Remove from appropriate pool */
     switch(tcb->status) {
         case RUNNABLE:
         case RUNNING:
-            if (ll_unlink_node(&(tp->runnable_pool), node) < 0) return -5;
+            if (tcb_pool_dequeue(tp, tcb) < 0) return -5;
             break;
         case WAITING:
             if (ll_unlink_node(&(tp->waiting_pool), node) < 0) return -5;
@@ -604,13 +800,8 @@ int tcb_pool_remove_tcb(tcb_pool_t *tp, int tid, circ_buf_t *addrs_to_free) {
         default:
             return -4;
     }
-    /* Check if node addr needs to be saved */
-    if (addrs_to_free != NULL) {
-        circ_buf_write(addrs_to_free, (void*) node);
-    } /* Otherwise free right now */
-    else {
-        free(node);
-    }
+    /* No longer in the pool */
+    ll_node_init(node, NULL);
     return 0;
 }
 
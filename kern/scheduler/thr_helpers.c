@@ -17,6 +17,7 @@
 #include <thr_helpers.h>
 #include <dispatcher.h>
 #include <tcb.h>
+#include <virtual_mem_mgmt.h>
 
 
 /**
@@ -39,7 +40,8 @@ int thr_deschedule(uint32_t old_esp, int *reject) {
     if(scheduler_get_current_tcb(&sched, &my_tcb) < 0) return -2;
 
     /* Check if reject is a valid pointer */
-    if (pd_get_mapping(&(my_tcb->pcb->pd), (uint32_t) reject, NULL) < 0) {
+    if (vmm_check_user_range(&(my_tcb->pcb->pd), (uint32_t) reject,
+                sizeof(int), true) < 0) {
         return -3;
     }
 
@@ -19,6 +19,10 @@
 
 #define DISABLE_CACHING_BIT 30
 
+#define WRITE_PROTECT_BIT 16
+
+#define PSE_FLAG_BIT 4
+
 #define PGE_FLAG_BIT 7
 
 #define EFLAGS_RESERVED_BIT 1
@@ -47,7 +51,10 @@ uint32_t get_pdbr() {
 
 
 void enable_paging(void) {
-    uint32_t new_cr0 = get_cr0() | (SET << ENABLE_PAGING_BIT) | (SET << DISABLE_CACHING_BIT);
+    /* write protect so that kernel writes to user memory also honor
+     * read only (and therefore copy-on-write) pages */
+    uint32_t new_cr0 = get_cr0() | (SET << ENABLE_PAGING_BIT) | (SET << DISABLE_CACHING_BIT)
+        | (SET << WRITE_PROTECT_BIT);
 
     set_cr0(new_cr0);
 }
@@ -58,6 +65,13 @@ void enable_pge(void) {
     set_cr4(new_cr4);
 }
 
+void enable_pse(void) {
+    /* page directory entries with the page size bit map 4MB pages */
+    uint32_t new_cr4 = get_cr4() | (SET << PSE_FLAG_BIT);
+
+    set_cr4(new_cr4);
+}
+
 uint32_t get_user_eflags() {
     uint32_t cur_eflags = get_eflags();
 
@@ -0,0 +1,170 @@
+/** @file timer.c
+ *  @brief Implements the programmable interval timer
+ *
+ *  The timer normally interrupts every TIMER_PERIOD_MS milliseconds. It may
+ *  instead be armed once to interrupt after a number of ticks. The counter
+ *  only holds 16 bits, so that is at most timer_max_oneshot ticks away.
+ *  While armed once, the ticks that have gone by are worked out from the
+ *  counter, and each one is handed out exactly once between timer_fired,
+ *  timer_sync and timer_periodic. Once the count runs out, its last tick is
+ *  left to the pending interrupt, whichever way the timer is then
+ *  programmed. The part of a tick that went by when the
+ *  timer goes back to interrupting periodically is carried over, so no time
+ *  is lost.
+ *
+ *  Every function must be called with interrupts disabled.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs
+ */
+
+#include <timer.h>
+/* outb, inb */
+#include <x86/asm.h>
+#include <x86/timer_defines.h>
+/* C_BYTE_MASK, C_BYTE_WIDTH */
+#include <constants.h>
+
+/** @brief number of milliseconds per second */
+#define C_MS_PER_SEC 1000
+/** @brief the number of clock cycles to wait per interrupt */
+#define TIMER_CYCLES ((TIMER_RATE * TIMER_PERIOD_MS) / C_MS_PER_SEC)
+/** @brief the largest count the counter holds */
+#define TIMER_MAX_COUNT 0xFFFF
+/** @brief read back command latching the count and status of counter 0 */
+#define TIMER_READ_BACK 0xC2
+/** @brief bit of the read back status holding the counter's output, which
+ * goes high once an armed count runs out */
+#define TIMER_STATUS_OUT 0x80
+
+/** @brief whether the timer is armed once rather than periodic */
+int oneshot;
+/** @brief number of ticks the timer was armed for */
+uint32_t shot_ticks;
+/** @brief number of ticks of the shot already handed out */
+uint32_t shot_counted;
+/** @brief clock cycles of partial ticks that went by before the timer was
+ * last made periodic, and were not handed out */
+uint32_t carry_cycles;
+
+/** @brief Programs counter 0 of the timer
+ *  @param mode The mode command
+ *  @param count The count to load
+ *  @return Void
+ */
+void timer_program(uint8_t mode, uint32_t count){
+    outb(TIMER_MODE_IO_PORT, mode);
+    outb(TIMER_PERIOD_IO_PORT, count & C_BYTE_MASK);
+    outb(TIMER_PERIOD_IO_PORT, (count >> C_BYTE_WIDTH) & C_BYTE_MASK);
+}
+
+/** @brief Gets the number of clock cycles since the timer was armed once
+ *  @param fired Where to store whether the count ran out, in which case its
+ *         interrupt is pending
+ *  @return The number of cycles
+ */
+uint32_t timer_shot_elapsed(int *fired){
+    uint32_t armed = shot_ticks * TIMER_CYCLES;
+    outb(TIMER_MODE_IO_PORT, TIMER_READ_BACK);
+    uint8_t status = inb(TIMER_PERIOD_IO_PORT);
+    uint32_t count = inb(TIMER_PERIOD_IO_PORT);
+    count |= inb(TIMER_PERIOD_IO_PORT) << C_BYTE_WIDTH;
+    /* once the count runs out it wraps around and keeps going */
+    *fired = (status & TIMER_STATUS_OUT) || count > armed;
+    if (*fired) return armed;
+    return armed - count;
+}
+
+/** @brief Makes the timer interrupt every TIMER_PERIOD_MS milliseconds
+ *  @return Void
+ */
+void timer_init(void){
+    oneshot = 0;
+    carry_cycles = 0;
+    timer_program(TIMER_SQUARE_WAVE, TIMER_CYCLES);
+}
+
+/** @brief Gets the most ticks the timer can be armed for at once
+ *  @return The number of ticks
+ */
+uint32_t timer_max_oneshot(void){
+    return TIMER_MAX_COUNT / TIMER_CYCLES;
+}
+
+/** @brief Arms the timer to interrupt once after a number of ticks
+ *
+ *  Any ticks that went by since the timer was last armed and were not
+ *  handed out are lost, so the timer should only be armed again right after
+ *  it fired.
+ *
+ *  @param ticks The number of ticks, at least 1 and at most
+ *         timer_max_oneshot
+ *  @return Void
+ */
+void timer_oneshot(uint32_t ticks){
+    if (ticks == 0) ticks = 1;
+    if (ticks > timer_max_oneshot()) ticks = timer_max_oneshot();
+    oneshot = 1;
+    shot_ticks = ticks;
+    shot_counted = 0;
+    timer_program(TIMER_ONE_SHOT, ticks * TIMER_CYCLES);
+}
+
+/** @brief Makes the timer interrupt every tick again
+ *  @return The number of ticks that went by since the timer was armed once
+ *          and were not handed out yet, 0 if it was periodic already
+ */
+uint32_t timer_periodic(void){
+    if (!oneshot) return 0;
+    int fired;
+    uint32_t elapsed = timer_shot_elapsed(&fired) + carry_cycles;
+    uint32_t ticks = elapsed / TIMER_CYCLES;
+    carry_cycles = elapsed % TIMER_CYCLES;
+    if (fired){
+        /* the pending interrupt hands out the last tick */
+        ticks = shot_ticks - 1;
+        carry_cycles = 0;
+    }
+    oneshot = 0;
+    timer_program(TIMER_SQUARE_WAVE, TIMER_CYCLES);
+    return (ticks > shot_counted) ? ticks - shot_counted : 0;
+}
+
+/** @brief Hands out the ticks that went by when the timer interrupts
+ *
+ *  When the timer was armed once, it stays stopped until it is armed again
+ *  or made periodic.
+ *
+ *  @return The number of ticks that went by and were not handed out yet
+ */
+uint32_t timer_fired(void){
+    if (!oneshot) return 1;
+    uint32_t ticks = shot_ticks - shot_counted;
+    shot_counted = shot_ticks;
+    return ticks;
+}
+
+/** @brief Hands out the ticks that went by since the timer was armed once,
+ *         without changing how it is programmed
+ *  @return The number of ticks that went by and were not handed out yet,
+ *          0 if the timer is periodic
+ */
+uint32_t timer_sync(void){
+    if (!oneshot) return 0;
+    int fired;
+    uint32_t ticks = timer_shot_elapsed(&fired) / TIMER_CYCLES;
+    /* the pending interrupt hands out the last tick */
+    if (fired) ticks = shot_ticks - 1;
+    if (ticks <= shot_counted) return 0;
+    ticks -= shot_counted;
+    shot_counted += ticks;
+    return ticks;
+}
+
+/** @brief Checks whether the timer is armed once rather than periodic
+ *  @return 1 if it is armed once, 0 otherwise
+ */
+int timer_is_oneshot(void){
+    return oneshot;
+}
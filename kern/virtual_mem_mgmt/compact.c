@@ -0,0 +1,253 @@
+/** @file compact.c
+ *  @brief Implements memory compaction
+ *
+ *  A request for a large block (a 4MB page) fails once memory fragments,
+ *  even with plenty of frames free, since the buddy allocator cannot move
+ *  allocated frames out of the way. Compaction does it for the buddy
+ *  allocator. It first walks the pages of every page directory and marks the
+ *  frames they map, so that the frame manager can pick the aligned range
+ *  that takes the fewest moves to empty. Only frames of anonymous and private
+ *  areas that a single page directory maps and references are moved. Frames
+ *  shared by copy-on-write, frames of the page cache and of shared segments
+ *  and large pages all stay put. It then walks the page directories again,
+ *  copies every page that lies in the range into a frame outside of it and
+ *  points its page table entry at the new frame. The range coalesces into a
+ *  single free block once the last of its frames is freed.
+ *
+ *  Page directories are only ever try locked, so a page directory that is
+ *  busy is left alone and the range may end up not empty. The caller finds
+ *  out by simply retrying its allocation.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <simics.h>
+#include <kern_internals.h>
+#include <frame_manager.h>
+#include <virtual_mem_mgmt.h>
+/* NULL */
+#include <stdlib.h>
+
+#include <debug.h>
+
+/** @brief defines the state shared by the walks of a compaction */
+typedef struct compact_walk {
+    /** @brief the page directory whose mutex the caller already holds */
+    page_directory_t *held;
+    /** @brief the address of the range being emptied */
+    uint32_t lo;
+    /** @brief the address just past the range being emptied */
+    uint32_t hi;
+    /** @brief number of pages moved out of the range */
+    uint32_t migrated;
+    /** @brief number of page directories that were busy */
+    uint32_t skipped;
+} compact_walk_t;
+
+/** @brief Held by the one thread compacting at a time */
+mutex_t compact_lock;
+/** @brief Fragmentation statistics before the last compaction */
+fm_frag_t compact_before;
+/** @brief Fragmentation statistics after the last compaction */
+fm_frag_t compact_after;
+/** @brief Number of pages the last compaction moved */
+uint32_t compact_migrated;
+/** @brief Number of compactions run */
+uint32_t compact_runs;
+
+/** @brief Calls a function on every page an area of a page directory maps
+ *         that compaction may move
+ *
+ *  Neighbouring areas may share a page, which is only visited once.
+ *
+ *  @param pd The page directory, with its mutex held
+ *  @param f The function to call with the page directory, the virtual
+ *           address of the page and the address of its frame
+ *  @param w The walk
+ *  @return Void
+ */
+void compact_walk_pages(page_directory_t *pd,
+        void (*f)(page_directory_t *, uint32_t, uint32_t, compact_walk_t *),
+        compact_walk_t *w){
+    uint32_t i, j, pte, last_page = 0;
+    bool any = false;
+    for (i = 0; i < pd->vmas.size; i++){
+        vma_t *vma = &pd->vmas.vmas[i];
+        uint32_t page = PAGE_ALIGN_DOWN(vma->start);
+        uint32_t num_pages =
+            (PAGE_ALIGN_DOWN(VMA_LAST(vma)) - page) / PAGE_SIZE + 1;
+        for (j = 0; j < num_pages; j++, page += PAGE_SIZE){
+            if (any && page <= last_page) continue;
+            any = true;
+            last_page = page;
+            if (vma->type != VMA_ANON && vma->type != VMA_PRIVATE) continue;
+            if (pd_get_large_mapping(pd, page, NULL) == 0) continue;
+            if (pd_get_mapping(pd, page, &pte) < 0
+                    || !pd_entry_present(pte)) continue;
+            f(pd, page, REMOVE_FLAGS(pte), w);
+        }
+    }
+}
+
+/** @brief Marks the frame of a page as mapped
+ *  @param pd The page directory
+ *  @param v_addr The virtual address of the page
+ *  @param p_addr The address of its frame
+ *  @param w The walk
+ *  @return Void
+ */
+void compact_mark_page(page_directory_t *pd, uint32_t v_addr,
+        uint32_t p_addr, compact_walk_t *w){
+    fm_compact_mark(&fm, p_addr);
+}
+
+/** @brief Moves a page into a frame outside of the range if its frame lies
+ *         in the range
+ *  @param pd The page directory
+ *  @param v_addr The virtual address of the page
+ *  @param p_addr The address of its frame
+ *  @param w The walk
+ *  @return Void
+ */
+void compact_move_page(page_directory_t *pd, uint32_t v_addr,
+        uint32_t p_addr, compact_walk_t *w){
+    if (p_addr < w->lo || p_addr >= w->hi) return;
+    /* frames shared since they were marked stay put */
+    if (fm_refcount(&fm, p_addr) != 1) return;
+    uint32_t new_addr;
+    /* nothing of the range is handed out during the compaction */
+    if (fm_alloc(&fm, 1, &new_addr) < 0) return;
+    if (pd_alloc_frame(pd, new_addr, 1) < 0){
+        fm_dealloc(&fm, new_addr);
+        return;
+    }
+    if (pd_migrate_page(pd, v_addr, new_addr) < 0){
+        pd_release_frames(pd, new_addr, 1);
+        fm_unref(&fm, new_addr, 1);
+        return;
+    }
+    if (pd_release_frames(pd, p_addr, 1) == 0){
+        fm_unref(&fm, p_addr, 1);
+    }
+    w->migrated++;
+}
+
+/** @brief Walks the pages of a page directory unless it is busy
+ *  @param pd The page directory
+ *  @param w The walk
+ *  @param f The function to call on each page
+ *  @return Void
+ */
+void compact_visit(page_directory_t *pd, compact_walk_t *w,
+        void (*f)(page_directory_t *, uint32_t, uint32_t, compact_walk_t *)){
+    if (pd != w->held && mutex_trylock(&pd->m) < 0){
+        w->skipped++;
+        return;
+    }
+    compact_walk_pages(pd, f, w);
+    if (pd != w->held) mutex_unlock(&pd->m);
+}
+
+/** @brief Marks the frames of a page directory, for pd_for_each
+ *  @param pd The page directory
+ *  @param arg The walk
+ *  @return Void
+ */
+void compact_mark_pd(page_directory_t *pd, void *arg){
+    compact_visit(pd, (compact_walk_t *)arg, &compact_mark_page);
+}
+
+/** @brief Moves the pages of a page directory out of the range, for
+ *         pd_for_each
+ *  @param pd The page directory
+ *  @param arg The walk
+ *  @return Void
+ */
+void compact_move_pd(page_directory_t *pd, void *arg){
+    compact_visit(pd, (compact_walk_t *)arg, &compact_move_page);
+}
+
+/** @brief Initializes memory compaction
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_compact_init(void){
+    if (mutex_init(&compact_lock) < 0) return -1;
+    return 0;
+}
+
+/** @brief Compacts memory so that a free block of 2^order frames forms
+ *
+ *  Gives up right away if another thread is already compacting, rather than
+ *  waiting on it with a page directory held.
+ *
+ *  @param order The order of the block that is wanted
+ *  @param held A page directory whose mutex the caller holds (optional)
+ *  @return The number of pages moved, negative integer code if no range
+ *          could be emptied
+ */
+int vmm_compact(uint32_t order, page_directory_t *held){
+    if (mutex_trylock(&compact_lock) < 0) return -1;
+    compact_walk_t w;
+    w.held = held;
+    w.migrated = 0;
+    w.skipped = 0;
+    fm_frag_t before;
+    fm_frag_stats(&fm, order, &before);
+
+    fm_compact_clear(&fm);
+    pd_for_each(&compact_mark_pd, &w);
+    int to_move = fm_compact_begin(&fm, order, &w.lo);
+    if (to_move < 0){
+        DEBUG_PRINT("compact: no range of order %d can be emptied",
+                (int)order);
+        mutex_unlock(&compact_lock);
+        return -2;
+    }
+    w.hi = w.lo + (1 << order) * PAGE_SIZE;
+    pd_for_each(&compact_move_pd, &w);
+    fm_compact_end(&fm);
+
+    compact_before = before;
+    fm_frag_stats(&fm, order, &compact_after);
+    compact_migrated = w.migrated;
+    compact_runs++;
+    lprintf("compact: moved %d of %d pages out of %p, %d busy, "
+            "unusable index %d -> %d", (int)w.migrated, to_move,
+            (void *)w.lo, (int)w.skipped, (int)before.unusable,
+            (int)compact_after.unusable);
+    mutex_unlock(&compact_lock);
+    return w.migrated;
+}
+
+/** @brief Compacts memory if free memory is too fragmented for large pages
+ *
+ *  Meant to be called by a kernel thread with nothing better to do, such as
+ *  the reaper once it has reaped.
+ *
+ *  @return Void
+ */
+void vmm_compact_idle(void){
+    fm_frag_t frag;
+    fm_frag_stats(&fm, VMM_COMPACT_ORDER, &frag);
+    if (frag.free_frames < (1 << VMM_COMPACT_ORDER)
+            || frag.unusable <= VMM_COMPACT_UNUSABLE) return;
+    vmm_compact(VMM_COMPACT_ORDER, NULL);
+}
+
+/** @brief Gets the statistics of the last compaction
+ *  @param before Where to store the fragmentation statistics from before it
+ *                (optional)
+ *  @param after Where to store the fragmentation statistics from after it
+ *               (optional)
+ *  @param migrated Where to store the number of pages it moved (optional)
+ *  @return The number of compactions run
+ */
+uint32_t vmm_compact_stats(fm_frag_t *before, fm_frag_t *after,
+        uint32_t *migrated){
+    if (before != NULL) *before = compact_before;
+    if (after != NULL) *after = compact_after;
+    if (migrated != NULL) *migrated = compact_migrated;
+    return compact_runs;
+}
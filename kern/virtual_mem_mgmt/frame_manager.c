@@ -3,27 +3,51 @@
  *
  *  We decided on implementing a binary buddy allocator for our frame manager.
  *  The buddy allocator allows us to represent a large number of pages using a
- *  single frame and allows for faster allocation for large number of pages and
- *  a smaller space footprint, as opposed to a simple linked list of free pages.
- *  Our implementation of hte buddy allocator uses bin sizes of power of two,
- *  which allow us to split and move larger pages easily. Every time a larger
- *  block is split to create smaller blocks, it is moved into a parent pool, and
- *  the two smaller blocks are linked together by a "buddy" link. Upon
- *  deallocating one of the buddy blocks, they can check to see if we should
- *  coalesce to form the larger parent block. This overall reduces external
- *  fragmentation at the cost of internal fragmentation.
- *
- *  We use a bin of linked lists to store our deallocated frames which gives us
- *  constant time deallocation requests if no splitting is required. However,
- *  since we need to be able to remove specific elements from the deallocated
- *  pool (due to coalescing and what not), we store each frame's linked list
- *  node in a particular hash table pool. Each hash table provides constant time
- *  lookup of linked list nodes which allow us to quickly place and remove
- *  linked list nodes into and out of their respective bin pools. In addition to
- *  deallocated and allocated pools, we have a parent pool which stores pointers
- *  to linked list nodes of split blocks. This allows for parents to persist
- *  after being split into smaller blocks and thus allows for multilevel
- *  coalescing.
+ *  single block and allows for faster allocation for large number of pages,
+ *  as opposed to a simple linked list of free pages. Our implementation of the
+ *  buddy allocator uses block sizes of power of two, which allow us to split
+ *  and coalesce blocks easily. This overall reduces external fragmentation at
+ *  the cost of internal fragmentation.
+ *
+ *  All bookkeeping lives in a single array with one frame_t per physical
+ *  frame, which is allocated once in fm_init. A block of 2^i frames is always
+ *  aligned to 2^i frames relative to USER_MEM_START and is described by the
+ *  metadata of its first frame (its head). This means the buddy of a block is
+ *  found with simple address arithmetic (flipping bit i of the head's index)
+ *  and no heap allocation or hash table lookups are needed to allocate,
+ *  split, free or coalesce blocks. Free blocks of each size are kept in an
+ *  intrusive doubly linked list threaded through the heads' metadata, so
+ *  removing a specific block (when coalescing with it) is constant time.
+ *
+ *  To support sharing frames between address spaces (copy-on-write fork) each
+ *  frame carries a reference count, and each allocated block keeps track of
+ *  how many of its frames are still referenced. A block is only handed back
+ *  to the buddy allocator once its last referenced frame is unreferenced,
+ *  which lets callers release individual pages of a larger block.
+ *
+ *  Most requests are for a single frame, so those are served from a small
+ *  magazine of free frames that is only protected by disabling interrupts
+ *  (we run on a single cpu). The magazine is refilled from and drained into
+ *  the buddy allocator in batches, so the common path never takes the frame
+ *  manager's mutex. Frames sitting in the magazine are allocated order 0
+ *  blocks with no references as far as the buddy allocator is concerned.
+ *
+ *  Frames freed into the magazine are zeroed in the background by the idle
+ *  path (see vmm_zero_idle_frames) and moved into a clean pool, which
+ *  fm_alloc_list_zeroed prefers so that callers that need zeroed memory can
+ *  skip zeroing those frames themselves.
+ *
+ *  Since requests are rounded up to a single block, a large request can fail
+ *  once memory fragments even though plenty of frames are free. fm_alloc_list
+ *  instead satisfies a request with a list of blocks of any size, which is
+ *  threaded through the heads of the blocks just like the free lists.
+ *
+ *  Requests that really need a large block (4MB pages) can compact memory
+ *  instead (see compact.c). The frame manager's part is to pick the aligned
+ *  range that is cheapest to empty, judging by which frames the caller marked
+ *  as movable, and to hold back every frame of the range that is or becomes
+ *  free until the caller is done moving the rest out, so that the range
+ *  coalesces into a single block at the end.
  *
  *  @author Aatish Nayak (aatishn)
  *  @author Christopher Wei (cjwei)
@@ -44,10 +68,19 @@
 
 /* uint32_t */
 #include <stdint.h>
+
+/* memset */
+#include <string.h>
 #include <simics.h>
 #include <debug.h>
 #include "contracts.h"
 #include <frame_manager.h>
+/* get_eflags */
+#include <special_reg_cntrl.h>
+/* disable_interrupts, enable_interrupts */
+#include <x86/asm.h>
+/* EFL_IF */
+#include <x86/eflags.h>
 
 /** @brief macro for max function */
 #define MAX(a,b) ((a) < (b) ? (b) : (a))
@@ -55,131 +88,94 @@
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 /** @brief macro for pow_2 */
 #define TWO_POW(i) (1 << (i))
-
-/** @brief Datastructure representing a single frame */
+/** @brief index of the frame containing addr in the frame array */
+#define FRAME_INDEX(addr) (((addr) - USER_MEM_START) >> PAGE_SHIFT)
+/** @brief physical address of the frame at index i in the frame array */
+#define FRAME_ADDR(i) (USER_MEM_START + ((i) << PAGE_SHIFT))
+/** @brief maximum number of references held on a single frame */
+#define MAX_REFCOUNT 0xFFFF
+/** @brief null index for the intrusive free lists and block lists */
+#define FRAME_NIL 0xFFFFFFFF
+
+/** @brief Datastructure holding the metadata of a single physical frame.
+ *
+ *  Only the head frame of a block holds meaningful status, order and list
+ *  information */
 typedef struct frame{
-    /** @brief The starting address of the frame */
-    uint32_t addr;
-    /** @brief The number of pages in the frame */
-    uint32_t num_pages;
-    /** @brief The status of the frame (allocated, deallocated, parent) */
-    int status;
-    /** @brief The index into frame manager deallocated bin */
-    int i;
-    /** @brief Pointer to the frame's buddy frame if it exists */
-    struct frame *buddy;
-    /** @brief Pointer to the frame's parent if it exists */
-    struct frame *parent;
+    /** @brief Index of the next free block of the same size, or of the next
+     * block of a frame_list_t once allocated */
+    uint32_t next;
+    union {
+        /** @brief Index of the previous free block of the same size */
+        uint32_t prev;
+        /** @brief Number of frames in an allocated block with a nonzero
+         * refcount */
+        uint32_t live;
+    };
+    /** @brief Number of references held on this frame */
+    uint16_t refcount;
+    /** @brief The block has 2^order frames */
+    uint8_t order;
+    /** @brief The status of the frame (allocated, deallocated, none) */
+    uint8_t status;
 } frame_t;
 
-/** @brief Status for a frame that is allocated */
-#define FRAME_ALLOC 0
-/** @brief Status for a frame that is deallocated */
-#define FRAME_DEALLOC 1
-/** @brief Status for a frame that has been split */
-#define FRAME_PARENT 2
-
-
-/** @brief Initializes a frame with the given parameters
- *  @param frame The frame
- *  @param addr The starting address
- *  @param num_pages The number of pages
- *  @param status The frame status
- *  @param buddy The buddy frame
- *  @param parent The parent frame
- *  @return 0 on success, negative integer code on failure
- */
-int frame_init(frame_t *frame, uint32_t addr, uint32_t num_pages,
-               int status, int i, frame_t *buddy, frame_t *parent){
-    if (frame == NULL) return -1;
-    frame->addr = addr;
-    frame->num_pages = num_pages;
-    frame->status = status;
-    frame->i = i;
-    frame->buddy = buddy;
-    frame->parent = parent;
-    return 0;
-}
-
-/** @brief Hashing function for addresses
- *  @param addr The input address
- *  @return The hashed address
- */
-int address_hash(key_t addr){
-    return (int)addr;
-}
-
-/** @brief Hashing function for page aligned addresses
- *  @param addr The input address
- *  @return The hashed address
+/** @brief Status for a frame that is not the head of a block */
+#define FRAME_NONE 0
+/** @brief Status for the head of an allocated block */
+#define FRAME_ALLOC 1
+/** @brief Status for the head of a deallocated block */
+#define FRAME_DEALLOC 2
+/** @brief Status for the head of a free block held back by a compaction */
+#define FRAME_RESERVED 3
+
+/** @brief checks whether a frame index lies in the range being compacted */
+#define IN_COMPACT_RANGE(fm, idx) \
+    ((idx) >= (fm)->compact_lo && (idx) < (fm)->compact_hi)
+/** @brief checks whether fm_compact_mark marked a frame exactly once */
+#define MARKED_ONCE(fm, idx) \
+    ((((fm)->seen[(idx) / 32] & ~(fm)->pinned[(idx) / 32]) >> ((idx) % 32)) & 1)
+
+int magazine_drain(frame_manager_t *fm, fm_magazine_t *mag,
+        uint32_t num_frames);
+
+/** @brief Pushes a deallocated block onto the free list for its size
+ *  @param fm The frame manager
+ *  @param idx The index of the block's head
+ *  @param i The order of the block
+ *  @return Void
  */
-int address_shift_hash(key_t addr){
-    return ((int)addr >> PAGE_SHIFT);
+void free_list_push(frame_manager_t *fm, uint32_t idx, int i){
+    frame_t *frame = &fm->frames[idx];
+    frame->status = FRAME_DEALLOC;
+    frame->order = i;
+    frame->prev = FRAME_NIL;
+    frame->next = fm->free_lists[i];
+    if (frame->next != FRAME_NIL){
+        fm->frames[frame->next].prev = idx;
+    }
+    fm->free_lists[i] = idx;
+    fm->num_free[i]++;
 }
 
-
-/** @brief Takes a frame and recursively joins it to the largest sized frame
- *         possible
- *
- *  This function takes a parent frame and checks to see if it has a buddy and
- *  is deallocated. If so, the frame and its buddy are removed and freed,
- *  and the request_join is called on the parent. Otherwise, the parent is
- *  removed from the parent pool and put into the deallocated pool.
- *
+/** @brief Removes a deallocated block from the free list for its size
  *  @param fm The frame manager
- *  @param frame The frame to join
- *  @return 0 on success, negative integer code on failure
+ *  @param idx The index of the block's head
+ *  @return Void
  */
-int request_join(frame_manager_t *fm, frame_t *frame){
-    if (frame == NULL) return -1;
-
-    ASSERT(frame->status == FRAME_PARENT);
-
-    if (frame->buddy != NULL && frame->buddy->status == FRAME_DEALLOC){
-        DEBUG_PRINT("Coalesing again!");
-        ASSERT(frame->parent == frame->buddy->parent && frame->parent != NULL);
-
-        frame_t *parent_frame = frame->parent;
-
-        /* destroy current frame and its buddy */
-        ll_node_t *buddy_node, *curr_node;
-        if (ht_remove(fm->parents, (key_t)(frame->addr | frame->i),
-                    (void *)&curr_node, NULL) < 0){
-            panic("Could not remove frame from parents!");
-        }
-        if (ht_remove(fm->deallocated, (key_t)(frame->buddy->addr),
-                    (void *)&buddy_node, NULL)< 0){
-            panic("Could not remove buddy node from dealloc!");
-        }
-        ll_unlink_node(fm->frame_bins[frame->i], buddy_node);
-        free(frame->buddy);
-        free(frame);
-        free(buddy_node);
-        free(curr_node);
-
-        /* call recursive join on parent */
-        if (request_join(fm, parent_frame) < 0){
-            panic("Invalid parent pointer!");
-        }
-
+void free_list_remove(frame_manager_t *fm, uint32_t idx){
+    frame_t *frame = &fm->frames[idx];
+    ASSERT(frame->status == FRAME_DEALLOC);
+    if (frame->prev != FRAME_NIL){
+        fm->frames[frame->prev].next = frame->next;
     } else {
-        /* base case when there is no buddy and no parent to further attempt to
-         * join or when the buddy is currently unavaliable to join on */
-
-        ll_node_t *node;
-        /* remove mapping in parents ht */
-        if (ht_remove(fm->parents, (key_t)(frame->addr | frame->i),
-                    (void **)&node, NULL) < 0){
-            panic("Could not locate parent in parent ht");
-        }
-        /* add mapping to deallocated ht */
-        if (ht_put(fm->deallocated, frame->addr, node) < 0){
-            panic("Could not register parent to deallocated");
-        }
-        frame->status = FRAME_DEALLOC;
-        ll_link_node_last(fm->frame_bins[frame->i], node);
+        fm->free_lists[frame->order] = frame->next;
     }
-    return 0;
+    if (frame->next != FRAME_NIL){
+        fm->frames[frame->next].prev = frame->prev;
+    }
+    fm->num_free[frame->order]--;
+    frame->status = FRAME_NONE;
 }
 
 
@@ -195,72 +191,253 @@ int request_join(frame_manager_t *fm, frame_t *frame){
  *  @return 0 on success, negative integer code on failure
  */
 int request_split(frame_manager_t *fm, int i){
-    if (i >= fm->num_bins || i == 0 || fm == NULL) return -1;
-    if (ll_size(fm->frame_bins[i]) < 0) panic("Invalid linked list!");
-    if (ll_size(fm->frame_bins[i]) == 0){
+    if (fm == NULL || i >= fm->num_bins || i == 0) return -1;
+    if (fm->free_lists[i] == FRAME_NIL){
         if (request_split(fm, i+1) < 0){
             DEBUG_PRINT("No blocks of size %d found", TWO_POW(i));
             return -2;
         }
     }
 
-    ASSERT(ll_size(fm->frame_bins[i]) > 0);
+    ASSERT(fm->free_lists[i] != FRAME_NIL);
+
+    /* take the next avaliable block and split it in half, pushing the right
+     * half first so that the left half is handed out first */
+    uint32_t idx = fm->free_lists[i];
+    free_list_remove(fm, idx);
+    free_list_push(fm, idx + TWO_POW(i-1), i-1);
+    free_list_push(fm, idx, i-1);
+    return 0;
+}
+
+/** @brief Allocates a block from the jth bin, splitting larger blocks if the
+ *         bin is empty
+ *
+ *  Must be called with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param j The index into the frame manager's bin pool
+ *  @param num_pages The number of pages of the block that will be referenced
+ *  @param p_addr The pointer to store the resulting block address
+ *  @return 0 on success, negative integer code on failure
+ */
+int alloc_frame(frame_manager_t *fm, int j, uint32_t num_pages,
+                uint32_t *p_addr){
+    if (fm->free_lists[j] == FRAME_NIL){
+        if (request_split(fm, j+1) < 0){
+            /* cached single frames may be all that keeps blocks from
+             * coalescing, give them back and try again */
+            if (magazine_drain(fm, &fm->mag, FM_MAGAZINE_SIZE)
+                    + magazine_drain(fm, &fm->clean, FM_CLEAN_SIZE) == 0
+                    || (fm->free_lists[j] == FRAME_NIL
+                        && request_split(fm, j+1) < 0)){
+                DEBUG_PRINT("No blocks of size %d found", TWO_POW(j));
+                return -2;
+            }
+        }
+    }
+
+    ASSERT(fm->free_lists[j] != FRAME_NIL);
 
-    frame_t *parent_frame;
-    ll_node_t *parent_node;
+    /* get the next avaliable block in the bin and remove it */
+    uint32_t idx = fm->free_lists[j];
+    free_list_remove(fm, idx);
+    frame_t *frame = &fm->frames[idx];
+    frame->status = FRAME_ALLOC;
+    frame->order = j;
 
-    /* get the next avaliable frame in the frame bin and remove it */
-    ll_head(fm->frame_bins[i], &parent_node);
-    ll_unlink_node(fm->frame_bins[i], parent_node);
-    ll_node_get_data(parent_node, (void **)&parent_frame);
-    ASSERT(parent_frame->status == FRAME_DEALLOC);
+    /* only the requested pages are referenced, the remainder of the block is
+     * never handed out */
+    uint32_t k;
+    for (k = 0; k < TWO_POW(j); k++){
+        fm->frames[idx+k].refcount = (k < num_pages) ? 1 : 0;
+    }
+    frame->live = num_pages;
 
-    /* deregister node from deallocated and register in parent */
-    ht_remove(fm->deallocated, parent_frame->addr, NULL, NULL);
-    ht_put(fm->parents, (parent_frame->addr | parent_frame->i), parent_node);
-    parent_frame->status = FRAME_PARENT;
+    DEBUG_PRINT("Allocated %p to %p", (void *)FRAME_ADDR(idx),
+            (void *)FRAME_ADDR(idx + TWO_POW(j)));
+
+    *p_addr = FRAME_ADDR(idx);
+    return 0;
+}
 
-    /* create two new nodes and register in dealloc */
-    frame_t *left_frame, *right_frame;
-    ll_node_t *left_node, *right_node;
+/** @brief Returns an allocated block back to the deallocated pool
+ *
+ *  Repeatedly coalesces the block with its buddy for as long as the buddy is
+ *  a deallocated block of the same size. Must be called with the frame
+ *  manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param idx The index of the allocated block's head
+ *  @return Void
+ */
+void release_frame(frame_manager_t *fm, uint32_t idx){
+    frame_t *frame = &fm->frames[idx];
+    ASSERT(frame->status == FRAME_ALLOC);
+    int i = frame->order;
+    DEBUG_PRINT("Deallocating %p to %p", (void *)FRAME_ADDR(idx),
+            (void *)FRAME_ADDR(idx + TWO_POW(i)));
+    if (IN_COMPACT_RANGE(fm, idx)){
+        /* nothing of the range may be handed out until fm_compact_end */
+        frame->status = FRAME_RESERVED;
+        return;
+    }
+    frame->status = FRAME_NONE;
 
-    /* create and initialize new frames */
-    left_frame = malloc(sizeof(frame_t));
-    right_frame = malloc(sizeof(frame_t));
+    /* See if we should coalesce */
+    while (i < fm->num_bins - 1){
+        uint32_t buddy = idx ^ TWO_POW(i);
+        if (buddy + TWO_POW(i) > fm->num_frames) break;
+        frame_t *buddy_frame = &fm->frames[buddy];
+        if (buddy_frame->status != FRAME_DEALLOC || buddy_frame->order != i)
+            break;
+        DEBUG_PRINT(">> Coalescing %p with %p", (void *)FRAME_ADDR(idx),
+                (void *)FRAME_ADDR(buddy));
+        free_list_remove(fm, buddy);
+        idx = MIN(idx, buddy);
+        i++;
+    }
+    free_list_push(fm, idx, i);
+}
 
-    frame_init(left_frame,
-            parent_frame->addr,
-            parent_frame->num_pages/2,
-            FRAME_DEALLOC,
-            i-1,
-            right_frame,
-            parent_frame);
 
-    frame_init(right_frame,
-            parent_frame->addr+((parent_frame->num_pages/2)*PAGE_SIZE),
-            parent_frame->num_pages/2,
-            FRAME_DEALLOC,
-            i-1,
-            left_frame,
-            parent_frame);
+/** @brief Keeps interrupts off while a magazine is touched
+ *
+ *  Unlike sched_mutex_unlock, magazine_unlock only turns interrupts back on if
+ *  they were on here, so this nests inside code that already runs with them
+ *  off.
+ *
+ *  @return The eflags to hand to magazine_unlock
+ */
+uint32_t magazine_lock(void){
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    return eflags;
+}
 
-    left_node = malloc(sizeof(ll_node_t));
-    right_node = malloc(sizeof(ll_node_t));
+/** @brief Turns interrupts back on if they were on before magazine_lock
+ *  @param eflags The eflags magazine_lock returned
+ *  @return Void
+ */
+void magazine_unlock(uint32_t eflags){
+    if (eflags & EFL_IF) enable_interrupts();
+}
 
-    /* link nodes to appropriate frame bin */
-    ll_node_init(left_node, left_frame);
-    ll_link_node_last(fm->frame_bins[i-1], left_node);
-    ll_node_init(right_node, right_frame);
-    ll_link_node_last(fm->frame_bins[i-1], right_node);
+/** @brief Pushes a free single frame into the magazine
+ *  @param fm The frame manager
+ *  @param p_addr The address of the frame
+ *  @return 0 on success, negative integer code if the magazine is full or
+ *          the frame is being compacted
+ */
+int magazine_push(frame_manager_t *fm, uint32_t p_addr){
+    fm_magazine_t *mag = &fm->mag;
+    int ret = -1;
+    uint32_t eflags = magazine_lock();
+    if (mag->count < FM_MAGAZINE_SIZE
+            && !IN_COMPACT_RANGE(fm, FRAME_INDEX(p_addr))){
+        mag->frames[mag->count++] = p_addr;
+        ret = 0;
+    }
+    magazine_unlock(eflags);
+    return ret;
+}
 
-    /* register nodes in the dealloc ht */
-    ht_put(fm->deallocated, left_frame->addr, left_node);
-    ht_put(fm->deallocated, right_frame->addr, right_node);
+/** @brief Returns up to num_frames frames from the magazine to the buddy
+ *         allocator
+ *
+ *  Must be called with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param mag The magazine to drain
+ *  @param num_frames The maximum number of frames to drain
+ *  @return The number of frames drained
+ */
+int magazine_drain(frame_manager_t *fm, fm_magazine_t *mag,
+        uint32_t num_frames){
+    uint32_t batch[FM_MAGAZINE_SIZE];
+    uint32_t i, n = 0;
+    uint32_t eflags = magazine_lock();
+    while (n < num_frames && n < FM_MAGAZINE_SIZE && mag->count > 0){
+        batch[n++] = mag->frames[--mag->count];
+    }
+    magazine_unlock(eflags);
+    for (i = 0; i < n; i++){
+        release_frame(fm, FRAME_INDEX(batch[i]));
+    }
+    return n;
+}
 
+/** @brief Allocates a single frame from the magazine, refilling it from the
+ *         buddy allocator in a batch if it is empty
+ *  @param fm The frame manager
+ *  @param p_addr The pointer to store the resulting frame address
+ *  @return 0 on success, negative integer code on failure
+ */
+int magazine_alloc(frame_manager_t *fm, uint32_t *p_addr){
+    fm_magazine_t *mag = &fm->mag;
+    uint32_t addr;
+    uint32_t eflags = magazine_lock();
+    if (mag->count > 0){
+        addr = mag->frames[--mag->count];
+        mag->hits++;
+        magazine_unlock(eflags);
+    } else {
+        mag->misses++;
+        magazine_unlock(eflags);
+
+        /* refill from the buddy allocator, keeping the last frame */
+        uint32_t batch[FM_MAGAZINE_BATCH];
+        uint32_t i, n;
+        mutex_lock(&fm->m);
+        for (n = 0; n < FM_MAGAZINE_BATCH; n++){
+            if (alloc_frame(fm, 0, 0, &batch[n]) < 0) break;
+        }
+        if (n == 0){
+            mutex_unlock(&fm->m);
+            return -1;
+        }
+        addr = batch[--n];
+        for (i = 0; i < n; i++){
+            if (magazine_push(fm, batch[i]) < 0){
+                release_frame(fm, FRAME_INDEX(batch[i]));
+            }
+        }
+        mutex_unlock(&fm->m);
+    }
+    /* the frame is ours now, nobody else touches its metadata */
+    frame_t *frame = &fm->frames[FRAME_INDEX(addr)];
+    frame->refcount = 1;
+    frame->live = 1;
+    *p_addr = addr;
     return 0;
+}
 
+/** @brief Gets the magazine hit and miss counters
+ *  @param fm The frame manager
+ *  @param hits Where to store the number of hits (optional)
+ *  @param misses Where to store the number of misses (optional)
+ *  @return Void
+ */
+void fm_magazine_stats(frame_manager_t *fm, uint32_t *hits,
+        uint32_t *misses){
+    if (fm == NULL) return;
+    if (hits != NULL) *hits = fm->mag.hits;
+    if (misses != NULL) *misses = fm->mag.misses;
 }
 
+/** @brief Gets the clean pool hit and miss counters
+ *  @param fm The frame manager
+ *  @param hits Where to store the number of zeroed frames handed out
+ *         (optional)
+ *  @param misses Where to store the number of frames that could not be
+ *         served from the clean pool (optional)
+ *  @return Void
+ */
+void fm_clean_stats(frame_manager_t *fm, uint32_t *hits, uint32_t *misses){
+    if (fm == NULL) return;
+    if (hits != NULL) *hits = fm->clean.hits;
+    if (misses != NULL) *misses = fm->clean.misses;
+}
 
 /** @brief Requests a frame from the frame manager
  *
@@ -276,6 +453,8 @@ int request_split(frame_manager_t *fm, int i){
  */
 int fm_alloc(frame_manager_t *fm, uint32_t num_pages, uint32_t *p_addr){
     int j;
+    /* single frames come from the magazine */
+    if (num_pages == 1 && magazine_alloc(fm, p_addr) == 0) return 0;
     mutex_lock(&fm->m);
     uint32_t frame_size = TWO_POW(fm->num_bins-1);
     if (num_pages > frame_size){
@@ -294,44 +473,45 @@ int fm_alloc(frame_manager_t *fm, uint32_t num_pages, uint32_t *p_addr){
         frame_size = TWO_POW(j);
         if (num_pages <= frame_size && num_pages > TWO_POW(j-1)) break;
     }
-    frame_size = TWO_POW(j);
-    if (ll_size(fm->frame_bins[j]) < 0) panic("Invalid linked list!");
-    if (ll_size(fm->frame_bins[j]) == 0){
-        if (request_split(fm, j+1) < 0){
-            DEBUG_PRINT("No blocks of size %d found", (unsigned int)frame_size);
-            mutex_unlock(&fm->m);
-            return -2;
-        }
+    if (alloc_frame(fm, j, num_pages, p_addr) < 0){
+        mutex_unlock(&fm->m);
+        return -2;
     }
-
-    ASSERT(ll_size(fm->frame_bins[j]) > 0);
-
-    frame_t *frame;
-    ll_node_t *node;
-
-    /* get the next avaliable frame in the frame bin and remove it */
-    ll_head(fm->frame_bins[j], &node);
-    ll_unlink_node(fm->frame_bins[j], node);
-    ll_node_get_data(node, (void **)&frame);
-    ASSERT(frame->status == FRAME_DEALLOC);
-
-    /* deregister node from deallocated and register in allocated */
-    ht_remove(fm->deallocated, frame->addr, NULL, NULL);
-    ht_put(fm->allocated, frame->addr, node);
-    frame->status = FRAME_ALLOC;
-
-    DEBUG_PRINT("Allocated %p to %p", (void *)frame->addr, (void *)(frame->addr + (PAGE_SIZE * frame->num_pages)));
-
-    *p_addr = frame->addr;
-
     mutex_unlock(&fm->m);
     return 0;
 }
 
+/** @brief Returns the allocated frame at p_addr to the deallocated pool
+ *
+ *  Must be called with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The address of the frame to be returned
+ *  @return 0 on success, negative integer code on failure
+ */
+int dealloc_frame(frame_manager_t *fm, uint32_t p_addr){
+    if (p_addr < USER_MEM_START || p_addr % PAGE_SIZE != 0
+            || FRAME_INDEX(p_addr) >= fm->num_frames) return -1;
+    uint32_t idx = FRAME_INDEX(p_addr);
+    frame_t *frame = &fm->frames[idx];
+    if (frame->status != FRAME_ALLOC){
+        DEBUG_PRINT("Address is not the start of an allocated frame");
+        return -2;
+    }
+    uint32_t k;
+    for (k = 0; k < TWO_POW(frame->order); k++){
+        fm->frames[idx+k].refcount = 0;
+    }
+    frame->live = 0;
+    release_frame(fm, idx);
+    return 0;
+}
+
 /** @brief Returns a frame to the frame manager
  *
  *  Endpoint for the virtual memory manager. Find the frame with the given
- *  p_addr and returns it back to the deallocated pool
+ *  p_addr and returns it back to the deallocated pool regardless of any
+ *  outstanding references on its pages
  *
  *  @param fm The frame manager
  *  @param p_addr The address of the frame to be returned
@@ -339,61 +519,410 @@ int fm_alloc(frame_manager_t *fm, uint32_t num_pages, uint32_t *p_addr){
  */
 int fm_dealloc(frame_manager_t *fm, uint32_t p_addr){
     if (fm == NULL) return -1;
+    if (p_addr >= USER_MEM_START && p_addr % PAGE_SIZE == 0
+            && FRAME_INDEX(p_addr) < fm->num_frames){
+        /* the caller owns the block so its head cannot change under us */
+        frame_t *frame = &fm->frames[FRAME_INDEX(p_addr)];
+        if (frame->status == FRAME_ALLOC && frame->order == 0){
+            frame->refcount = 0;
+            frame->live = 0;
+            if (magazine_push(fm, p_addr) == 0) return 0;
+            /* magazine is full, drain a batch and return the frame */
+            mutex_lock(&fm->m);
+            magazine_drain(fm, &fm->mag, FM_MAGAZINE_BATCH);
+            if (magazine_push(fm, p_addr) < 0){
+                release_frame(fm, FRAME_INDEX(p_addr));
+            }
+            mutex_unlock(&fm->m);
+            return 0;
+        }
+    }
     mutex_lock(&fm->m);
+    int ret = dealloc_frame(fm, p_addr);
+    mutex_unlock(&fm->m);
+    return ret;
+}
+
+/** @brief Initializes an empty list of blocks
+ *  @param list The list
+ *  @return Void
+ */
+void fm_list_init(frame_list_t *list){
+    list->first = FRAME_NIL;
+    list->last = FRAME_NIL;
+    list->size = 0;
+    list->num_zeroed = 0;
+}
+
+/** @brief Appends an allocated block to a list of blocks
+ *
+ *  The caller must own the block, so that its head's next index is free to
+ *  link the list through.
+ *
+ *  @param fm The frame manager
+ *  @param list The list
+ *  @param idx The index of the block's head
+ *  @return Void
+ */
+void list_append(frame_manager_t *fm, frame_list_t *list, uint32_t idx){
+    fm->frames[idx].next = FRAME_NIL;
+    if (list->size == 0){
+        list->first = idx;
+    } else {
+        fm->frames[list->last].next = idx;
+    }
+    list->last = idx;
+    list->size++;
+}
+
+/** @brief Returns every block of a list to the buddy allocator
+ *
+ *  Must be called with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param list The list, which is left empty
+ *  @return Void
+ */
+void dealloc_list(frame_manager_t *fm, frame_list_t *list){
+    uint32_t idx = list->first;
+    while (idx != FRAME_NIL){
+        /* freeing the block reuses its next index */
+        uint32_t next = fm->frames[idx].next;
+        dealloc_frame(fm, FRAME_ADDR(idx));
+        idx = next;
+    }
+    fm_list_init(list);
+}
 
-    /* Get the node from the allocated pool */
-    ll_node_t *node;
-    if (ht_remove(fm->allocated, (key_t)p_addr, (void **)&node, NULL) < 0){
-        DEBUG_PRINT("Could not locate address in allocated ht");
+/** @brief Requests num_pages frames from the frame manager without requiring
+ *         them to be physically contiguous
+ *
+ *  Endpoint for the virtual memory manager. Rather than rounding the request
+ *  up to a single power of two block, the request is broken into a list of
+ *  blocks whose sizes are powers of two. Larger blocks are preferred, but once
+ *  a block size can no longer be satisfied we fall back to smaller ones, so
+ *  the request succeeds as long as enough frames are free. The list is linked
+ *  through the heads of the blocks, so no memory is allocated to build it.
+ *
+ *  @param fm The frame manager
+ *  @param num_pages The number of pages requested
+ *  @param runs The list to store the blocks in
+ *  @return 0 on success, negative integer code on failure
+ */
+int fm_alloc_list(frame_manager_t *fm, uint32_t num_pages, frame_list_t *runs){
+    if (fm == NULL || runs == NULL || num_pages == 0) return -1;
+    fm_list_init(runs);
+    mutex_lock(&fm->m);
+    uint32_t remaining = num_pages;
+    int j = fm->num_bins-1;
+    while (remaining > 0){
+        /* largest block that does not exceed what we still need */
+        while (TWO_POW(j) > remaining) j--;
+        uint32_t p_addr;
+        if (alloc_frame(fm, j, TWO_POW(j), &p_addr) < 0){
+            /* no blocks this large are left, try smaller ones */
+            if (j == 0) break;
+            j--;
+            continue;
+        }
+        list_append(fm, runs, FRAME_INDEX(p_addr));
+        remaining -= TWO_POW(j);
+    }
+    if (remaining > 0){
+        DEBUG_PRINT("Could not find %d pages", (unsigned int)num_pages);
+        dealloc_list(fm, runs);
         mutex_unlock(&fm->m);
         return -2;
     }
-    frame_t *frame;
-    ll_node_get_data(node, (void **)&frame);
-    ASSERT(frame->status == FRAME_ALLOC);
-    DEBUG_PRINT("Deallocating %p to %p", (void *)frame->addr, (void *)(frame->addr + PAGE_SIZE*frame->num_pages));
-    frame_t *buddy_frame = frame->buddy;
+    mutex_unlock(&fm->m);
+    return 0;
+}
 
-    ASSERT( (!buddy_frame) ||
-            (buddy_frame->parent == frame->parent
-             && buddy_frame->i == frame->i
-             && buddy_frame->num_pages == frame->num_pages
-             && buddy_frame->buddy == frame));
+/** @brief Returns every block of a list to the frame manager
+ *  @param fm The frame manager
+ *  @param runs The list of blocks from fm_alloc_list, which is left empty
+ *  @return Void
+ */
+void fm_dealloc_list(frame_manager_t *fm, frame_list_t *runs){
+    if (fm == NULL || runs == NULL) return;
+    mutex_lock(&fm->m);
+    dealloc_list(fm, runs);
+    mutex_unlock(&fm->m);
+}
 
-    /* See if we should coalesce */
-    if (buddy_frame != NULL && buddy_frame->status == FRAME_DEALLOC){
-        DEBUG_PRINT(">> Coalescing %p with %p to %p", (void *)frame->addr, (void *)buddy_frame->addr,
-                (void *)frame->parent);
+/** @brief Requests num_pages zeroed frames from the frame manager without
+ *         requiring them to be physically contiguous
+ *
+ *  Like fm_alloc_list, but takes as many frames as possible from the clean
+ *  pool first. Those come first in the list as single frame blocks known to
+ *  be zeroed, the rest are not zeroed and it is up to the caller to zero them.
+ *
+ *  @param fm The frame manager
+ *  @param num_pages The number of pages requested
+ *  @param runs The list to store the blocks in
+ *  @return 0 on success, negative integer code on failure
+ */
+int fm_alloc_list_zeroed(frame_manager_t *fm, uint32_t num_pages,
+        frame_list_t *runs){
+    if (fm == NULL || runs == NULL || num_pages == 0) return -1;
+    fm_list_init(runs);
+    fm_magazine_t *clean = &fm->clean;
+    uint32_t remaining = num_pages;
+    uint32_t eflags = magazine_lock();
+    while (remaining > 0 && clean->count > 0){
+        uint32_t idx = FRAME_INDEX(clean->frames[--clean->count]);
+        frame_t *frame = &fm->frames[idx];
+        frame->refcount = 1;
+        frame->live = 1;
+        list_append(fm, runs, idx);
+        remaining--;
+    }
+    runs->num_zeroed = runs->size;
+    clean->hits += runs->size;
+    clean->misses += remaining;
+    magazine_unlock(eflags);
+    if (remaining == 0) return 0;
+
+    /* get the rest from the buddy allocator */
+    frame_list_t rest;
+    if (fm_alloc_list(fm, remaining, &rest) < 0){
+        fm_dealloc_list(fm, runs);
+        return -2;
+    }
+    if (runs->size == 0){
+        *runs = rest;
+    } else {
+        fm->frames[runs->last].next = rest.first;
+        runs->last = rest.last;
+        runs->size += rest.size;
+    }
+    return 0;
+}
+
+/** @brief Takes a free frame that should be zeroed for the clean pool
+ *
+ *  Must be called with interrupts disabled, and the frame must be handed to
+ *  fm_put_clean_frame before they are enabled again.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr Where to store the address of the frame
+ *  @return 0 on success, negative integer code if the clean pool is full or
+ *          there are no free frames cached
+ */
+int fm_get_dirty_frame(frame_manager_t *fm, uint32_t *p_addr){
+    if (fm == NULL || p_addr == NULL) return -1;
+    if (fm->clean.count == FM_CLEAN_SIZE || fm->mag.count == 0) return -2;
+    *p_addr = fm->mag.frames[--fm->mag.count];
+    return 0;
+}
+
+/** @brief Places a frame from fm_get_dirty_frame that has been zeroed into the
+ *         clean pool
+ *
+ *  Must be called with interrupts disabled.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The address of the zeroed frame
+ *  @return Void
+ */
+void fm_put_clean_frame(frame_manager_t *fm, uint32_t p_addr){
+    if (fm == NULL) return;
+    ASSERT(fm->clean.count < FM_CLEAN_SIZE);
+    fm->clean.frames[fm->clean.count++] = p_addr;
+}
+
+/** @brief Initializes an iterator over the frames of a list of blocks
+ *  @param it The iterator
+ *  @param fm The frame manager the blocks came from
+ *  @param runs The list of blocks
+ *  @return Void
+ */
+void fm_iter_init(frame_iter_t *it, frame_manager_t *fm, frame_list_t *runs){
+    it->fm = fm;
+    it->idx = runs->first;
+    it->offset = 0;
+    it->num_zeroed = runs->num_zeroed;
+}
+
+/** @brief Gets the rest of the current block from a block list iterator
+ *
+ *  The block's frames are physically contiguous.
+ *
+ *  @param it The iterator
+ *  @param p_addr Where to store the address of the first frame
+ *  @param num_pages Where to store the number of frames
+ *  @param zeroed Where to store whether the frames are known to be zeroed
+ *                (optional)
+ *  @return 0 on success, negative integer code if there are no frames left
+ */
+int fm_iter_next_run(frame_iter_t *it, uint32_t *p_addr, uint32_t *num_pages,
+        bool *zeroed){
+    if (it->idx == FRAME_NIL) return -1;
+    frame_t *frame = &it->fm->frames[it->idx];
+    *p_addr = FRAME_ADDR(it->idx + it->offset);
+    *num_pages = TWO_POW(frame->order) - it->offset;
+    if (zeroed != NULL) *zeroed = (it->num_zeroed > 0);
+    if (it->num_zeroed > 0) it->num_zeroed--;
+    it->idx = frame->next;
+    it->offset = 0;
+    return 0;
+}
 
-        frame_t *parent_frame = frame->parent;
-        ll_node_t *buddy_node;
+/** @brief Gets the next frame from a block list iterator
+ *  @param it The iterator
+ *  @param p_addr Where to store the address of the next frame
+ *  @param zeroed Where to store whether the frame is known to be zeroed
+ *                (optional)
+ *  @return 0 on success, negative integer code if there are no frames left
+ */
+int fm_iter_next(frame_iter_t *it, uint32_t *p_addr, bool *zeroed){
+    if (it->idx == FRAME_NIL) return -1;
+    frame_t *frame = &it->fm->frames[it->idx];
+    *p_addr = FRAME_ADDR(it->idx + it->offset);
+    if (zeroed != NULL) *zeroed = (it->num_zeroed > 0);
+    if (++it->offset == TWO_POW(frame->order)){
+        if (it->num_zeroed > 0) it->num_zeroed--;
+        it->idx = frame->next;
+        it->offset = 0;
+    }
+    return 0;
+}
 
-        /* remove buddy mapping in deallocated pool */
-        if (ht_remove(fm->deallocated, (key_t)buddy_frame->addr,
-                        (void **)&buddy_node, NULL) < 0){
-            panic("Could not remove buddy from dealloc ht");
+/** @brief Finds the allocated block that contains a physical address
+ *
+ *  Allocated blocks of size 2^i always start on a 2^i frame boundary, so the
+ *  owning block's head must be one of those aligned frames. Must be called
+ *  with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address
+ *  @param headp Pointer to store the index of the owning block's head
+ *  @return 0 on success, negative integer code on failure
+ */
+int find_allocated_frame(frame_manager_t *fm, uint32_t p_addr,
+                         uint32_t *headp){
+    if (p_addr < USER_MEM_START || FRAME_INDEX(p_addr) >= fm->num_frames)
+        return -1;
+    uint32_t idx = FRAME_INDEX(p_addr);
+    int i;
+    for (i = 0; i < fm->num_bins; i++){
+        uint32_t head = idx & ~(TWO_POW(i) - 1);
+        frame_t *frame = &fm->frames[head];
+        if (frame->status == FRAME_ALLOC
+                && idx < head + TWO_POW(frame->order)){
+            *headp = head;
+            return 0;
         }
-        /* remove from deallocated bin pool */
-        ll_unlink_node(fm->frame_bins[buddy_frame->i], buddy_node);
+    }
+    return -2;
+}
 
-        /* free resources */
-        free(frame);
-        free(buddy_frame);
-        free(buddy_node);
-        free(node);
+/** @brief Checks that num_pages contiguous frames starting at p_addr lie in
+ *         allocated blocks and are all referenced
+ *
+ *  The frames may span several blocks. Must be called with the frame
+ *  manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address of the first frame
+ *  @param num_pages The number of frames
+ *  @param ref Whether the frames are about to be referenced once more
+ *  @return 0 on success, negative integer code on failure
+ */
+int check_refs(frame_manager_t *fm, uint32_t p_addr, uint32_t num_pages,
+               bool ref){
+    uint32_t head, idx = FRAME_INDEX(p_addr), end = idx + num_pages;
+    while (idx < end){
+        if (find_allocated_frame(fm, FRAME_ADDR(idx), &head) < 0) return -1;
+        uint32_t stop = head + TWO_POW(fm->frames[head].order);
+        if (stop > end) stop = end;
+        for (; idx < stop; idx++){
+            uint16_t refcount = fm->frames[idx].refcount;
+            if (refcount == 0 || (ref && refcount == MAX_REFCOUNT))
+                return -2;
+        }
+    }
+    return 0;
+}
 
-        /* recursively coalesce parent frame */
-        request_join(fm, parent_frame);
-    } else {
-        /* register with dealloc and put into the linked list */
-        ht_put(fm->deallocated, (key_t)frame->addr, node);
-        ll_link_node_last(fm->frame_bins[frame->i], node);
-        frame->status = FRAME_DEALLOC;
+/** @brief Adds a reference to num_pages contiguous frames starting at p_addr
+ *
+ *  The frames may span several blocks returned by fm_alloc and must already
+ *  be referenced, i.e. this is used to share existing frames
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address of the first frame
+ *  @param num_pages The number of frames to reference
+ *  @return 0 on success, negative integer code on failure
+ */
+int fm_ref(frame_manager_t *fm, uint32_t p_addr, uint32_t num_pages){
+    if (fm == NULL || p_addr % PAGE_SIZE != 0 || p_addr < USER_MEM_START)
+        return -1;
+    mutex_lock(&fm->m);
+    /* validate before modifying anything */
+    if (check_refs(fm, p_addr, num_pages, true) < 0){
+        mutex_unlock(&fm->m);
+        return -2;
+    }
+    uint32_t i, idx = FRAME_INDEX(p_addr);
+    for (i = 0; i < num_pages; i++){
+        fm->frames[idx+i].refcount++;
+    }
+    mutex_unlock(&fm->m);
+    return 0;
+}
+
+/** @brief Drops a reference on num_pages contiguous frames starting at p_addr
+ *
+ *  The frames may span several blocks. Once every frame of a block has been
+ *  unreferenced, the block is returned to the deallocated pool
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address of the first frame
+ *  @param num_pages The number of frames to unreference
+ *  @return 0 on success, negative integer code on failure
+ */
+int fm_unref(frame_manager_t *fm, uint32_t p_addr, uint32_t num_pages){
+    if (fm == NULL || p_addr % PAGE_SIZE != 0 || p_addr < USER_MEM_START)
+        return -1;
+    mutex_lock(&fm->m);
+    if (check_refs(fm, p_addr, num_pages, false) < 0){
+        mutex_unlock(&fm->m);
+        return -2;
+    }
+    uint32_t head, idx = FRAME_INDEX(p_addr), end = idx + num_pages;
+    while (idx < end){
+        find_allocated_frame(fm, FRAME_ADDR(idx), &head);
+        frame_t *frame = &fm->frames[head];
+        uint32_t stop = head + TWO_POW(frame->order);
+        if (stop > end) stop = end;
+        for (; idx < stop; idx++){
+            if (--fm->frames[idx].refcount == 0) frame->live--;
+        }
+        if (frame->live == 0){
+            /* dead single frames go back to the magazine when there is
+             * room */
+            if (frame->order != 0 || magazine_push(fm, FRAME_ADDR(head)) < 0){
+                release_frame(fm, head);
+            }
+        }
     }
     mutex_unlock(&fm->m);
     return 0;
 }
 
+/** @brief Gets the number of references held on the frame at p_addr
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address of the frame
+ *  @return The reference count on success, negative integer code on failure
+ */
+int fm_refcount(frame_manager_t *fm, uint32_t p_addr){
+    if (fm == NULL || p_addr < USER_MEM_START
+            || FRAME_INDEX(p_addr) >= fm->num_frames) return -1;
+    return fm->frames[FRAME_INDEX(p_addr)].refcount;
+}
+
 
 /** @brief Initializes the frame manager with all the frames that represent the
  *         possible physical addresses avaliable to the user space
@@ -404,7 +933,7 @@ int fm_dealloc(frame_manager_t *fm, uint32_t p_addr){
  *  persist and should never be "deallocated" or "allocated".
  *
  *  @param fm The frame manager
- *  @param num_frames Number of user space pages to allocate
+ *  @param num_pages Number of user space pages to track
  *  @return 0 on success, negative integer code on failure
  */
 int fm_init_user_space(frame_manager_t *fm, uint32_t num_pages){
@@ -412,38 +941,21 @@ int fm_init_user_space(frame_manager_t *fm, uint32_t num_pages){
     mutex_lock(&fm->m);
     int i;
     uint32_t num_bins = fm->num_bins;
-    int pages_remaining = num_pages;
-    uint32_t p_addr = USER_MEM_START;
+    uint32_t pages_remaining = num_pages;
+    uint32_t idx = 0;
 
-    /* for each bin, starting with the largest bin, allocate as many frames as
-     * possible */
+    /* for each bin, starting with the largest bin, add as many blocks as
+     * possible. Since sizes only decrease, every block stays aligned to its
+     * own size */
     for (i = num_bins-1; i != -1; i--){
         uint32_t frame_size = TWO_POW(i);
         while(pages_remaining >= frame_size){
-            DEBUG_PRINT("Allocating a frame with %d pages; %d remaining",
+            DEBUG_PRINT("Adding a block with %d pages; %d remaining",
                     (unsigned int)frame_size,
                     (unsigned int)(pages_remaining - frame_size));
-
-            /* create a new frame */
-            frame_t *new_frame = malloc(sizeof(frame_t));
-            frame_init(new_frame,
-                    p_addr,
-                    frame_size,
-                    FRAME_DEALLOC,
-                    i,
-                    NULL,
-                    NULL);
-            /* link the frame to its respective bin */
-            ll_node_t *node = malloc(sizeof(ll_node_t));
-            ll_node_init(node, (void *)new_frame);
-            ll_link_node_last(fm->frame_bins[i], node);
-
-            /* create a mapping between paddr->node */
-            ht_put(fm->deallocated, p_addr, node);
-
+            free_list_push(fm, idx, i);
             pages_remaining -= frame_size;
-            p_addr += PAGE_SIZE * frame_size;
-
+            idx += frame_size;
         }
     }
     mutex_unlock(&fm->m);
@@ -460,7 +972,7 @@ int fm_init_user_space(frame_manager_t *fm, uint32_t num_pages){
  *  @return 0 on success, negative integer code on failure
  */
 int fm_init(frame_manager_t *fm, uint32_t num_bins){
-    if (fm == NULL) return -1;
+    if (fm == NULL || num_bins == 0 || num_bins > FM_MAX_BINS) return -1;
 
     int i = USER_MEM_START/PAGE_SIZE;
     int n = machine_phys_frames();
@@ -472,31 +984,31 @@ int fm_init(frame_manager_t *fm, uint32_t num_bins){
     num_frames = MIN(n, n_addressable);
     if (mutex_init(&(fm->m)) < 0) return -1;
 
-    /* initialize hash tables */
-    /* allocated and deallocate frames should have unique addresses
-     * which are also page aligned. Therefore, for a decent hash
-     * function we should ignore the bottom 12 bits since they are
-     * all the same */
-    fm->allocated = malloc(sizeof(ht_t));
-    ht_init(fm->allocated, 64, &address_shift_hash);
-    fm->deallocated = malloc(sizeof(ht_t));
-    ht_init(fm->deallocated, 64, &address_shift_hash);
-    /* Since parent address can be the same, we need a different key to hash
-     * We know that there cannot be multiple entries with the same address and
-     * the same bin size, we can use the bottom 12 bits of the address to store
-     * addition information about the address and thus we should not page shift
-     * them away when hashing*/
-    fm->parents = malloc(sizeof(ht_t));
-    ht_init(fm->parents, 64, &address_hash);
+    /* these are the only allocations the frame manager ever makes */
+    fm->frames = malloc(sizeof(frame_t) * num_frames);
+    if (fm->frames == NULL) return -1;
+    memset(fm->frames, 0, sizeof(frame_t) * num_frames);
+    fm->num_frames = num_frames;
+    uint32_t words = (num_frames + 31) / 32;
+    fm->seen = calloc(words, sizeof(uint32_t));
+    fm->pinned = calloc(words, sizeof(uint32_t));
+    if (fm->seen == NULL || fm->pinned == NULL) return -1;
+    fm->compact_lo = 0;
+    fm->compact_hi = 0;
 
     /* initialize bins */
-    fm->frame_bins = malloc(sizeof(ll_t *) * num_bins);
     uint32_t j;
-    for (j = 0; j < num_bins; j++){
-        fm->frame_bins[j] = malloc(sizeof(ll_t));
-        ll_init(fm->frame_bins[j]);
+    for (j = 0; j < FM_MAX_BINS; j++){
+        fm->free_lists[j] = FRAME_NIL;
+        fm->num_free[j] = 0;
     }
     fm->num_bins = num_bins;
+    fm->mag.count = 0;
+    fm->mag.hits = 0;
+    fm->mag.misses = 0;
+    fm->clean.count = 0;
+    fm->clean.hits = 0;
+    fm->clean.misses = 0;
 
     if (fm_init_user_space(fm, num_frames) < 0){
         panic("Could not initialize frame manager!");
@@ -505,23 +1017,186 @@ int fm_init(frame_manager_t *fm, uint32_t num_bins){
     return 0;
 }
 
-/* Debugging purposes only */
+/** @brief Gets the fragmentation statistics of a frame manager
+ *  @param fm The frame manager
+ *  @param order The order of the blocks that are wanted
+ *  @param frag Where to store the statistics
+ *  @return Void
+ */
+void fm_frag_stats(frame_manager_t *fm, uint32_t order, fm_frag_t *frag){
+    if (fm == NULL || frag == NULL) return;
+    mutex_lock(&fm->m);
+    uint32_t i, usable = 0;
+    frag->free_frames = fm->mag.count + fm->clean.count;
+    frag->free_blocks = fm->mag.count + fm->clean.count;
+    frag->largest_order = (frag->free_frames > 0) ? 0 : -1;
+    for (i = 0; i < fm->num_bins; i++){
+        if (fm->num_free[i] == 0) continue;
+        frag->free_frames += fm->num_free[i] * TWO_POW(i);
+        frag->free_blocks += fm->num_free[i];
+        frag->largest_order = i;
+        if (i >= order) usable += fm->num_free[i] * TWO_POW(i);
+    }
+    mutex_unlock(&fm->m);
+    frag->unusable = (frag->free_frames == 0) ? 0
+        : ((frag->free_frames - usable) * 1000) / frag->free_frames;
+}
 
-void frame_print(void *ptr){
-    frame_t *f = (frame_t *)ptr;
-    if (ptr == NULL) lprintf("(NULL_FRAME)");
-    else lprintf("<%p>(%d)%d: [%p, %p), parent: %p, buddy: %p",
-            ptr,
-            (unsigned int)f->i, (unsigned int)f->num_pages, (void *)f->addr,
-            (void *)(f->addr + PAGE_SIZE*f->num_pages),
-            (void *)(f->parent), (void *)(f->buddy));
+/** @brief Forgets every mark made by fm_compact_mark
+ *  @param fm The frame manager
+ *  @return Void
+ */
+void fm_compact_clear(frame_manager_t *fm){
+    if (fm == NULL) return;
+    uint32_t words = (fm->num_frames + 31) / 32;
+    memset(fm->seen, 0, words * sizeof(uint32_t));
+    memset(fm->pinned, 0, words * sizeof(uint32_t));
 }
 
+/** @brief Marks a frame as mapped once more
+ *
+ *  A frame marked exactly once (and referenced once) is taken to be movable
+ *  by fm_compact_begin. Only the compacting thread may mark frames.
+ *
+ *  @param fm The frame manager
+ *  @param p_addr The physical address of the frame
+ *  @return Void
+ */
+void fm_compact_mark(frame_manager_t *fm, uint32_t p_addr){
+    if (fm == NULL || p_addr < USER_MEM_START
+            || FRAME_INDEX(p_addr) >= fm->num_frames) return;
+    uint32_t idx = FRAME_INDEX(p_addr);
+    uint32_t bit = 1 << (idx % 32);
+    if (fm->seen[idx / 32] & bit) fm->pinned[idx / 32] |= bit;
+    fm->seen[idx / 32] |= bit;
+}
+
+/** @brief Counts the frames that have to move to empty an aligned range
+ *
+ *  Must be called with the frame manager's mutex held.
+ *
+ *  @param fm The frame manager
+ *  @param base The index of the first frame of the range
+ *  @param order The range has 2^order frames
+ *  @return The number of frames to move, negative integer code if the range
+ *          cannot be emptied
+ */
+int compact_cost(frame_manager_t *fm, uint32_t base, uint32_t order){
+    uint32_t k, idx = base, cost = 0;
+    while (idx < base + TWO_POW(order)){
+        frame_t *frame = &fm->frames[idx];
+        /* the range must be made of whole blocks */
+        if (frame->status == FRAME_NONE || frame->order > order) return -1;
+        if (frame->status == FRAME_ALLOC){
+            for (k = idx; k < idx + TWO_POW(frame->order); k++){
+                if (fm->frames[k].refcount == 0) continue;
+                if (fm->frames[k].refcount > 1 || !MARKED_ONCE(fm, k))
+                    return -2;
+                cost++;
+            }
+        }
+        idx += TWO_POW(frame->order);
+    }
+    return cost;
+}
+
+/** @brief Picks the aligned range of 2^order frames that is cheapest to
+ *         empty and holds back its free frames
+ *
+ *  Until fm_compact_end, every frame of the range that is free or gets freed
+ *  is held back instead of being handed out, so frames allocated meanwhile
+ *  always lie outside of the range.
+ *
+ *  @param fm The frame manager
+ *  @param order The range has 2^order frames
+ *  @param p_addr Where to store the address of the range
+ *  @return The number of frames to move out of the range, negative integer
+ *          code if no range can be emptied
+ */
+int fm_compact_begin(frame_manager_t *fm, uint32_t order, uint32_t *p_addr){
+    if (fm == NULL || p_addr == NULL || order >= fm->num_bins) return -1;
+    uint32_t base, best = FRAME_NIL, best_cost = FRAME_NIL;
+    mutex_lock(&fm->m);
+    /* cached single frames would otherwise look allocated */
+    magazine_drain(fm, &fm->mag, FM_MAGAZINE_SIZE);
+    magazine_drain(fm, &fm->clean, FM_CLEAN_SIZE);
+    for (base = 0; base + TWO_POW(order) <= fm->num_frames;
+            base += TWO_POW(order)){
+        int cost = compact_cost(fm, base, order);
+        if (cost >= 0 && (uint32_t)cost < best_cost){
+            best = base;
+            best_cost = cost;
+        }
+    }
+    if (best == FRAME_NIL){
+        mutex_unlock(&fm->m);
+        return -2;
+    }
+    uint32_t eflags = magazine_lock();
+    fm->compact_lo = best;
+    fm->compact_hi = best + TWO_POW(order);
+    magazine_unlock(eflags);
+    /* frames of the range may have been cached since */
+    magazine_drain(fm, &fm->mag, FM_MAGAZINE_SIZE);
+    magazine_drain(fm, &fm->clean, FM_CLEAN_SIZE);
+    uint32_t idx = best;
+    while (idx < fm->compact_hi){
+        frame_t *frame = &fm->frames[idx];
+        if (frame->status == FRAME_DEALLOC){
+            free_list_remove(fm, idx);
+            frame->status = FRAME_RESERVED;
+        }
+        idx += TWO_POW(frame->order);
+    }
+    mutex_unlock(&fm->m);
+    *p_addr = FRAME_ADDR(best);
+    return best_cost;
+}
+
+/** @brief Ends a compaction, freeing every frame of its range that was held
+ *         back so that they coalesce
+ *  @param fm The frame manager
+ *  @return Void
+ */
+void fm_compact_end(frame_manager_t *fm){
+    if (fm == NULL) return;
+    mutex_lock(&fm->m);
+    uint32_t idx = fm->compact_lo, hi = fm->compact_hi;
+    uint32_t eflags = magazine_lock();
+    fm->compact_lo = 0;
+    fm->compact_hi = 0;
+    magazine_unlock(eflags);
+    while (idx < hi){
+        frame_t *frame = &fm->frames[idx];
+        uint32_t next = idx + TWO_POW(frame->order);
+        if (frame->status == FRAME_RESERVED){
+            frame->status = FRAME_ALLOC;
+            release_frame(fm, idx);
+        }
+        idx = next;
+    }
+    mutex_unlock(&fm->m);
+}
+
+/* Debugging purposes only */
+
 void fm_print(frame_manager_t *fm){
     if (fm == NULL) return;
     int i;
+    lprintf("******** MAGAZINE %d cached, %d hits, %d misses ********",
+            (unsigned int)fm->mag.count, (unsigned int)fm->mag.hits,
+            (unsigned int)fm->mag.misses);
+    lprintf("******** CLEAN %d cached, %d hits, %d misses ********",
+            (unsigned int)fm->clean.count, (unsigned int)fm->clean.hits,
+            (unsigned int)fm->clean.misses);
     for (i = 0; i < fm->num_bins; i++){
-        lprintf("******** BIN %d ********", i);
-        ll_foreach(fm->frame_bins[i], &frame_print);
+        lprintf("******** BIN %d (%d free) ********", i,
+                (unsigned int)fm->num_free[i]);
+        uint32_t idx = fm->free_lists[i];
+        while (idx != FRAME_NIL){
+            lprintf("(%d)%d: [%p, %p)", i, TWO_POW(i), (void *)FRAME_ADDR(idx),
+                    (void *)FRAME_ADDR(idx + TWO_POW(i)));
+            idx = fm->frames[idx].next;
+        }
     }
 }
@@ -0,0 +1,190 @@
+/** @file frame_set.c
+ *  @brief Implements the set of frames owned by an address space
+ *
+ *  A page directory remembers every frame it was given so that it can give
+ *  them back when the process exits. Frames are handed out in runs of
+ *  physically contiguous frames, and runs never overlap, so like the areas of
+ *  an address space (see vm_area.c) we keep them in an array sorted by
+ *  address. Finding the run that holds a frame is a binary search for the
+ *  first run that ends at or after it, so releasing frames costs O(log n) in
+ *  the number of runs instead of a scan of every run. A run that is added
+ *  right next to another is merged into it, so the set stays short when a
+ *  process gets frames that happen to be contiguous, e.g. one at a time
+ *  from a buddy allocator that splits a block in order.
+ *
+ *  A range of frames may be released no matter how it lines up with the
+ *  runs, as long as every frame of it is in the set. The runs it covers are
+ *  replaced by whatever is left of the first and the last of them, so
+ *  releasing a whole range is one search and one shift of the runs after it.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <frame_set.h>
+
+/** @brief Finds the first run of a set that ends at or after an address
+ *  @param set The set
+ *  @param p_addr The address
+ *  @return The index of the run, or the size of the set if there is none
+ */
+uint32_t frame_set_lower_bound(frame_set_t *set, uint32_t p_addr){
+    uint32_t low = 0, high = set->size;
+    while (low < high){
+        uint32_t mid = low + (high - low) / 2;
+        if (FRAME_RUN_LAST(&set->runs[mid]) < p_addr){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/** @brief Initializes an empty set of frames
+ *  @param set The set
+ *  @return 0 on success, negative integer code on failure
+ */
+int frame_set_init(frame_set_t *set){
+    if (set == NULL) return -1;
+    set->runs = malloc(FRAME_SET_INIT_CAP * sizeof(frame_run_t));
+    if (set->runs == NULL) return -2;
+    set->size = 0;
+    set->cap = FRAME_SET_INIT_CAP;
+    return 0;
+}
+
+/** @brief Makes room for num_runs more runs in a set
+ *
+ *  Inserting that many runs afterwards never has to allocate.
+ *
+ *  @param set The set
+ *  @param num_runs The number of runs to make room for
+ *  @return 0 on success, negative integer code on failure
+ */
+int frame_set_reserve(frame_set_t *set, uint32_t num_runs){
+    if (set == NULL) return -1;
+    if (set->size + num_runs <= set->cap) return 0;
+    uint32_t cap = set->cap;
+    while (cap < set->size + num_runs) cap *= 2;
+    frame_run_t *runs = realloc(set->runs, cap * sizeof(frame_run_t));
+    if (runs == NULL) return -2;
+    set->runs = runs;
+    set->cap = cap;
+    return 0;
+}
+
+/** @brief Adds a run of frames to a set
+ *
+ *  The run is merged into the runs right before and after it if it touches
+ *  them.
+ *
+ *  @param set The set
+ *  @param p_addr The base address of the run
+ *  @param num_pages The number of frames of the run
+ *  @return 0 on success, negative integer code on failure or if the run
+ *          overlaps one already in the set
+ */
+int frame_set_insert(frame_set_t *set, uint32_t p_addr, uint32_t num_pages){
+    if (set == NULL || num_pages == 0) return -1;
+    frame_run_t run;
+    run.p_addr = p_addr;
+    run.num_pages = num_pages;
+    /* the run may not wrap around the address space */
+    if (FRAME_RUN_LAST(&run) < p_addr) return -2;
+    uint32_t i = frame_set_lower_bound(set, p_addr);
+    if (i < set->size && set->runs[i].p_addr <= FRAME_RUN_LAST(&run))
+        return -3;
+    bool after_prev = (i > 0 && FRAME_RUN_LAST(&set->runs[i-1]) + 1 == p_addr);
+    bool before_next = (i < set->size
+            && set->runs[i].p_addr == FRAME_RUN_LAST(&run) + 1);
+    if (after_prev){
+        frame_run_t *prev = &set->runs[i-1];
+        prev->num_pages += num_pages;
+        if (before_next){
+            /* the run fills the gap between two runs */
+            prev->num_pages += set->runs[i].num_pages;
+            set->size--;
+            memmove(&set->runs[i], &set->runs[i+1],
+                    (set->size - i) * sizeof(frame_run_t));
+        }
+        return 0;
+    }
+    if (before_next){
+        set->runs[i].p_addr = p_addr;
+        set->runs[i].num_pages += num_pages;
+        return 0;
+    }
+    if (frame_set_reserve(set, 1) < 0) return -4;
+    memmove(&set->runs[i+1], &set->runs[i],
+            (set->size - i) * sizeof(frame_run_t));
+    set->runs[i] = run;
+    set->size++;
+    return 0;
+}
+
+/** @brief Removes a range of frames from a set
+ *
+ *  The range may span several runs that follow each other without a gap.
+ *  Nothing is removed unless every frame of the range is in the set.
+ *
+ *  @param set The set
+ *  @param p_addr The base address of the range
+ *  @param num_pages The number of frames of the range
+ *  @return 0 on success, negative integer code on failure
+ */
+int frame_set_remove(frame_set_t *set, uint32_t p_addr, uint32_t num_pages){
+    if (set == NULL || num_pages == 0) return -1;
+    uint32_t last = p_addr + (num_pages * PAGE_SIZE - 1);
+    if (last < p_addr) return -1;
+    uint32_t i = frame_set_lower_bound(set, p_addr), j = i;
+    if (i == set->size || set->runs[i].p_addr > p_addr) return -2;
+    /* find the last run the range covers */
+    while (FRAME_RUN_LAST(&set->runs[j]) < last){
+        if (j + 1 == set->size
+                || set->runs[j+1].p_addr != FRAME_RUN_LAST(&set->runs[j]) + 1)
+            return -2;
+        j++;
+    }
+    /* keep what is left of the first and the last run */
+    frame_run_t head = set->runs[i], tail = set->runs[j];
+    head.num_pages = (p_addr - head.p_addr) / PAGE_SIZE;
+    tail.num_pages = (FRAME_RUN_LAST(&tail) - last) / PAGE_SIZE;
+    tail.p_addr = last + 1;
+    uint32_t keep = (head.num_pages > 0) + (tail.num_pages > 0);
+    uint32_t drop = j - i + 1;
+    /* only splitting a run in two needs more room */
+    if (keep > drop && frame_set_reserve(set, keep - drop) < 0) return -3;
+    memmove(&set->runs[i+keep], &set->runs[j+1],
+            (set->size - (j + 1)) * sizeof(frame_run_t));
+    set->size = set->size + keep - drop;
+    if (head.num_pages > 0) set->runs[i++] = head;
+    if (tail.num_pages > 0) set->runs[i] = tail;
+    return 0;
+}
+
+/** @brief Removes every run from a set
+ *  @param set The set
+ *  @return Void
+ */
+void frame_set_clear(frame_set_t *set){
+    if (set == NULL) return;
+    set->size = 0;
+}
+
+/** @brief Destroys a set of frames
+ *  @param set The set
+ *  @return Void
+ */
+void frame_set_destroy(frame_set_t *set){
+    if (set == NULL) return;
+    free(set->runs);
+    set->runs = NULL;
+    set->size = 0;
+    set->cap = 0;
+}
@@ -10,6 +10,8 @@
  *  @bug No known bugs.
  */
 #include <stdlib.h>
+/* PAGE_SIZE */
+#include <x86/page.h>
 
 #include <mem_section.h>
 
@@ -87,3 +89,44 @@ int ms_get_bounding_section(mem_section_t *secs, uint32_t num_secs,
     return 1;
 }
 
+/** @brief Finds the pages that a section of an array overlaps which no
+ *         earlier section of the array overlaps
+ *
+ *  Sections may only share the pages at their ends, so going through an
+ *  array this way visits every page that the sections overlap exactly once.
+ *
+ *  @param secs The array of memory sections
+ *  @param num_secs The length of secs
+ *  @param i The index of the section
+ *  @param first Where the address of the first page is stored
+ *  @param num_pages Where the number of pages is stored, which may be 0
+ *  @return 0 on success, -1 on invalid input */
+int ms_get_own_pages(mem_section_t *secs, uint32_t num_secs, uint32_t i,
+        uint32_t *first, uint32_t *num_pages){
+    if (secs == NULL || i >= num_secs || first == NULL || num_pages == NULL)
+        return -1;
+    *num_pages = 0;
+    if (secs[i].len == 0) return 0;
+    uint32_t low = secs[i].v_addr_start & ~(PAGE_SIZE-1);
+    uint32_t high = (secs[i].v_addr_start + (secs[i].len - 1))
+        & ~(PAGE_SIZE-1);
+    uint32_t n = (high - low) / PAGE_SIZE + 1;
+    int j;
+    for (j = 0; j < i; j++){
+        if (secs[j].len == 0) continue;
+        uint32_t j_low = secs[j].v_addr_start & ~(PAGE_SIZE-1);
+        uint32_t j_high = (secs[j].v_addr_start + (secs[j].len - 1))
+            & ~(PAGE_SIZE-1);
+        if (n > 0 && j_low <= low && low <= j_high){
+            low += PAGE_SIZE;
+            n--;
+        }
+        if (n > 0 && j_low <= high && high <= j_high){
+            high -= PAGE_SIZE;
+            n--;
+        }
+    }
+    *first = low;
+    *num_pages = n;
+    return 0;
+}
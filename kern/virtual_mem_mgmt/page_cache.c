@@ -0,0 +1,161 @@
+/** @file page_cache.c
+ *  @brief Implements a cache of read only executable pages
+ *
+ *  Read only pages of a program's image are the same for every process
+ *  running that program, so the first process to page one in leaves its frame
+ *  in the page cache and every later process maps that same frame. The same
+ *  goes for RAM disk files mapped with map_file.
+ *
+ *  A page is identified by the file backed area that it was paged in from
+ *  (whose bytes live in the RAM disk forever) and its offset from the start of
+ *  that area, so a file shares its pages wherever it is mapped. The
+ *  cache holds no reference on its frames. Each process that maps a cached
+ *  frame holds a reference through the frame manager, and the page is
+ *  forgotten when the last of them drops its reference through pc_unref.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <x86/page.h>
+
+#include <page_cache.h>
+#include <kern_internals.h>
+
+/** @brief defines a cached page */
+typedef struct pc_entry {
+    /** @brief the file bytes of the area the page was paged in from */
+    const char *src;
+    /** @brief the offset of the page from the start of its area */
+    uint32_t pos;
+    /** @brief the frame holding the page */
+    uint32_t p_addr;
+} pc_entry_t;
+
+/** @brief Computes the key of a page in the by_pos table
+ *  @param src The file bytes of the area the page belongs to
+ *  @param pos The offset of the page from the start of the area
+ *  @return The key
+ */
+key_t pos_key(const char *src, uint32_t pos){
+    return (key_t)((uint32_t)src ^ pos);
+}
+
+/** @brief Hashes a key of either table
+ *  @param key The key
+ *  @return A non negative hash
+ */
+int pc_hash(key_t key){
+    uint32_t k = (uint32_t)key;
+    return (int)((k ^ (k >> PAGE_SHIFT)) & 0x7FFFFFFF);
+}
+
+/** @brief Initializes a page cache
+ *  @param pc The page cache
+ *  @return 0 on success, negative integer code on failure
+ */
+int pc_init(page_cache_t *pc){
+    if (pc == NULL) return -1;
+    if (mutex_init(&pc->m) < 0) return -2;
+    if (ht_init(&pc->by_pos, PC_TABLE_SIZE, pc_hash) < 0) return -3;
+    if (ht_init(&pc->by_frame, PC_TABLE_SIZE, pc_hash) < 0){
+        ht_destroy(&pc->by_pos);
+        return -4;
+    }
+    pc->hits = 0;
+    pc->misses = 0;
+    return 0;
+}
+
+/** @brief Looks up a page and takes a reference on its frame
+ *  @param pc The page cache
+ *  @param src The file bytes of the area the page belongs to
+ *  @param pos The offset of the page from the start of the area
+ *  @param p_addr Where to store the frame of the page
+ *  @return 0 on success, negative integer code if the page is not cached
+ */
+int pc_get(page_cache_t *pc, const char *src, uint32_t pos,
+        uint32_t *p_addr){
+    if (pc == NULL || p_addr == NULL) return -1;
+    pc_entry_t *e;
+    mutex_lock(&pc->m);
+    if (ht_get(&pc->by_pos, pos_key(src, pos), (void **)&e) < 0
+            || e->src != src || e->pos != pos
+            || fm_ref(&fm, e->p_addr, 1) < 0){
+        pc->misses++;
+        mutex_unlock(&pc->m);
+        return -2;
+    }
+    pc->hits++;
+    *p_addr = e->p_addr;
+    mutex_unlock(&pc->m);
+    return 0;
+}
+
+/** @brief Adds a page to the cache
+ *
+ *  The caller must hold a reference on the frame. The page is not added if
+ *  another frame already holds it.
+ *
+ *  @param pc The page cache
+ *  @param src The file bytes of the area the page belongs to
+ *  @param pos The offset of the page from the start of the area
+ *  @param p_addr The frame holding the page
+ *  @return 0 on success, negative integer code on failure
+ */
+int pc_put(page_cache_t *pc, const char *src, uint32_t pos,
+        uint32_t p_addr){
+    if (pc == NULL) return -1;
+    pc_entry_t *e = malloc(sizeof(pc_entry_t));
+    if (e == NULL) return -2;
+    e->src = src;
+    e->pos = pos;
+    e->p_addr = p_addr;
+    mutex_lock(&pc->m);
+    if (ht_put(&pc->by_pos, pos_key(src, pos), e) < 0){
+        mutex_unlock(&pc->m);
+        free(e);
+        return -3;
+    }
+    if (ht_put(&pc->by_frame, (key_t)p_addr, e) < 0){
+        ht_remove(&pc->by_pos, pos_key(src, pos), NULL, NULL);
+        mutex_unlock(&pc->m);
+        free(e);
+        return -4;
+    }
+    mutex_unlock(&pc->m);
+    return 0;
+}
+
+/** @brief Drops a reference on frames that may be in the cache
+ *
+ *  Use in place of fm_unref for frames of a file backed area. A cached
+ *  page is forgotten when its last reference is dropped.
+ *
+ *  @param pc The page cache
+ *  @param p_addr The base address of the frames
+ *  @param num_pages The number of frames
+ *  @return 0 on success, negative integer code on failure
+ */
+int pc_unref(page_cache_t *pc, uint32_t p_addr, uint32_t num_pages){
+    if (pc == NULL) return -1;
+    pc_entry_t *e;
+    uint32_t i, addr = p_addr;
+    mutex_lock(&pc->m);
+    /* the frames may have been released together with neighbouring frames,
+     * any of which may be cached */
+    for (i = 0; i < num_pages && pc->by_frame.size > 0;
+            i++, addr += PAGE_SIZE){
+        if (fm_refcount(&fm, addr) == 1
+                && ht_remove(&pc->by_frame, (key_t)addr, (void **)&e,
+                    NULL) == 0){
+            ht_remove(&pc->by_pos, pos_key(e->src, e->pos), NULL, NULL);
+            free(e);
+        }
+    }
+    int ret = fm_unref(&fm, p_addr, num_pages);
+    mutex_unlock(&pc->m);
+    return ret;
+}
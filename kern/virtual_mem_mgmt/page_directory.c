@@ -8,10 +8,38 @@
  *  updated along side the page directory whenever a frame is allocated on
  *  behalf of the page directory.
  *
- *  In addition to the usual page directory interface, we have implemented a way
- *  to essentially commit multiple mappings if all of them succeed or none at
- *  all. This allows for ease of error handling when looping through a bunch of
- *  pd_create/remove_mapping calls.
+ *  Page directories and page tables come from the kernel's page table pool
+ *  (see pt_pool.c) rather than straight from the kernel heap. Each page
+ *  directory counts the present entries of each of its user page tables, and
+ *  a table goes back to the pool as soon as its last entry is removed, so the
+ *  page tables a process holds follow what it has mapped.
+ *
+ *  Ranges of pages are mapped with pd_map_range, which maps either every page
+ *  of the range or none at all. It checks the whole range and allocates any
+ *  page tables the range needs up front, so that once it starts writing page
+ *  table entries nothing can fail, and it never allocates anything per page.
+ *
+ *  Page directories may also share frames copy-on-write. pd_cow_copy gives the
+ *  destination its own page tables which point at the same frames as the
+ *  source, and write protects every writable page in both directories by
+ *  marking it with our custom copy-on-write flag. The first write to such a
+ *  page faults and is resolved by pd_break_cow which either copies the page
+ *  into a new frame or, if no one else references the frame anymore, simply
+ *  makes it writable again.
+ *
+ *  Where paging allows it, a single page directory entry maps a whole 4MB
+ *  large page instead of pointing at a page table. The kernel's direct map is
+ *  made of global large pages apart from the first 4MB, which leaves the 0th
+ *  page unmapped, and the 4MB holding the copy window. User memory may also be
+ *  mapped with large pages (see vmm_page_in). Those are split back into page
+ *  tables before anything needs to look at their pages individually, such as
+ *  a copy of the directory.
+ *
+ *  A page directory also holds the set of areas of user memory that its pages
+ *  belong to (see vm_area.c). Pages of an area need not be mapped until they
+ *  are touched, at which point the page fault handler maps a frame and, for
+ *  file backed areas, fills it in with pd_fill_file_page. Copies only walk the
+ *  pages of the areas rather than every entry of every page table.
  *
  *  @author Aatish Nayak (aatishn)
  *  @author Christopher Wei (cjwei)
@@ -30,9 +58,14 @@
 #include <constants.h>
 
 #include <page_directory.h>
+/* ptpool */
+#include <kern_internals.h>
 
 /* access to flush_tlb */
 #include <special_reg_cntrl.h>
+/* disable_interrupts, get_eflags */
+#include <x86/asm.h>
+#include <x86/eflags.h>
 #include <simics.h>
 
 /** @brief gets the [n]th bit of [v] */
@@ -48,17 +81,8 @@
 #define PDE_SHIFT 10
 /** @brief number of bits for the page table offset */
 #define PTE_SHIFT 10
-
-/** @brief Holds a single mapping task to be completed by the page directory
- *         upon pd_commit_mapping or freed upon pd_abort_mapping */
-typedef struct mapping_task{
-    /** @brief Virtual address to map */
-    uint32_t v_addr;
-    /** @brief Page table entry to map */
-    uint32_t pte;
-    /** @brief A resource to free upon failure */
-    void *resource;
-} mapping_task_t;
+/** @brief index of the page directory entry of a virtual address */
+#define PDE_INDEX(v) ((uint32_t)(v) >> (OFF_SHIFT + PTE_SHIFT))
 
 /* @brief Global variable that stores the kernel page directory entries. We can
  * use the same page tables for the kernel in all page directories that are
@@ -68,6 +92,35 @@ uint32_t kernel_pde[NUM_KERNEL_PDE];
 /* @brief Whether or not the kernel has been initialized or not */
 bool is_kernel_initialized = false;
 
+/** @brief Window slot that the frame being copied from is mapped to */
+#define WINDOW_SRC 0
+/** @brief Window slot that the frame being copied or zeroed is mapped to */
+#define WINDOW_DST 1
+/** @brief Number of slots in a copy window */
+#define WINDOW_SLOTS 2
+
+/** @brief Defines reserved kernel virtual pages that arbitrary frames can be
+ * mapped to so that they can be copied and zeroed directly */
+typedef struct copy_window {
+    /** @brief the first virtual page of the window */
+    char *base;
+    /** @brief the kernel page table entries backing each slot */
+    uint32_t *ptes[WINDOW_SLOTS];
+} copy_window_t;
+
+/* @brief The kernel's copy window, one per cpu (we only run on one) */
+copy_window_t window = { NULL, { NULL, NULL } };
+
+/* @brief Every page directory made by pd_init, so that memory compaction can
+ * find the page table entries pointing at a frame */
+ll_t pd_registry;
+/* @brief Serializes changes to pd_registry with walks over it */
+mutex_t pd_registry_lock;
+
+/* @brief Frame of zeroes shared read only by every untouched demand-zero
+ * page. It comes from kernel memory so the frame manager never sees it */
+void *zero_page = NULL;
+
 /* Helper functions */
 
 /** @brief Finds from a pte or pde whether that entry is present
@@ -104,26 +157,106 @@ int pd_init_kernel(){
      * to the global variable kernel_pde */
     page_directory_t pd_temp;
     pd_temp.directory = kernel_pde;
-    pd_temp.batch_enabled = false;
+    /* kernel page tables are never freed, so they are not counted */
+    pd_temp.pt_live = NULL;
 
     /* present, rw enabled, supervisor mode, dont flush */
     uint32_t pte_flags = NEW_FLAGS(SET,SET,UNSET,SET);
     /* present, rw enabled, supervisor mode */
     uint32_t pde_flags = NEW_FLAGS(SET,SET,UNSET,DONT_CARE);
     uint32_t i;
+    /* steal direct mapped pages to use as a window onto other frames, aligned
+     * so that they share a page table */
+    window.base = memalign(WINDOW_SLOTS * PAGE_SIZE, WINDOW_SLOTS * PAGE_SIZE);
+    if (window.base == NULL) return -2;
+    uint32_t window_pde = PDE_INDEX(window.base);
+
     /* for the first num_kernel_entries, set the vpn==ppn for direct map */
-    /* Leave 0th page unmapped */
-    for (i = 1; i < NUM_KERNEL_PTE; i++){
-        uint32_t direct_addr = i << PAGE_SHIFT;
-        if (pd_create_mapping(&pd_temp, direct_addr, direct_addr,
+    for (i = 0; i < NUM_KERNEL_PDE; i++){
+        uint32_t v = i * LARGE_PAGE_SIZE;
+        if (i != 0 && i != window_pde){
+            if (pd_map_large(&pd_temp, v, v, pte_flags) < 0) return -1;
+            continue;
+        }
+        /* Leave 0th page unmapped, and give the window entries of its own */
+        uint32_t first = (i == 0) ? PAGE_SIZE : v;
+        if (pd_map_range(&pd_temp, first,
+                    (v + LARGE_PAGE_SIZE - first) / PAGE_SIZE, first, NULL,
                     pte_flags, pde_flags) < 0){
             return -1;
         }
     }
+    for (i = 0; i < WINDOW_SLOTS; i++){
+        uint32_t w = (uint32_t)window.base + i * PAGE_SIZE;
+        uint32_t *pt =
+            (uint32_t *)REMOVE_FLAGS(kernel_pde[w >> (OFF_SHIFT+PTE_SHIFT)]);
+        window.ptes[i] = &pt[(w >> OFF_SHIFT) & (PT_NUM_ENTRIES-1)];
+    }
+
+    if ((zero_page = memalign(PAGE_SIZE, PAGE_SIZE)) == NULL) return -3;
+    memset(zero_page, 0, PAGE_SIZE);
+    if (ll_init(&pd_registry) < 0 || mutex_init(&pd_registry_lock) < 0)
+        return -4;
     is_kernel_initialized = true;
     return 0;
 }
 
+/** @brief Points a slot of the copy window at a frame
+ *
+ *  Must be called with interrupts disabled, the slot stays valid until they
+ *  are enabled again. The previous mapping is not restored since nothing but
+ *  the window uses these pages, so a single invlpg suffices.
+ *
+ *  @param slot The window slot
+ *  @param p_addr The physical address of the frame
+ *  @return The virtual address the frame is mapped at
+ */
+void *window_map(int slot, uint32_t p_addr){
+    /* present, rw enabled, supervisor mode, not global */
+    *window.ptes[slot] = ADD_FLAGS(p_addr, NEW_FLAGS(SET,SET,UNSET,UNSET));
+    void *v_addr = window.base + slot * PAGE_SIZE;
+    flush_tlb((uint32_t)v_addr);
+    return v_addr;
+}
+
+/** @brief Zeroes a physical frame that need not be mapped anywhere
+ *  @param p_addr The physical address of the frame
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_zero_frame(uint32_t p_addr){
+    if (window.base == NULL || !IS_PAGE_ALIGNED(p_addr)) return -1;
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    memset(window_map(WINDOW_DST, p_addr), 0, PAGE_SIZE);
+    if (eflags & EFL_IF) enable_interrupts();
+    return 0;
+}
+
+/** @brief Copies one physical frame into another, neither of which need be
+ *         mapped anywhere
+ *  @param dest The physical address of the frame to copy to
+ *  @param src The physical address of the frame to copy from
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_copy_frame(uint32_t dest, uint32_t src){
+    if (window.base == NULL || !IS_PAGE_ALIGNED(dest)
+            || !IS_PAGE_ALIGNED(src)) return -1;
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    memcpy(window_map(WINDOW_DST, dest), window_map(WINDOW_SRC, src),
+            PAGE_SIZE);
+    if (eflags & EFL_IF) enable_interrupts();
+    return 0;
+}
+
+/** @brief Gets the frame shared by every demand-zero page that has not been
+ *         written to yet
+ *  @return The physical address of the zero frame
+ */
+uint32_t pd_get_zero_frame(void){
+    return (uint32_t)zero_page;
+}
+
 /** @brief Initializes the kernel mappings of a page directory
  *  @param pd The page directory
  *  @return 0 on success -1 on failure
@@ -138,90 +271,110 @@ int initialize_kernel(page_directory_t *pd){
     return 0;
 }
 
-/** @brief Gets the address of a page given its page table and page directory
- *         indexes
- *  @param pd_i The page directory index
- *  @param pt_i The page table index
- *  @return The page's address
+/** @brief Finds the page table entry of a virtual address
+ *  @param pd The page directory
+ *  @param v_addr The virtual address
+ *  @return The address of the entry, or NULL if its page table is not present
+ *          or v_addr lies in a large page
+ */
+uint32_t *get_pte(page_directory_t *pd, uint32_t v_addr){
+    uint32_t pde = pd->directory[(v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF];
+    if (!entry_present(pde) || IS_LARGE(pde)) return NULL;
+    return &((uint32_t *)REMOVE_FLAGS(pde))[(v_addr >> OFF_SHIFT) & 0x3FF];
+}
+
+/** @brief Counts a new present entry in the page table of a virtual address
+ *  @param pd The page directory
+ *  @param v_addr The virtual address that was mapped
+ *  @return Void
  */
-void *get_page_address(uint32_t pd_i, uint32_t pt_i){
-    return (void *)(pd_i << 22 | pt_i << 12);
+void pt_entry_added(page_directory_t *pd, uint32_t v_addr){
+    if (pd->pt_live != NULL) pd->pt_live[PDE_INDEX(v_addr)]++;
 }
 
-/** @brief Copies contents stored in a page referenced by a virtual address
- *  in the current page directory into the physical address
- *
- *  Slightly hacky. We use the current page directory to copy the contents
- *  stored at virtual address v_addr into a local buffer. Then we update the
- *  mapping so that it points at the new physical address we want to copy into.
- *  Then we memcpy the local buffer into the new physical address, restore the
- *  old mapping and flush tlb.
- *
- *  @param target_pte Pointer to the page table entry that hold the physical
- *  address to copy from
- *  @param v_addr The virtual address represented by target_pte
- *  @param p_addr The new physical address to copy to
- *  @return 0 on success or negative integer code on failure
+/** @brief Uncounts a present entry of the page table of a virtual address,
+ *         freeing the table if it was the last one
+ *  @param pd The page directory
+ *  @param v_addr The virtual address that was unmapped
+ *  @return Void
  */
-int p_copy(void **target_pte, void *v_addr, void *p_addr){
-    if (target_pte == NULL || v_addr == NULL)
-        return -1;
-    /* allocate a new buffer to hold our page contents locally */
-    void *buffer = malloc(PAGE_SIZE);
-    if (buffer == NULL) return -2;
-    /* original page table entry */
-    void *original_pte = *target_pte;
-    uint32_t flags = EXTRACT_FLAGS(original_pte);
-    /* target virtual address */
-    memcpy(buffer, v_addr, PAGE_SIZE);
-    /* remap our virtual address to new physical address */
-    *target_pte = (void *)(ADD_FLAGS(p_addr,flags));
-    /* flush cached mappings for our virtual address */
-    flush_tlb((uint32_t)v_addr);
-    /* copy contents into new phys page */
-    memcpy(v_addr, buffer, PAGE_SIZE);
-    /* restore mapping */
-    *target_pte = original_pte;
-    /* flush out any false mappings */
-    flush_tlb((uint32_t)v_addr);
-    free(buffer);
+void pt_entry_removed(page_directory_t *pd, uint32_t v_addr){
+    if (pd->pt_live == NULL) return;
+    uint32_t pde_i = PDE_INDEX(v_addr);
+    if (--pd->pt_live[pde_i] > 0) return;
+    uint32_t pt = REMOVE_FLAGS(pd->directory[pde_i]);
+    pd->directory[pde_i] = 0;
+    /* invlpg also drops any directory entry cached for the table */
+    flush_tlb(v_addr);
+    /* every entry of the table is empty again */
+    ptp_free(&ptpool, (void *)pt, true);
+}
+
+/** @brief Frees every user space page table of a page directory
+ *  @param pd The page directory
+ *  @return Void
+ */
+void free_user_tables(page_directory_t *pd){
+    int i;
+    for (i = NUM_KERNEL_PDE; i < PD_NUM_ENTRIES; i++) {
+        uint32_t entry = pd->directory[i];
+        if (entry_present(entry)){
+            pd->directory[i] = 0;
+            /* the frames of large pages belong to the frame list */
+            if (!IS_LARGE(entry))
+                ptp_free(&ptpool, (void *)REMOVE_FLAGS(entry), false);
+        }
+        if (pd->pt_live != NULL) pd->pt_live[i] = 0;
+    }
+}
+
+/** @brief Splits every large page in the user space of a page directory
+ *  @param pd The page directory
+ *  @return 0 on success, negative integer code on failure
+ */
+int split_large_pages(page_directory_t *pd){
+    uint32_t i;
+    for (i = NUM_KERNEL_PDE; i < PD_NUM_ENTRIES; i++){
+        uint32_t entry = pd->directory[i];
+        if (entry_present(entry) && IS_LARGE(entry)
+                && pd_split_large(pd, i * LARGE_PAGE_SIZE) < 0){
+            return -1;
+        }
+    }
     return 0;
 }
 
-/** @brief Copies a page table from pt_src to pt_dest
+/** @brief Gives pd_dest an empty page table in place of every page table of
+ *         pd_src that backs one of pd_src's areas
+ *
+ *  pd_dest is expected to have no user space page tables. On failure it is
+ *  left with none.
  *
- *  @param pt_dest The page table to copy into
- *  @param pt_src The page table to copy from
- *  @param pd_i The page directory index (used to find the virtual address)
- *  @param p_addr_p Pointer to the physical address which we should update as
- *                  we consume physical pages.
+ *  @param pd_dest The page directory to give page tables to
+ *  @param pd_src The page directory whose page tables are copied
  *  @return 0 on success, negative integer code on failure
  */
-int pt_copy(uint32_t *pt_dest, uint32_t *pt_src, uint32_t pd_i,
-        uint32_t *p_addr_p){
-    uint32_t i;
-    /* copy each page table entry */
-    for (i = 0; i < PT_NUM_ENTRIES; i++){
-        uint32_t entry = pt_src[i];
-        uint32_t flags = entry & 0xFFF;
-        /* copy over present mappings */
-        if (entry_present(entry)){
-            void *p_addr = (void *)(*p_addr_p);
-            *p_addr_p += PAGE_SIZE;
-            /* calculate the virtual address of current page being copied so
-             * that p_copy can *v_addr to write to the new physical address
-             * after remapping*/
-            void *v_addr = get_page_address(pd_i, i);
-            /* pass in address to the current page table entry so that p_copy
-             * can use it to copy into the new physical address */
-            if (p_copy((void **)&(pt_src[i]), v_addr, p_addr) < 0)
+int alloc_area_tables(page_directory_t *pd_dest, page_directory_t *pd_src){
+    uint32_t i, j;
+    for (i = 0; i < pd_src->vmas.size; i++){
+        vma_t *vma = &pd_src->vmas.vmas[i];
+        uint32_t first = vma->start >> (OFF_SHIFT + PTE_SHIFT);
+        uint32_t last = VMA_LAST(vma) >> (OFF_SHIFT + PTE_SHIFT);
+        for (j = first; j <= last; j++){
+            uint32_t entry = pd_src->directory[j];
+            if (!entry_present(entry) || entry_present(pd_dest->directory[j]))
+                continue;
+            uint32_t *new_pt;
+            if (ptp_alloc(&ptpool, (void **)&new_pt) < 0){
+                free_user_tables(pd_dest);
                 return -1;
-            /* assign pte to new physical address with flags */
-            pt_dest[i] = ADD_FLAGS(p_addr, flags);
+            }
+            pd_dest->directory[j] = ADD_FLAGS(new_pt, EXTRACT_FLAGS(entry));
         }
     }
     return 0;
 }
+
 /* Implementation */
 
 /** @brief Finds the mapping of a virtual address if it exists in a page
@@ -237,10 +390,20 @@ int pd_get_mapping(page_directory_t *pd, uint32_t v_addr,
     uint32_t pde_i = (v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF;
     /* page table index = 2nd 10 bits of v_addr */
     uint32_t pte_i = (v_addr >> OFF_SHIFT) & 0x3FF;
-    if (!entry_present(pd->directory[pde_i])){
+    uint32_t pde = pd->directory[pde_i];
+    if (!entry_present(pde)){
         /* page directory entry not present */
         return -2;
     }
+    if (IS_LARGE(pde)){
+        /* make up the entry of the 4KB page of the large page */
+        if (entry_addr != NULL){
+            uint32_t frame = REMOVE_LARGE_FLAGS(pde) + pte_i * PAGE_SIZE;
+            *entry_addr = ADD_FLAGS(frame,
+                    (EXTRACT_FLAGS(pde) & ~(SET << PAGE_SIZE_FLAG_BIT)));
+        }
+        return 0;
+    }
     uint32_t *pt = (uint32_t *)(REMOVE_FLAGS(pd->directory[pde_i]));
     if (!entry_present(pt[pte_i])){
         /* directory exists but table does not */
@@ -264,19 +427,21 @@ int pd_get_permissions(page_directory_t *pd, uint32_t v_addr,
         uint32_t *priv, uint32_t *access){
     if (pd == NULL) return -1;
     uint32_t pde_i = (v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF;
-    /* page table index = 2nd 10 bits of v_addr */
-    uint32_t pte_i = (v_addr >> OFF_SHIFT) & 0x3FF;
     if (!entry_present(pd->directory[pde_i])){
         return -2;
     }
-    uint32_t *pt = (uint32_t *)(REMOVE_FLAGS(pd->directory[pde_i]));
-    if (!entry_present(pt[pte_i])){
+    /* a large page only has the permissions of its directory entry */
+    uint32_t *pte = IS_LARGE(pd->directory[pde_i]) ?
+        &pd->directory[pde_i] : get_pte(pd, v_addr);
+    if (!entry_present(*pte)){
         return -3;
     }
     uint32_t pd_priv, pd_access, pt_priv, pt_access,
              combined_priv, combined_access;
     entry_permissions(pd->directory[pde_i], &pd_priv, &pd_access);
-    entry_permissions(pt[pte_i], &pt_priv, &pt_access);
+    entry_permissions(*pte, &pt_priv, &pt_access);
+    /* copy-on-write pages become writable on the first write */
+    if (IS_COW(*pte)) pt_access = 1;
     /* combined priv = 1 only if both levels are user */
     combined_priv = pd_priv && pt_priv;
     /* if combined priv = user, both access types must be set
@@ -309,54 +474,231 @@ int pd_is_user_readable(page_directory_t *pd, uint32_t v_addr){
     return (priv == 1);
 }
 
-/** @brief Begins a batch mapping
+/** @brief Frees the page tables that pd_map_range allocated for a range
  *  @param pd The page directory
+ *  @param first_pde The index of the first page directory entry of the range
+ *  @param last_pde The index of the last page directory entry of the range
+ *  @param new_tables Bitmap of the page directory entries that were allocated
+ *  @return Void
+ */
+void free_new_tables(page_directory_t *pd, uint32_t first_pde,
+        uint32_t last_pde, uint32_t *new_tables){
+    uint32_t i;
+    for (i = first_pde; i <= last_pde; i++){
+        /* unmapping may already have freed the table */
+        if ((new_tables[i / 32] & (1 << (i % 32)))
+                && entry_present(pd->directory[i])){
+            /* nothing was left mapped in the table */
+            ptp_free(&ptpool, (void *)REMOVE_FLAGS(pd->directory[i]), true);
+            pd->directory[i] = 0;
+        }
+    }
+}
+
+/** @brief Maps a range of pages with the same flags, either all of them or
+ *         none
+ *
+ *  Requires that v_addr and p_addr are page aligned and that no page of the
+ *  range is mapped already. The pages are mapped to the frames handed out by
+ *  it in order or, if it is NULL, to contiguous frames starting at p_addr.
+ *  Every page table the range needs is allocated before any page is mapped,
+ *  so on failure the page directory is left as it was.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The virtual address of the first page
+ *  @param num_pages The number of pages to map
+ *  @param p_addr The first frame to map to if it is NULL
+ *  @param it Iterator over the frames to map to (optional)
+ *  @param pte_flags The page table entry flags
+ *  @param pde_flags The page directory entry flags (if new page tables are
+ *                   made)
  *  @return 0 on success, negative integer code on failure
  */
-int pd_begin_mapping(page_directory_t *pd){
-    if (pd == NULL || pd->mapping_tasks == NULL) return -1;
-    if (pd->batch_enabled) return -2;
-    pd->batch_enabled = true;
+int pd_map_range(page_directory_t *pd, uint32_t v_addr, uint32_t num_pages,
+        uint32_t p_addr, frame_iter_t *it, uint32_t pte_flags,
+        uint32_t pde_flags){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr) || !IS_PAGE_ALIGNED(p_addr))
+        return -1;
+    if (num_pages == 0) return 0;
+    /* the range may not wrap around the address space */
+    if (num_pages - 1 > (PAGE_ALIGN_DOWN(0xFFFFFFFF) - v_addr) / PAGE_SIZE)
+        return -2;
+    uint32_t last = v_addr + (num_pages - 1) * PAGE_SIZE;
+    uint32_t first_pde = v_addr >> (OFF_SHIFT + PTE_SHIFT);
+    uint32_t last_pde = last >> (OFF_SHIFT + PTE_SHIFT);
+    uint32_t i, v;
+
+    /* the whole range must be unmapped */
+    for (i = 0, v = v_addr; i < num_pages; i++, v += PAGE_SIZE){
+        uint32_t *pte = get_pte(pd, v);
+        if (pte != NULL && entry_present(*pte)) return -3;
+        /* so are the pages of large pages */
+        if (pte == NULL && entry_present(pd->directory[PDE_INDEX(v)]))
+            return -3;
+    }
+
+    /* allocate every missing page table, remembering which ones are new */
+    uint32_t new_tables[PD_NUM_ENTRIES / 32];
+    memset(new_tables, 0, sizeof(new_tables));
+    for (i = first_pde; i <= last_pde; i++){
+        if (entry_present(pd->directory[i])) continue;
+        uint32_t *pt;
+        if (ptp_alloc(&ptpool, (void **)&pt) < 0){
+            free_new_tables(pd, first_pde, last_pde, new_tables);
+            return -4;
+        }
+        pd->directory[i] = ADD_FLAGS(pt, pde_flags);
+        new_tables[i / 32] |= (1 << (i % 32));
+    }
+
+    /* commit the range */
+    for (i = 0, v = v_addr; i < num_pages; i++, v += PAGE_SIZE){
+        uint32_t frame = p_addr + i * PAGE_SIZE;
+        if (it != NULL && fm_iter_next(it, &frame, NULL) < 0){
+            /* ran out of frames, roll back */
+            pd_unmap_range(pd, v_addr, i);
+            free_new_tables(pd, first_pde, last_pde, new_tables);
+            return -5;
+        }
+        *get_pte(pd, v) = ADD_FLAGS(frame, pte_flags);
+        pt_entry_added(pd, v);
+    }
     return 0;
 }
-/** @brief Aborts a batch mapping
+
+/** @brief Unmaps every mapped page of a range of pages
+ *
+ *  Pages of the range that are not mapped are skipped. The frames that were
+ *  mapped are left to the caller. Page tables left empty are freed.
+ *
  *  @param pd The page directory
- *  @return Void
+ *  @param v_addr The page aligned virtual address of the first page
+ *  @param num_pages The number of pages to unmap
+ *  @return 0 on success, negative integer code on failure
  */
-void pd_abort_mapping(page_directory_t *pd){
-    mapping_task_t *task;
-    while (ll_size(pd->mapping_tasks) > 0){
-        ll_remove_first(pd->mapping_tasks, (void **)&task);
-        if (task->resource != NULL) free(task->resource);
-        free(task);
+int pd_unmap_range(page_directory_t *pd, uint32_t v_addr, uint32_t num_pages){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr)) return -1;
+    if (num_pages == 0) return 0;
+    if (num_pages - 1 > (PAGE_ALIGN_DOWN(0xFFFFFFFF) - v_addr) / PAGE_SIZE)
+        return -2;
+    uint32_t i, v;
+    for (i = 0, v = v_addr; i < num_pages; i++, v += PAGE_SIZE){
+        uint32_t *pte = get_pte(pd, v);
+        if (pte == NULL || !entry_present(*pte)) continue;
+        *pte = 0;
+        flush_tlb(v);
+        pt_entry_removed(pd, v);
     }
-    pd->batch_enabled = false;
+    return 0;
 }
-/** @brief Commits a batch mapping
+
+/** @brief Replaces the flags of every mapped page of a range of pages
  *
- *  Requires that no mapping in the page directory's mapping_tasks will fail
+ *  Pages of the range that are not mapped are skipped.
  *
  *  @param pd The page directory
- *  @return Void
+ *  @param v_addr The page aligned virtual address of the first page
+ *  @param num_pages The number of pages
+ *  @param pte_flags The new page table entry flags
+ *  @return 0 on success, negative integer code on failure
  */
-void pd_commit_mapping(page_directory_t *pd){
-    mapping_task_t *task;
-    while (ll_size(pd->mapping_tasks) > 0){
-        ll_remove_first(pd->mapping_tasks, (void **)&task);
-        uint32_t pde_i = (task->v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF;
-        uint32_t pte_i = (task->v_addr >> OFF_SHIFT) & 0x3FF;
-        uint32_t pde_value = pd->directory[pde_i];
-        uint32_t *page_table = (uint32_t *)REMOVE_FLAGS(pde_value);
-        page_table[pte_i] = task->pte;
-        free(task);
+int pd_protect_range(page_directory_t *pd, uint32_t v_addr,
+        uint32_t num_pages, uint32_t pte_flags){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr)) return -1;
+    if (num_pages == 0) return 0;
+    if (num_pages - 1 > (PAGE_ALIGN_DOWN(0xFFFFFFFF) - v_addr) / PAGE_SIZE)
+        return -2;
+    uint32_t i, v;
+    for (i = 0, v = v_addr; i < num_pages; i++, v += PAGE_SIZE){
+        uint32_t *pte = get_pte(pd, v);
+        if (pte == NULL || !entry_present(*pte)) continue;
+        *pte = ADD_FLAGS(REMOVE_FLAGS(*pte), EXTRACT_FLAGS(pte_flags));
+        flush_tlb(v);
     }
-    pd->batch_enabled = false;
+    return 0;
+}
+
+/** @brief Maps a large page with a single page directory entry
+ *
+ *  Requires that v_addr and p_addr are large page aligned and that nothing is
+ *  mapped in the large page yet, not even a page table. The large page is not
+ *  counted in pt_live since it has no page table to free.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The virtual address of the large page
+ *  @param p_addr The physical address of the large frame
+ *  @param flags The page directory entry flags
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_map_large(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr,
+        uint32_t flags){
+    if (pd == NULL || !IS_LARGE_PAGE_ALIGNED(v_addr)
+            || !IS_LARGE_PAGE_ALIGNED(p_addr)) return -1;
+    uint32_t pde_i = PDE_INDEX(v_addr);
+    if (entry_present(pd->directory[pde_i])) return -2;
+    pd->directory[pde_i] =
+        ADD_FLAGS(p_addr, EXTRACT_FLAGS(flags) | (SET << PAGE_SIZE_FLAG_BIT));
+    return 0;
 }
 
+/** @brief Finds the large page containing a virtual address if there is one
+ *  @param pd The page directory
+ *  @param v_addr The virtual address
+ *  @param pde Where to store the page directory entry (optional)
+ *  @return 0 if v_addr lies in a large page, negative integer code otherwise
+ */
+int pd_get_large_mapping(page_directory_t *pd, uint32_t v_addr,
+        uint32_t *pde){
+    if (pd == NULL) return -1;
+    uint32_t entry = pd->directory[PDE_INDEX(v_addr)];
+    if (!entry_present(entry) || !IS_LARGE(entry)) return -2;
+    if (pde != NULL) *pde = entry;
+    return 0;
+}
+
+/** @brief Removes a large page from a page directory and from the tlb
+ *
+ *  The large frame that was mapped is left to the caller.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The large page aligned virtual address of the large page
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_remove_large(page_directory_t *pd, uint32_t v_addr){
+    if (pd == NULL || !IS_LARGE_PAGE_ALIGNED(v_addr)) return -1;
+    if (pd_get_large_mapping(pd, v_addr, NULL) < 0) return -2;
+    pd->directory[PDE_INDEX(v_addr)] = 0;
+    flush_tlb(v_addr);
+    return 0;
+}
+
+/** @brief Replaces a large page with a page table mapping the same frames
+ *         with the same flags
+ *  @param pd The page directory
+ *  @param v_addr The large page aligned virtual address of the large page
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_split_large(page_directory_t *pd, uint32_t v_addr){
+    if (pd == NULL || !IS_LARGE_PAGE_ALIGNED(v_addr)) return -1;
+    uint32_t pde;
+    if (pd_get_large_mapping(pd, v_addr, &pde) < 0) return -2;
+    uint32_t *pt;
+    if (ptp_alloc(&ptpool, (void **)&pt) < 0) return -3;
+    uint32_t i, flags = EXTRACT_FLAGS(pde) & ~(SET << PAGE_SIZE_FLAG_BIT);
+    for (i = 0; i < PT_NUM_ENTRIES; i++){
+        pt[i] = ADD_FLAGS((REMOVE_LARGE_FLAGS(pde) + i * PAGE_SIZE), flags);
+    }
+    pd->directory[PDE_INDEX(v_addr)] = ADD_FLAGS(pt, flags);
+    if (pd->pt_live != NULL) pd->pt_live[PDE_INDEX(v_addr)] = PT_NUM_ENTRIES;
+    /* one invlpg drops the whole large page */
+    flush_tlb(v_addr);
+    return 0;
+}
 
 /** @brief Creates a mapping in a page directory with given flags
  *
- *  Requires that both v_addr and p_addr are page aligned
+ *  Requires that both v_addr and p_addr are page aligned and that v_addr is
+ *  not mapped already
  *
  *  @param pd The page directory
  *  @param v_addr The virtual address to map
@@ -367,56 +709,13 @@ void pd_commit_mapping(page_directory_t *pd){
  */
 int pd_create_mapping(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr,
         uint32_t pte_flags, uint32_t pde_flags){
-    /* input addresses must be page aligned */
-    if (!IS_PAGE_ALIGNED(v_addr) || !IS_PAGE_ALIGNED(p_addr)) return -1;
-    uint32_t pde_i, pte_i, pde_value, pte_value;
-
-    /* page directory entry index = top 10 bits of v_addr */
-    pde_i = (v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF;
-    /* page table index = 2nd 10 bits of v_addr */
-    pte_i = (v_addr >> OFF_SHIFT) & 0x3FF;
-    /* page table entry value is the physical address with flags */
-    pte_value = ADD_FLAGS(p_addr, pte_flags);
-
-    /* create a table if needed */
-
-    void *resource = NULL;
-
-    if (!entry_present(pd->directory[pde_i])){
-        if ((pde_value = (uint32_t)memalign(PAGE_SIZE, PT_SIZE)) == 0)
-            return -2;
-        resource = (void *)(pde_value);
-        memset((void *)pde_value, 0, PAGE_SIZE);
-        pde_value = ADD_FLAGS(pde_value, pde_flags);
-        pd->directory[pde_i] = pde_value;
-    } else {
-        pde_value = pd->directory[pde_i];
-    }
-    /* get address of page table and save mapping */
-    uint32_t *page_table = (uint32_t *)REMOVE_FLAGS(pde_value);
-
-    /* check if we should create mapping right away or add to mapping tasks */
-    if (pd->batch_enabled){
-        mapping_task_t *task = malloc(sizeof(mapping_task_t));
-        if (task == NULL) return -3;
-        task->v_addr = v_addr;
-        task->pte = pte_value;
-        task->resource = resource;
-        if (ll_add_last(pd->mapping_tasks, task) < 0){
-            free(task);
-            free(resource);
-            return -4;
-        }
-    } else {
-        page_table[pte_i] = pte_value;
-    }
-
-    return 0;
+    return pd_map_range(pd, v_addr, 1, p_addr, NULL, pte_flags, pde_flags);
 }
 
 /** @brief Removes mapping from page directory
  *
- *  Requires that both v_addr and p_addr are page aligned
+ *  Requires that both v_addr and p_addr are page aligned. The page table is
+ *  freed if this was its last mapping.
  *
  *  @param pd The page directory
  *  @param v_addr The virtual address to remove
@@ -424,32 +723,15 @@ int pd_create_mapping(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr,
  */
 int pd_remove_mapping(page_directory_t *pd, uint32_t v_addr){
     if (!IS_PAGE_ALIGNED(v_addr) || pd == NULL) return -1;
-    uint32_t pde_i, pte_i;
-    /* page directory entry index = top 10 bits of v_addr */
-    pde_i = (v_addr >> (OFF_SHIFT + PTE_SHIFT)) & 0x3FF;
-    /* page table index = 2nd 10 bits of v_addr */
-    pte_i = (v_addr >> OFF_SHIFT) & 0x3FF;
-
+    uint32_t *pte = get_pte(pd, v_addr);
     /* check for present page directory entry */
-    if (!entry_present(pd->directory[pde_i]))
+    if (pte == NULL)
         return -2;
-    uint32_t *page_table = (uint32_t *)REMOVE_FLAGS(pd->directory[pde_i]);
-    if (!entry_present(page_table[pte_i]))
+    if (!entry_present(*pte))
         return -3;
-    /* clear the mapping */
-    if (pd->batch_enabled){
-        mapping_task_t *task = malloc(sizeof(mapping_task_t));
-        if (task == NULL) return -3;
-        task->v_addr = v_addr;
-        task->pte = 0;
-        task->resource = NULL;
-        if (ll_add_last(pd->mapping_tasks, task) < 0){
-            free(task);
-            return -4;
-        }
-    } else {
-        page_table[pte_i] = 0;
-    }
+    /* clear the mapping, freeing the table if it was the last one */
+    *pte = 0;
+    pt_entry_removed(pd, v_addr);
     return 0;
 }
 
@@ -468,110 +750,303 @@ void *pd_get_base_addr(page_directory_t *pd){
  *  @return 0 on success, -1 on failure
  */
 int pd_init(page_directory_t *pd){
-    /* page align allocation and clear out all present bits */
-    pd->directory = memalign(PAGE_SIZE, PD_SIZE);
-    if (pd->directory == NULL){
+    /* page aligned allocation with all present bits cleared */
+    if (ptp_alloc(&ptpool, (void **)&pd->directory) < 0){
         return -1;
     }
-    memset(pd->directory, 0, PD_SIZE);
     if (initialize_kernel(pd) < 0){
-        free(pd->directory);
+        ptp_free(&ptpool, pd->directory, true);
         pd->directory = NULL;
         return -2;
     }
     pd->num_pages = 0;
-    pd->batch_enabled = false;
-    pd->mapping_tasks = malloc(sizeof(ll_t));
-    if (pd->mapping_tasks == NULL) return -3;
-    pd->p_addr_list = malloc(sizeof(ll_t));
-    if (pd->p_addr_list == NULL){
-        free(pd->mapping_tasks);
+    pd->pt_live = calloc(PD_NUM_ENTRIES, sizeof(uint16_t));
+    if (pd->pt_live == NULL){
+        ptp_free(&ptpool, pd->directory, false);
+        return -3;
+    }
+    if (frame_set_init(&pd->frames) < 0){
+        free(pd->pt_live);
+        ptp_free(&ptpool, pd->directory, false);
         return -4;
     }
-    if (ll_init(pd->p_addr_list) < 0){
-        free(pd->mapping_tasks);
-        free(pd->p_addr_list);
+    if (mutex_init(&pd->m) < 0){
+        frame_set_destroy(&pd->frames);
+        free(pd->pt_live);
+        ptp_free(&ptpool, pd->directory, false);
         return -5;
     }
-    if (ll_init(pd->mapping_tasks) < 0){
-        ll_destroy(pd->p_addr_list);
-        free(pd->mapping_tasks);
-        free(pd->p_addr_list);
+    if (vma_set_init(&pd->vmas) < 0){
+        mutex_destroy(&pd->m);
+        frame_set_destroy(&pd->frames);
+        free(pd->pt_live);
+        ptp_free(&ptpool, pd->directory, false);
         return -6;
     }
-
+    mutex_lock(&pd_registry_lock);
+    if (ll_add_last(&pd_registry, pd) < 0){
+        mutex_unlock(&pd_registry_lock);
+        vma_set_destroy(&pd->vmas);
+        mutex_destroy(&pd->m);
+        frame_set_destroy(&pd->frames);
+        free(pd->pt_live);
+        ptp_free(&ptpool, pd->directory, false);
+        return -7;
+    }
+    mutex_unlock(&pd_registry_lock);
     return 0;
 }
 
+/** @brief Gets a page directory itself, for lookups in pd_registry
+ *  @param pd The page directory
+ *  @return pd
+ */
+void *pd_registry_key(void *pd){
+    return pd;
+}
 
-/** @brief Shallow copies a page directory
+/** @brief Calls a function on every page directory made by pd_init
  *
- *  Both pd_dest and pd_src are expected to be pd_init'ed. Only copies
- *  page directory entries that are present and are not in the kernel.
- *  After execution, the same page directory entry indexes of pd_dest
- *  and pd_src will be filled but  pd_dest will point to different (and empty)
- *  page tables then that of pd_src.
+ *  No page directory is destroyed while the walk is going on. f is called
+ *  without the page directory's mutex.
+ *
+ *  @param f The function to call
+ *  @param arg The argument to pass to f along with each page directory
+ *  @return Void
+ */
+void pd_for_each(void (*f)(page_directory_t *, void *), void *arg){
+    if (f == NULL) return;
+    mutex_lock(&pd_registry_lock);
+    ll_node_t *node;
+    ll_head(&pd_registry, &node);
+    while (node != NULL){
+        f((page_directory_t *)node->e, arg);
+        node = node->next;
+    }
+    mutex_unlock(&pd_registry_lock);
+}
+
+
+/** @brief Deep copies the user space of a page directory
+ *
+ *  Both pd_dest and pd_src are expected to be pd_init'ed. pd_dest gets the
+ *  areas of pd_src, and every page of those areas that is present in pd_src
+ *  is copied into a frame of its own in pd_dest. Pages of kernel memory
+ *  (the shared zero frame and RAM disk pages) and of shared memory segments
+ *  stay shared.
  *
  *  @param pd_dest The page directory to copy to
  *  @param pd_src The page directory copying from
- *  @return 0 On success -1 on failure
+ *  @param runs The list of blocks to copy pages into, which must hold
+ *              atleast as many frames as pd_src has pages mapped
+ *  @return 0 On success, negative integer code on failure
  */
 int pd_deep_copy(page_directory_t *pd_dest, page_directory_t *pd_src,
-        uint32_t p_addr_start){
-    if (pd_dest == NULL || pd_src == NULL) return -1;
-
-    /* copy the upper level page directory */
-    uint32_t i, j;
+        frame_list_t *runs){
+    if (pd_dest == NULL || pd_src == NULL || runs == NULL) return -1;
+    /* pages are copied one at a time */
+    if (split_large_pages(pd_src) < 0) return -2;
+    if (vma_set_copy(&pd_dest->vmas, &pd_src->vmas) < 0) return -2;
+    if (alloc_area_tables(pd_dest, pd_src) < 0){
+        vma_set_clear(&pd_dest->vmas);
+        return -3;
+    }
 
-    uint32_t p_addr = p_addr_start;
+    frame_iter_t it;
+    fm_iter_init(&it, &fm, runs);
+    uint32_t i, j, last_page = 0;
+    bool any = false;
+    for (i = 0; i < pd_src->vmas.size; i++){
+        vma_t *vma = &pd_src->vmas.vmas[i];
+        uint32_t page = PAGE_ALIGN_DOWN(vma->start);
+        uint32_t num_pages =
+            (PAGE_ALIGN_DOWN(VMA_LAST(vma)) - page) / PAGE_SIZE + 1;
+        for (j = 0; j < num_pages; j++, page += PAGE_SIZE){
+            /* neighbouring areas may share a page */
+            if (any && page <= last_page) continue;
+            any = true;
+            last_page = page;
+            uint32_t *pte_src = get_pte(pd_src, page);
+            if (pte_src == NULL || !entry_present(*pte_src)) continue;
+            uint32_t *pte_dest = get_pte(pd_dest, page);
+            /* kernel memory (the zero frame and RAM disk pages) and shared
+             * segments are shared, not copied */
+            if (REMOVE_FLAGS(*pte_src) < USER_MEM_START
+                    || vma->type == VMA_SHARED){
+                *pte_dest = *pte_src;
+                pt_entry_added(pd_dest, page);
+                continue;
+            }
+            uint32_t p_addr;
+            if (fm_iter_next(&it, &p_addr, NULL) < 0
+                    /* copy straight from the old frame into the new one */
+                    || pd_copy_frame(p_addr, REMOVE_FLAGS(*pte_src)) < 0){
+                free_user_tables(pd_dest);
+                vma_set_clear(&pd_dest->vmas);
+                return -4;
+            }
+            *pte_dest = ADD_FLAGS(p_addr, EXTRACT_FLAGS(*pte_src));
+            pt_entry_added(pd_dest, page);
+        }
+    }
+    return 0;
+}
 
-    uint32_t backup_directory[PD_NUM_ENTRIES];
+/** @brief Copies a page directory so that it shares frames copy-on-write
+ *
+ *  Both pd_dest and pd_src are expected to be pd_init'ed. pd_dest gets the
+ *  areas of pd_src and new page tables in which every page of those areas
+ *  that is present in pd_src points at the same physical frame. Every
+ *  writable page is made read only and flagged copy-on-write in both
+ *  directories, except for the pages of shared memory segments, which stay
+ *  writable. The caller is responsible for referencing the shared frames
+ *  and for flushing the tlb if pd_src is the active directory.
+ *
+ *  @param pd_dest The page directory to copy to
+ *  @param pd_src The page directory copying from
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_cow_copy(page_directory_t *pd_dest, page_directory_t *pd_src){
+    if (pd_dest == NULL || pd_src == NULL) return -1;
+    /* pages are write protected and broken one at a time */
+    if (split_large_pages(pd_src) < 0) return -2;
+    if (vma_set_copy(&pd_dest->vmas, &pd_src->vmas) < 0) return -2;
+    /* allocate all page tables first so that failures leave pd_src intact */
+    if (alloc_area_tables(pd_dest, pd_src) < 0){
+        vma_set_clear(&pd_dest->vmas);
+        return -3;
+    }
 
-    /* copy over non-kernel space */
-    for (i = NUM_KERNEL_PDE; i < PD_NUM_ENTRIES; i++){
-        /* for each present entry, create a new page table  */
-        uint32_t entry = pd_src->directory[i];
-        if (entry_present(entry)){
-            /* allocate a new page table */
-            uint32_t *new_pt = memalign(PAGE_SIZE, PT_SIZE);
-            if (new_pt == NULL){
-                /* roll back changes and release resources */
-                for (j = i-1; j >= NUM_KERNEL_PDE; j--){
-                    if (entry_present(pd_dest->directory[j])){
-                        free((void *)(REMOVE_FLAGS(pd_dest->directory[j])));
-                    }
-                }
-                memcpy(&pd_dest->directory[NUM_KERNEL_PDE],
-                        &backup_directory[NUM_KERNEL_PDE],
-                        (i-NUM_KERNEL_PDE) * sizeof(uint32_t));
-                return -2;
+    /* share every present page, write protecting writable ones */
+    uint32_t i, j, last_page = 0;
+    bool any = false;
+    for (i = 0; i < pd_src->vmas.size; i++){
+        vma_t *vma = &pd_src->vmas.vmas[i];
+        uint32_t page = PAGE_ALIGN_DOWN(vma->start);
+        uint32_t num_pages =
+            (PAGE_ALIGN_DOWN(VMA_LAST(vma)) - page) / PAGE_SIZE + 1;
+        for (j = 0; j < num_pages; j++, page += PAGE_SIZE){
+            /* neighbouring areas may share a page */
+            if (any && page <= last_page) continue;
+            any = true;
+            last_page = page;
+            uint32_t *pte_src = get_pte(pd_src, page);
+            if (pte_src == NULL || !entry_present(*pte_src)) continue;
+            /* writes to a shared segment are seen by everyone mapping it */
+            if (vma->type != VMA_SHARED && NTH_BIT(*pte_src, RW_FLAG_BIT)){
+                *pte_src = ADD_COW_FLAG((*pte_src & ~(SET << RW_FLAG_BIT)));
             }
-            memset((void *)new_pt, 0, PAGE_SIZE);
-            uint32_t flags = EXTRACT_FLAGS(entry);
-            /* save the old mapping in case of rollbacks */
-            backup_directory[i] = pd_dest->directory[i];
-            /* map page directory to new page table */
-            pd_dest->directory[i] = (uint32_t)new_pt | flags;
-            pt_copy(new_pt, (uint32_t *)REMOVE_FLAGS(entry), i, &p_addr);
+            *get_pte(pd_dest, page) = *pte_src;
+            pt_entry_added(pd_dest, page);
         }
     }
-    /* add new physical address space to our new pd's address list */
+    return 0;
+}
+
+/** @brief Gives a copy-on-write page its own writable frame
+ *
+ *  Requires that pd is the active page directory. If p_addr is the frame that
+ *  is already mapped at v_addr, the page is simply made writable. Otherwise
+ *  the contents of the page are copied into p_addr and v_addr is remapped to
+ *  it. The caller is responsible for the frame that was previously mapped.
+ *  Nothing is copied out of the shared zero frame, the caller must make sure
+ *  that p_addr is zeroed in that case.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The page aligned virtual address of the copy-on-write page
+ *  @param p_addr The frame that should back v_addr from now on
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_break_cow(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr) || !IS_PAGE_ALIGNED(p_addr))
+        return -1;
+    uint32_t *pt_entry = get_pte(pd, v_addr);
+    if (pt_entry == NULL) return -2;
+    uint32_t pte = *pt_entry;
+    if (!entry_present(pte) || !IS_COW(pte)) return -3;
+
+    uint32_t flags = REMOVE_COW_FLAG(EXTRACT_FLAGS(pte)) | (SET << RW_FLAG_BIT);
+    if (REMOVE_FLAGS(pte) != p_addr
+            && REMOVE_FLAGS(pte) != (uint32_t)zero_page){
+        if (pd_copy_frame(p_addr, REMOVE_FLAGS(pte)) < 0)
+            return -4;
+    }
+    *pt_entry = ADD_FLAGS(p_addr, flags);
+    flush_tlb(v_addr);
+    return 0;
+}
 
+/** @brief Moves a mapped page into another frame
+ *
+ *  Copies the page into p_addr and points its page table entry at it with
+ *  the same flags. Interrupts stay disabled from the copy to the update, so
+ *  no thread of pd can write to the old frame in between. Both frames are
+ *  left to the caller.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The page aligned virtual address of a 4KB page
+ *  @param p_addr The frame to move the page into
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_migrate_page(page_directory_t *pd, uint32_t v_addr, uint32_t p_addr){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr) || !IS_PAGE_ALIGNED(p_addr))
+        return -1;
+    uint32_t *pt_entry = get_pte(pd, v_addr);
+    if (pt_entry == NULL || !entry_present(*pt_entry)) return -2;
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    pd_copy_frame(p_addr, REMOVE_FLAGS(*pt_entry));
+    *pt_entry = ADD_FLAGS(p_addr, EXTRACT_FLAGS(*pt_entry));
+    /* other directories are flushed when they are next loaded */
+    if (REMOVE_FLAGS(get_pdbr()) == (uint32_t)pd->directory)
+        flush_tlb(v_addr);
+    if (eflags & EFL_IF) enable_interrupts();
     return 0;
 }
 
-/** @brief Defines metadata for a frame that should be remembered in a page
- * directory */
-typedef struct pd_frame_metadata{
-    /** @brief The base address */
-    uint32_t p_addr;
-    /** @breif Size of frame */
-    uint32_t num_pages;
-} pd_frame_metadata_t;
+/** @brief Replaces the flags of an existing page table entry
+ *
+ *  @param pd The page directory
+ *  @param v_addr The page aligned virtual address
+ *  @param pte_flags The new page table entry flags
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_protect_mapping(page_directory_t *pd, uint32_t v_addr,
+        uint32_t pte_flags){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr)) return -1;
+    uint32_t *pt_entry = get_pte(pd, v_addr);
+    if (pt_entry == NULL) return -2;
+    uint32_t pte = *pt_entry;
+    if (!entry_present(pte)) return -3;
+    *pt_entry = ADD_FLAGS(REMOVE_FLAGS(pte), EXTRACT_FLAGS(pte_flags));
+    flush_tlb(v_addr);
+    return 0;
+}
 
-/** @brief Returns the frame base address of a metadata */
-void *pd_frame_metadata_addr(void *metadata){
-    return (void *)((pd_frame_metadata_t *)metadata)->p_addr;
+/** @brief Fills in a page from every file backed area that overlaps it
+ *
+ *  Requires that pd is the active page directory, that v_addr is mapped
+ *  writable and that the page is already zeroed.
+ *
+ *  @param pd The page directory
+ *  @param v_addr The page aligned virtual address of the page
+ *  @return 0 on success, negative integer code on failure
+ */
+int pd_fill_file_page(page_directory_t *pd, uint32_t v_addr){
+    if (pd == NULL || !IS_PAGE_ALIGNED(v_addr)) return -1;
+    uint32_t i, last = v_addr + (PAGE_SIZE-1);
+    if (vma_set_first_overlap(&pd->vmas, v_addr, last, &i) < 0) return 0;
+    for (; i < pd->vmas.size && pd->vmas.vmas[i].start <= last; i++){
+        vma_t *vma = &pd->vmas.vmas[i];
+        if (vma->type != VMA_FILE) continue;
+        /* the part of the area's file bytes that land in this page */
+        uint32_t low = vma->start > v_addr ? vma->start : v_addr;
+        uint32_t high = vma->start + vma->src_len;
+        if (high > v_addr + PAGE_SIZE) high = v_addr + PAGE_SIZE;
+        if (low >= high) continue;
+        memcpy((void *)low, vma->src + (low - vma->start), high - low);
+    }
+    return 0;
 }
 
 /** @brief Gives a page directory a frame to remember
@@ -582,36 +1057,63 @@ void *pd_frame_metadata_addr(void *metadata){
  */
 int pd_alloc_frame(page_directory_t *pd, uint32_t p_addr, uint32_t num_pages){
     if (pd == NULL) return -1;
+    if (frame_set_insert(&pd->frames, p_addr, num_pages) < 0) return -2;
     pd->num_pages += num_pages;
-    /* add first for better locality */
-    pd_frame_metadata_t *metadata = malloc(sizeof(pd_frame_metadata_t));
-    if (metadata == NULL) return -2;
-    metadata->p_addr = p_addr;
-    metadata->num_pages = num_pages;
-    if (ll_add_first(pd->p_addr_list, (void *)metadata) < 0){
-        free(metadata);
-        return -3;
+    return 0;
+}
+
+/** @brief Makes room in a page directory for every block in a list
+ *
+ *  Call before mapping the frames of the list, so that pd_alloc_frames
+ *  cannot fail once they are mapped.
+ *
+ *  @param pd The page directory
+ *  @param runs The list of blocks from fm_alloc_list
+ *  @return 0 On success, negative integer code on failure
+ */
+int pd_reserve_frames(page_directory_t *pd, frame_list_t *runs){
+    if (pd == NULL || runs == NULL) return -1;
+    if (frame_set_reserve(&pd->frames, runs->size) < 0) return -2;
+    return 0;
+}
+
+/** @brief Gives a page directory every block in a list to remember
+ *
+ *  The list is left empty. This cannot fail once room for the blocks was
+ *  made with pd_reserve_frames.
+ *
+ *  @param pd The page directory
+ *  @param runs The list of blocks from fm_alloc_list
+ *  @return 0 On success, negative integer code on failure
+ */
+int pd_alloc_frames(page_directory_t *pd, frame_list_t *runs){
+    if (pd == NULL || runs == NULL) return -1;
+    frame_iter_t it;
+    uint32_t p_addr, num_pages;
+    fm_iter_init(&it, &fm, runs);
+    while (fm_iter_next_run(&it, &p_addr, &num_pages, NULL) == 0){
+        if (pd_alloc_frame(pd, p_addr, num_pages) < 0) return -2;
     }
+    fm_list_init(runs);
     return 0;
 }
 
-/** @brief Removes frame metadata from a page directory with a given address
+/** @brief Removes a range of frames from the frames of a page directory
+ *
+ *  The range need not line up with the runs the frames were given in, and a
+ *  run it lies in the middle of is split in two. Nothing is removed unless
+ *  the page directory holds every frame of the range.
+ *
  *  @param pd The page directory
- *  @param p_addr Base address of the physical frame to be removed
- *  @param frame_size Optional address to store the frame size that was
- *  dealloacated
- *  @return 0 On success -1 on failure
+ *  @param p_addr The physical address of the first frame
+ *  @param num_pages The number of frames to remove
+ *  @return 0 on success, negative integer code on failure
  */
-int pd_dealloc_frame(page_directory_t *pd, uint32_t p_addr,
-        uint32_t *frame_size){
-    if (pd == NULL) return -1;
-    pd_frame_metadata_t *metadata;
-    if (ll_remove(pd->p_addr_list, &pd_frame_metadata_addr,
-            (void *)p_addr, (void **)&metadata, NULL) < 0)
-        return -2;
-    pd->num_pages -= metadata->num_pages;
-    if (frame_size != NULL) *frame_size = metadata->num_pages;
-    free(metadata);
+int pd_release_frames(page_directory_t *pd, uint32_t p_addr,
+        uint32_t num_pages){
+    if (pd == NULL || !IS_PAGE_ALIGNED(p_addr)) return -1;
+    if (frame_set_remove(&pd->frames, p_addr, num_pages) < 0) return -2;
+    pd->num_pages -= num_pages;
     return 0;
 }
 
@@ -621,48 +1123,35 @@ int pd_dealloc_frame(page_directory_t *pd, uint32_t p_addr,
  */
 int pd_num_frames(page_directory_t *pd){
     if (pd == NULL) return -1;
-    return ll_size(pd->p_addr_list);
+    return pd->frames.size;
 }
 
 
-/** @brief Removes all frame metadata from a page directory and stores the
- *         starting addresses of each frame in an array
+/** @brief Removes all frame metadata from a page directory
+ *
+ *  The frames are read straight out of pd->frames beforehand, so that
+ *  nothing proportional to their number is copied.
+ *
  *  @param pd The page directory
- *  @param addr_list The array to store to
  *  @return 0 on success, negative integer code on failure
  */
-int pd_dealloc_all_frames(page_directory_t *pd, uint32_t *addr_list, uint32_t *size_list){
-    if (pd == NULL || addr_list == NULL) return -1;
-    int arr_i = 0;
-    while (pd_num_frames(pd) > 0){
-        pd_frame_metadata_t *metadata;
-        ll_remove_first(pd->p_addr_list, (void **)&metadata);
-        addr_list[arr_i] = metadata->p_addr;
-        if (size_list != NULL)
-            size_list[arr_i] = metadata->num_pages;
-        arr_i++;
-    }
+int pd_dealloc_all_frames(page_directory_t *pd){
+    if (pd == NULL) return -1;
+    frame_set_clear(&pd->frames);
     pd->num_pages = 0;
     return 0;
 }
 
 
 /** @brief Removes all mappings from the user space
+ *
+ *  The areas of the page directory are left for the caller to clear.
+ *
  *  @param pd The page directory
  *  @return 0 on success, negative integer code on failure
  */
 int pd_clear_user_space(page_directory_t *pd){
-    int i;
-    for (i = NUM_KERNEL_PDE; i < PD_NUM_ENTRIES; i++) {
-        uint32_t entry = pd->directory[i];
-        if (entry_present(entry)){
-            pd->directory[i] = 0;
-            /* Free each page table */
-            uint32_t pt = REMOVE_FLAGS(entry);
-
-            free((void*) pt);
-        }
-    }
+    free_user_tables(pd);
     return 0;
 }
 
@@ -675,22 +1164,20 @@ int pd_clear_user_space(page_directory_t *pd){
  *  @return Void
  */
 void pd_destroy(page_directory_t *pd) {
-    int i;
-    /* At this point we should have already deallocated addresses stored
-     * in p_addr_list so it should be safe to destroy */
-    if (ll_size(pd->p_addr_list) > 0){
+    mutex_lock(&pd_registry_lock);
+    ll_remove(&pd_registry, &pd_registry_key, pd, NULL, NULL);
+    mutex_unlock(&pd_registry_lock);
+    /* At this point we should have already deallocated the frames stored
+     * in frames so it should be safe to destroy */
+    if (pd->frames.size > 0){
         panic("Destroying page directory before returning all frames!");
     }
-    ll_destroy(pd->p_addr_list);
+    frame_set_destroy(&pd->frames);
+    vma_set_destroy(&pd->vmas);
     /* destroy all non-kernel page tables */
-    for (i = NUM_KERNEL_PDE ; i < PD_NUM_ENTRIES ; i++) {
-        uint32_t entry = pd->directory[i];
-        if (entry_present(entry)){
-            /* Free each page table */
-            uint32_t pt = REMOVE_FLAGS(entry);
-            free((void*) pt);
-        }
-    }
+    free_user_tables(pd);
+    mutex_destroy(&pd->m);
+    free(pd->pt_live);
     /* Free whole directory */
-    free(pd->directory);
+    ptp_free(&ptpool, pd->directory, false);
 }
@@ -0,0 +1,169 @@
+/** @file pt_pool.c
+ *  @brief Implements a pool of pages used as page tables and directories
+ *
+ *  Page tables and directories have to live in the kernel's direct map, so
+ *  they cannot come from the frame manager. Allocating each of them with
+ *  memalign interleaves page aligned blocks with every other allocation of
+ *  the kernel heap, which fragments it until large allocations fail even
+ *  though plenty of memory is free. Instead we take pages from the heap in
+ *  large page aligned slabs, once at boot and again whenever the pool runs
+ *  dry, and never give them back.
+ *
+ *  Free pages are threaded onto two lists through their first word. Pages
+ *  known to be zero apart from that link (fresh slabs, and page tables freed
+ *  with nothing mapped in them) are kept apart from the rest, so most
+ *  allocations do not have to zero a page. The rest are zeroed either on
+ *  allocation or while the idle thread runs.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <x86/page.h>
+
+#include <pt_pool.h>
+/* sched_lock */
+#include <kern_internals.h>
+
+/** @brief Takes a zeroed slab of pages from the kernel heap and frees every
+ *         page of it into the clean list
+ *  @param pool The pool
+ *  @param num_pages The number of pages of the slab
+ *  @return 0 on success, negative integer code on failure
+ */
+int ptp_grow(pt_pool_t *pool, uint32_t num_pages){
+    char *slab = memalign(PAGE_SIZE, num_pages * PAGE_SIZE);
+    if (slab == NULL) return -1;
+    memset(slab, 0, num_pages * PAGE_SIZE);
+    uint32_t i;
+    sched_mutex_lock(&sched_lock);
+    for (i = 0; i < num_pages; i++){
+        ptp_page_t *page = (ptp_page_t *)(slab + i * PAGE_SIZE);
+        page->next = pool->clean;
+        pool->clean = page;
+    }
+    pool->num_clean += num_pages;
+    pool->num_slabs++;
+    sched_mutex_unlock(&sched_lock);
+    return 0;
+}
+
+/** @brief Initializes a pool with a first slab of pages
+ *  @param pool The pool
+ *  @param num_pages The number of pages to reserve right away
+ *  @return 0 on success, negative integer code on failure
+ */
+int ptp_init(pt_pool_t *pool, uint32_t num_pages){
+    if (pool == NULL || num_pages == 0) return -1;
+    pool->clean = NULL;
+    pool->dirty = NULL;
+    pool->num_clean = 0;
+    pool->num_dirty = 0;
+    pool->num_used = 0;
+    pool->num_slabs = 0;
+    if (ptp_grow(pool, num_pages) < 0) return -2;
+    return 0;
+}
+
+/** @brief Allocates a zeroed, page aligned page from a pool
+ *  @param pool The pool
+ *  @param page Where to store the address of the page
+ *  @return 0 on success, negative integer code on failure
+ */
+int ptp_alloc(pt_pool_t *pool, void **page){
+    if (pool == NULL || page == NULL) return -1;
+    ptp_page_t *p;
+    bool zeroed;
+    sched_mutex_lock(&sched_lock);
+    while (pool->clean == NULL && pool->dirty == NULL){
+        sched_mutex_unlock(&sched_lock);
+        if (ptp_grow(pool, PTP_SLAB_PAGES) < 0) return -2;
+        sched_mutex_lock(&sched_lock);
+    }
+    if (pool->clean != NULL){
+        p = pool->clean;
+        pool->clean = p->next;
+        pool->num_clean--;
+        zeroed = true;
+    } else {
+        p = pool->dirty;
+        pool->dirty = p->next;
+        pool->num_dirty--;
+        zeroed = false;
+    }
+    pool->num_used++;
+    sched_mutex_unlock(&sched_lock);
+
+    if (zeroed){
+        /* only the link was ever written */
+        p->next = NULL;
+    } else {
+        memset(p, 0, PAGE_SIZE);
+    }
+    *page = (void *)p;
+    return 0;
+}
+
+/** @brief Returns a page to a pool
+ *  @param pool The pool
+ *  @param page The page from ptp_alloc
+ *  @param zeroed Whether every byte of the page is known to be zero
+ *  @return Void
+ */
+void ptp_free(pt_pool_t *pool, void *page, bool zeroed){
+    if (pool == NULL || page == NULL) return;
+    ptp_page_t *p = (ptp_page_t *)page;
+    sched_mutex_lock(&sched_lock);
+    if (zeroed){
+        p->next = pool->clean;
+        pool->clean = p;
+        pool->num_clean++;
+    } else {
+        p->next = pool->dirty;
+        pool->dirty = p;
+        pool->num_dirty++;
+    }
+    pool->num_used--;
+    sched_mutex_unlock(&sched_lock);
+}
+
+/** @brief Zeroes up to num_pages free pages of a pool that are not known to
+ *         be zeroed
+ *
+ *  Meant to be called from the timer handler while the idle thread is
+ *  running, so it must be called with interrupts disabled and never blocks.
+ *
+ *  @param pool The pool
+ *  @param num_pages The maximum number of pages to zero
+ *  @return The number of pages zeroed
+ */
+int ptp_zero_idle(pt_pool_t *pool, uint32_t num_pages){
+    if (pool == NULL) return 0;
+    uint32_t i;
+    for (i = 0; i < num_pages && pool->dirty != NULL; i++){
+        ptp_page_t *p = pool->dirty;
+        pool->dirty = p->next;
+        pool->num_dirty--;
+        memset(p, 0, PAGE_SIZE);
+        p->next = pool->clean;
+        pool->clean = p;
+        pool->num_clean++;
+    }
+    return i;
+}
+
+/** @brief Gets how many pages of a pool are in use and free
+ *  @param pool The pool
+ *  @param num_used Where to store the number of pages in use (optional)
+ *  @param num_free Where to store the number of free pages (optional)
+ *  @return Void
+ */
+void ptp_stats(pt_pool_t *pool, uint32_t *num_used, uint32_t *num_free){
+    if (pool == NULL) return;
+    if (num_used != NULL) *num_used = pool->num_used;
+    if (num_free != NULL) *num_free = pool->num_clean + pool->num_dirty;
+}
@@ -0,0 +1,129 @@
+/** @file shm.c
+ *  @brief Implements shared memory segments
+ *
+ *  A segment is a run of zeroed frames that any number of page directories
+ *  map at once, named by an integer key. The first process to attach a key
+ *  creates its segment, and later ones map the very same frames. The frames
+ *  are never recorded in the frame lists of the page directories mapping
+ *  them. Instead the segment counts the areas that map it, and its frames go
+ *  back to the frame manager when the last of them is detached, whether by
+ *  shm_detach, exec or the death of the process.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <malloc.h>
+
+#include <shm.h>
+#include <kern_internals.h>
+#include <virtual_mem_mgmt.h>
+
+/** @brief Gets the key of a segment for lookups in the table
+ *  @param seg The segment
+ *  @return The key
+ */
+void *shm_seg_key(void *seg){
+    return (void *)((shm_seg_t *)seg)->key;
+}
+
+/** @brief Initializes a table of segments
+ *  @param t The table
+ *  @return 0 on success, negative integer code on failure
+ */
+int shm_init(shm_table_t *t){
+    if (t == NULL) return -1;
+    if (mutex_init(&t->m) < 0) return -2;
+    if (ll_init(&t->segs) < 0) return -3;
+    t->num_created = 0;
+    t->num_destroyed = 0;
+    return 0;
+}
+
+/** @brief Takes a reference on the segment with a given key, creating it
+ *         with zeroed frames if there is none
+ *  @param t The table
+ *  @param key The key of the segment
+ *  @param num_pages The number of pages the segment must have
+ *  @param seg Where to store the segment
+ *  @return 0 on success, negative integer code on failure
+ */
+int shm_get(shm_table_t *t, int key, uint32_t num_pages, shm_seg_t **seg){
+    if (t == NULL || seg == NULL || num_pages == 0
+            || num_pages > SHM_MAX_PAGES) return -1;
+    shm_seg_t *s;
+    mutex_lock(&t->m);
+    if (ll_find(&t->segs, &shm_seg_key, (void *)key, (void **)&s) == 0){
+        if (s->num_pages != num_pages){
+            mutex_unlock(&t->m);
+            return -2;
+        }
+        s->refcount++;
+        mutex_unlock(&t->m);
+        *seg = s;
+        return 0;
+    }
+
+    s = malloc(sizeof(shm_seg_t));
+    if (s == NULL){
+        mutex_unlock(&t->m);
+        return -3;
+    }
+    s->key = key;
+    s->num_pages = num_pages;
+    s->refcount = 1;
+    if (fm_alloc_list_zeroed(&fm, num_pages, &s->runs) < 0){
+        free(s);
+        mutex_unlock(&t->m);
+        return -4;
+    }
+    zero_dirty_runs(&s->runs);
+    if (ll_add_last(&t->segs, s) < 0){
+        fm_dealloc_list(&fm, &s->runs);
+        free(s);
+        mutex_unlock(&t->m);
+        return -5;
+    }
+    t->num_created++;
+    mutex_unlock(&t->m);
+    *seg = s;
+    return 0;
+}
+
+/** @brief Takes another reference on a segment
+ *  @param t The table
+ *  @param seg The segment, which must already be referenced
+ *  @return Void
+ */
+void shm_ref(shm_table_t *t, shm_seg_t *seg){
+    if (t == NULL || seg == NULL) return;
+    mutex_lock(&t->m);
+    seg->refcount++;
+    mutex_unlock(&t->m);
+}
+
+/** @brief Drops a reference on a segment, tearing it down and returning its
+ *         frames to the frame manager if it was the last one
+ *
+ *  Every mapping of the segment must be gone by the time the last reference
+ *  is dropped.
+ *
+ *  @param t The table
+ *  @param seg The segment
+ *  @return Void
+ */
+void shm_put(shm_table_t *t, shm_seg_t *seg){
+    if (t == NULL || seg == NULL) return;
+    mutex_lock(&t->m);
+    if (--seg->refcount > 0){
+        mutex_unlock(&t->m);
+        return;
+    }
+    ll_remove(&t->segs, &shm_seg_key, (void *)seg->key, NULL, NULL);
+    t->num_destroyed++;
+    mutex_unlock(&t->m);
+    fm_dealloc_list(&fm, &seg->runs);
+    free(seg);
+}
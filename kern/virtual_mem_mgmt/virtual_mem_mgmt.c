@@ -7,6 +7,35 @@
  *  manager to map in the page directory, as well as removing mappings from the
  *  page directory and returning frames to the frame manager.
  *
+ *  Every range of user memory is recorded as an area of the page directory, so
+ *  new_pages, remove_pages, fork and the validation of system call arguments
+ *  cost time in the number of areas rather than the number of pages.
+ *
+ *  Memory that starts out zeroed (new_pages, .bss and the user stack) is
+ *  allocated on demand. Its pages are not mapped at all until they are
+ *  touched. A read maps a single shared frame of zeroes read only and marked
+ *  copy-on-write, and the first write to each page gives it a frame of its own.
+ *
+ *  With LARGE_USER_PAGES, large anonymous areas, such as big new_pages
+ *  allocations, are mapped a 4MB large page at a time when the buddy
+ *  allocator has a large enough block to spare, or can be made to have one by
+ *  compacting memory (see compact.c), which saves both page tables and tlb
+ *  entries.
+ *
+ *  An area may also grow down, like the user stack does. A fault just below
+ *  such an area extends it and maps several zeroed pages at once, all without
+ *  leaving the page fault handler.
+ *
+ *  Shared memory segments (see shm.c) are mapped in full when they are
+ *  attached. Their frames belong to the segment rather than to any page
+ *  directory, so copies share them writable and tearing down an address space
+ *  only drops its references on the segments.
+ *
+ *  Frames may be shared between page directories after a copy-on-write fork,
+ *  so frames are returned to the frame manager by dropping references on them
+ *  rather than deallocating them outright. The last page directory to drop
+ *  its reference on a frame is the one that actually frees it.
+ *
  *  @author Christopher Wei (cjwei)
  *  @author Aatish Nayak (aatishn)
  *  @bug Not neccesarily a bug, but at some point we would like to abstract out
@@ -19,6 +48,9 @@
 #include <simics.h>
 #include <kern_internals.h>
 #include <frame_manager.h>
+#include <virtual_mem_mgmt.h>
+#include <page_cache.h>
+#include <shm.h>
 /* NULL */
 #include <stdlib.h>
 /* memset */
@@ -30,7 +62,18 @@
 
 #include <debug.h>
 
-
+/** @brief Takes a reference on the segment of every shared area of a page
+ *         directory, after the areas were copied into it
+ *  @param pd The page directory
+ *  @return Void
+ */
+void ref_shared_areas(page_directory_t *pd){
+    uint32_t i;
+    for (i = 0; i < pd->vmas.size; i++){
+        if (pd->vmas.vmas[i].type == VMA_SHARED)
+            shm_ref(&shmtab, pd->vmas.vmas[i].seg);
+    }
+}
 
 /** @brief Deep copies the current page directory into pd_dest
  *
@@ -52,31 +95,394 @@ int vmm_deep_copy(page_directory_t *pd_dest){
 
     page_directory_t *pd_src = &(cur_pcb->pd);
 
-    uint32_t p_addr_start;
-    if (fm_alloc(&fm, pd_src->num_pages, &p_addr_start) < 0){
+    /* the frames do not need to be contiguous */
+    frame_list_t runs;
+    if (fm_alloc_list(&fm, pd_src->num_pages, &runs) < 0){
         DEBUG_PRINT("Failed allocate %d pages in vmm_deep_copy",
-                (unsigned int)pd_dest->num_pages);
+                (unsigned int)pd_src->num_pages);
         return -3;
     }
-    if (pd_alloc_frame(pd_dest, p_addr_start, pd_src->num_pages) < 0){
-        fm_dealloc(&fm, p_addr_start);
+    if (pd_reserve_frames(pd_dest, &runs) < 0){
+        fm_dealloc_list(&fm, &runs);
         return -4;
     }
 
     /* deep copy page directory structure */
-    if (pd_deep_copy(pd_dest, pd_src, p_addr_start) < 0){
-        fm_dealloc(&fm, p_addr_start);
-        pd_dealloc_frame(pd_dest, p_addr_start, NULL);
+    if (pd_deep_copy(pd_dest, pd_src, &runs) < 0){
+        fm_dealloc_list(&fm, &runs);
+        return -5;
+    }
+    pd_alloc_frames(pd_dest, &runs);
+    ref_shared_areas(pd_dest);
+    return 0;
+}
+
+
+/** @brief Copies the current page directory into pd_dest copy-on-write
+ *
+ *  Sets pd_dest to the same structure as the current active directory with
+ *  new page tables that point at the same physical frames. All writable pages
+ *  are write protected in both directories and are copied lazily by
+ *  vmm_resolve_fault the first time either side writes to them.
+ *
+ *  @param pd_dest The page directory to copy to
+ *  @return 0 on success, negative integer code on failure */
+int vmm_cow_copy(page_directory_t *pd_dest){
+    if (pd_dest == NULL) return -1;
+
+    /* Get current running pcb */
+    pcb_t *cur_pcb;
+    if(scheduler_get_current_pcb(&sched, &cur_pcb) < 0) {
+        return -2;
+    }
+
+    page_directory_t *pd_src = &(cur_pcb->pd);
+
+    mutex_lock(&pd_src->m);
+    /* the source's runs stay put while we hold its lock */
+    frame_run_t *runs = pd_src->frames.runs;
+    uint32_t i, num_runs = pd_src->frames.size;
+
+    /* take a reference on every frame of the source */
+    for (i = 0; i < num_runs; i++){
+        if (fm_ref(&fm, runs[i].p_addr, runs[i].num_pages) < 0) break;
+        if (pd_alloc_frame(pd_dest, runs[i].p_addr, runs[i].num_pages) < 0){
+            fm_unref(&fm, runs[i].p_addr, runs[i].num_pages);
+            break;
+        }
+    }
+    if (i < num_runs || pd_cow_copy(pd_dest, pd_src) < 0){
+        /* release whatever references we managed to take */
+        uint32_t j;
+        for (j = 0; j < i; j++){
+            pd_release_frames(pd_dest, runs[j].p_addr, runs[j].num_pages);
+            fm_unref(&fm, runs[j].p_addr, runs[j].num_pages);
+        }
+        mutex_unlock(&pd_src->m);
+        return -3;
+    }
+    ref_shared_areas(pd_dest);
+    /* writable pages of the source were just write protected */
+    flush_all_tlb();
+    mutex_unlock(&pd_src->m);
+    return 0;
+}
+
+#ifdef LARGE_USER_PAGES
+/** @brief Maps the large page around a page of an anonymous area with a
+ *         zeroed large frame
+ *
+ *  Only done if the area covers the whole large page and nothing of the large
+ *  page is mapped yet. Requires that pd->m is held.
+ *
+ *  @param pd The page directory
+ *  @param vma The anonymous area
+ *  @param v_addr The page aligned virtual address that was touched
+ *  @return 0 on success, negative integer code if 4KB pages should be used
+ */
+int page_in_large(page_directory_t *pd, vma_t *vma, uint32_t v_addr){
+    uint32_t base = v_addr - (v_addr % LARGE_PAGE_SIZE);
+    if (base < vma->start || VMA_LAST(vma) - base < LARGE_PAGE_SIZE - 1)
+        return -1;
+    /* a page table is already there */
+    if (pd_get_mapping(pd, base, NULL) != -2) return -2;
+    uint32_t i, p_addr;
+    /* buddy blocks of a large page are aligned to one. If memory is too
+     * fragmented for one, try to make one by compacting */
+    if (fm_alloc(&fm, LARGE_PAGE_PAGES, &p_addr) < 0
+            && (vmm_compact(VMM_COMPACT_ORDER, pd) < 0
+                || fm_alloc(&fm, LARGE_PAGE_PAGES, &p_addr) < 0))
+        return -3;
+    for (i = 0; i < LARGE_PAGE_PAGES; i++){
+        pd_zero_frame(p_addr + i * PAGE_SIZE);
+    }
+    if (pd_alloc_frame(pd, p_addr, LARGE_PAGE_PAGES) < 0){
+        fm_dealloc(&fm, p_addr);
+        return -4;
+    }
+    pd_map_large(pd, base, p_addr, vma->pte_f);
+    return 0;
+}
+#endif
+
+/** @brief Maps a page of an area that has not been touched yet
+ *
+ *  Pages of anonymous areas are mapped to the shared zero frame when read and
+ *  get a zeroed frame of their own when written. Pages of file backed areas
+ *  are filled in from every file backed area that overlaps them, read only
+ *  ones are looked up in the page cache first and are added to it after being
+ *  filled in. A page is writable if any area that overlaps it is.
+ *
+ *  Requires that pd is the active page directory
+ *
+ *  @param pd The page directory
+ *  @param v_addr The page aligned virtual address that was touched
+ *  @param write Whether the page was touched by a write
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_page_in(page_directory_t *pd, uint32_t v_addr, bool write){
+    uint32_t i, last = v_addr + (PAGE_SIZE-1);
+    mutex_lock(&pd->m);
+    if (pd_get_mapping(pd, v_addr, NULL) == 0){
+        /* another thread beat us to it */
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+    if (vma_set_first_overlap(&pd->vmas, v_addr, last, &i) < 0){
+        mutex_unlock(&pd->m);
+        return -1;
+    }
+    uint32_t pte_f = pd->vmas.vmas[i].pte_f;
+    uint32_t pde_f = pd->vmas.vmas[i].pde_f;
+    vma_t *file = NULL;
+    for (; i < pd->vmas.size && pd->vmas.vmas[i].start <= last; i++){
+        vma_t *vma = &pd->vmas.vmas[i];
+        pte_f |= vma->pte_f & (SET << RW_FLAG_BIT);
+        if (vma->type == VMA_FILE && file == NULL) file = vma;
+        if (vma->type == VMA_SHARED){
+            /* segments are mapped in full when attached */
+            mutex_unlock(&pd->m);
+            return -6;
+        }
+    }
+    bool writable = (pte_f & (SET << RW_FLAG_BIT)) != 0;
+    uint32_t p_addr;
+
+#ifdef LARGE_USER_PAGES
+    vma_t *vma;
+    if (file == NULL && write && writable
+            && vma_set_find(&pd->vmas, v_addr, &vma) == 0
+            && vma->type == VMA_ANON
+            && page_in_large(pd, vma, v_addr) == 0){
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+#endif
+
+    if (file == NULL && !(write && writable)){
+        /* reads of untouched anonymous memory see the zero frame */
+        if (writable){
+            pte_f = ADD_COW_FLAG((pte_f & ~(SET << RW_FLAG_BIT)));
+        }
+        if (pd_create_mapping(pd, v_addr, pd_get_zero_frame(),
+                    pte_f, pde_f) < 0){
+            mutex_unlock(&pd->m);
+            return -3;
+        }
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+
+    /* read only pages can be shared with every other process running the
+     * same program */
+    bool shareable = (file != NULL && !writable);
+    /* anonymous pages have no file to take a position in */
+    uint32_t pos = shareable ? v_addr - file->start : 0;
+    if (shareable && pc_get(&pcache, file->src, pos, &p_addr) == 0){
+        if (pd_alloc_frame(pd, p_addr, 1) < 0){
+            pc_unref(&pcache, p_addr, 1);
+            mutex_unlock(&pd->m);
+            return -4;
+        }
+        if (pd_create_mapping(pd, v_addr, p_addr, pte_f, pde_f) < 0){
+            pd_release_frames(pd, p_addr, 1);
+            pc_unref(&pcache, p_addr, 1);
+            mutex_unlock(&pd->m);
+            return -5;
+        }
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+    frame_list_t runs;
+    if (fm_alloc_list_zeroed(&fm, 1, &runs) < 0){
+        mutex_unlock(&pd->m);
+        return -2;
+    }
+    if (pd_reserve_frames(pd, &runs) < 0){
+        fm_dealloc_list(&fm, &runs);
+        mutex_unlock(&pd->m);
+        return -2;
+    }
+    bool zeroed;
+    frame_iter_t it;
+    fm_iter_init(&it, &fm, &runs);
+    fm_iter_next(&it, &p_addr, &zeroed);
+    if (!zeroed) pd_zero_frame(p_addr);
+    /* map writable so that the kernel can fill it in */
+    if (pd_create_mapping(pd, v_addr, p_addr,
+                pte_f | (SET << RW_FLAG_BIT), pde_f) < 0){
+        fm_dealloc_list(&fm, &runs);
+        mutex_unlock(&pd->m);
+        return -3;
+    }
+    if (file != NULL){
+        pd_fill_file_page(pd, v_addr);
+        pd_protect_mapping(pd, v_addr, pte_f);
+    }
+    pd_alloc_frames(pd, &runs);
+    /* if this fails the page simply stays private */
+    if (shareable) pc_put(&pcache, file->src, pos, p_addr);
+    mutex_unlock(&pd->m);
+    return 0;
+}
+
+/** @brief Attempts to resolve a page fault in the active page directory
+ *
+ *  Touching a page of an area that is not mapped yet pages it in. Otherwise
+ *  only writes to copy-on-write pages are resolved. If the faulting page
+ *  is no longer shared it is simply made writable again, otherwise its
+ *  contents are copied into a newly allocated frame and the reference on the
+ *  shared frame is dropped.
+ *
+ *  @param pd The active page directory
+ *  @param addr The faulting address
+ *  @param error_code The error code pushed by the page fault
+ *  @return 0 if the fault was resolved, negative integer code otherwise
+ */
+int vmm_resolve_fault(page_directory_t *pd, uint32_t addr,
+        uint32_t error_code){
+    if (pd == NULL) return -1;
+    uint32_t v_addr = PAGE_ALIGN_DOWN(addr);
+    /* pages of areas are not mapped until they are touched */
+    if (!(error_code & PF_ERR_PRESENT)){
+        bool write = (error_code & PF_ERR_WRITE) != 0;
+        int ret = vmm_page_in(pd, v_addr, write);
+        /* touching just below a stack grows it */
+        if (ret == -1 && vmm_grow_stack(pd, addr) == 0)
+            ret = vmm_page_in(pd, v_addr, write);
+        return ret;
+    }
+    /* only writes to present pages can be copy-on-write faults */
+    if (!(error_code & PF_ERR_WRITE))
+        return -2;
+    uint32_t pte;
+
+    mutex_lock(&pd->m);
+    if (pd_get_mapping(pd, v_addr, &pte) < 0 || !IS_COW(pte)){
+        mutex_unlock(&pd->m);
+        return -3;
+    }
+    uint32_t p_addr = REMOVE_FLAGS(pte);
+    if (p_addr == pd_get_zero_frame()){
+        /* first write to a demand-zero page */
+        frame_list_t runs;
+        if (fm_alloc_list_zeroed(&fm, 1, &runs) < 0){
+            mutex_unlock(&pd->m);
+            return -5;
+        }
+        if (pd_reserve_frames(pd, &runs) < 0){
+            fm_dealloc_list(&fm, &runs);
+            mutex_unlock(&pd->m);
+            return -6;
+        }
+        frame_iter_t it;
+        bool zeroed;
+        fm_iter_init(&it, &fm, &runs);
+        fm_iter_next(&it, &p_addr, &zeroed);
+        if (pd_break_cow(pd, v_addr, p_addr) < 0){
+            fm_dealloc_list(&fm, &runs);
+            mutex_unlock(&pd->m);
+            return -7;
+        }
+        if (!zeroed) memset((void *)v_addr, 0, PAGE_SIZE);
+        pd_alloc_frames(pd, &runs);
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+    if (fm_refcount(&fm, p_addr) == 1){
+        /* nobody else references the frame anymore, take it over */
+        if (pd_break_cow(pd, v_addr, p_addr) < 0){
+            mutex_unlock(&pd->m);
+            return -4;
+        }
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+    uint32_t new_p_addr;
+    if (fm_alloc(&fm, 1, &new_p_addr) < 0){
+        mutex_unlock(&pd->m);
         return -5;
     }
+    if (pd_alloc_frame(pd, new_p_addr, 1) < 0){
+        fm_dealloc(&fm, new_p_addr);
+        mutex_unlock(&pd->m);
+        return -6;
+    }
+    if (pd_break_cow(pd, v_addr, new_p_addr) < 0){
+        pd_release_frames(pd, new_p_addr, 1);
+        fm_dealloc(&fm, new_p_addr);
+        mutex_unlock(&pd->m);
+        return -7;
+    }
+    /* drop our reference on the shared frame */
+    if (pd_release_frames(pd, p_addr, 1) == 0){
+        fm_unref(&fm, p_addr, 1);
+    }
+    mutex_unlock(&pd->m);
     return 0;
 }
 
 
+/** @brief Forgets the areas recorded for the first num_secs sections
+ *  @param pd The page directory
+ *  @param secs The array of memory sections
+ *  @param num_secs The number of sections to forget
+ *  @return Void
+ */
+void remove_section_areas(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs){
+    uint32_t i;
+    for (i = 0; i < num_secs; i++){
+        if (secs[i].len > 0)
+            vma_set_remove(&pd->vmas, secs[i].v_addr_start, NULL);
+    }
+}
+
+/** @brief Records every memory section as an area of a page directory
+ *  @param pd The page directory
+ *  @param secs The array of memory sections
+ *  @param num_secs The number of sections
+ *  @param type How the pages of the areas are backed
+ *  @return 0 on success, negative integer code on failure
+ */
+int add_section_areas(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs, int type){
+    uint32_t i;
+    for (i = 0; i < num_secs; i++){
+        if (secs[i].len == 0) continue;
+        vma_t vma;
+        vma_init(&vma, secs[i].v_addr_start, secs[i].len, secs[i].pte_f,
+                secs[i].pde_f, type);
+        if (vma_set_insert(&pd->vmas, &vma) < 0){
+            remove_section_areas(pd, secs, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** @brief Zeroes the frames of every block in a list that is not known to be
+ *         zeroed already
+ *  @param runs The list of blocks from fm_alloc_list_zeroed
+ *  @return Void
+ */
+void zero_dirty_runs(frame_list_t *runs){
+    frame_iter_t it;
+    uint32_t p_addr;
+    bool zeroed;
+    fm_iter_init(&it, &fm, runs);
+    while (fm_iter_next(&it, &p_addr, &zeroed) == 0){
+        if (!zeroed) pd_zero_frame(p_addr);
+    }
+}
+
 /** @brief Maps multiple memory sections into pd
  *
  *  Requires that sections that share the same page table have the same
- *  permissioning
+ *  permissioning. Every page that a section overlaps is given a zeroed frame
+ *  and is mapped writable so that the kernel is able to fill in the sections,
+ *  vmm_protect_sections should be called afterwards to apply each section's
+ *  page table flags.
  *
  *  @param pd The page directory to map to
  *  @param secs The array of memory sections
@@ -87,76 +493,207 @@ int vmm_map_sections(page_directory_t *pd, mem_section_t *secs,
         uint32_t num_secs) {
     if (pd == NULL || secs == NULL || num_secs == 0) return -1;
 
-    uint32_t v_addr_low, v_addr_high;
-    ms_get_bounding_addr(secs, num_secs, &v_addr_low, &v_addr_high);
+    /* pages between sections are left out */
+    uint32_t i, j, first, num_pages, total = 0;
+    for (i = 0; i < num_secs; i++){
+        ms_get_own_pages(secs, num_secs, i, &first, &num_pages);
+        total += num_pages;
+    }
+    if (total == 0) return 0;
+
+    if (add_section_areas(pd, secs, num_secs, VMA_PRIVATE) < 0) return -2;
+
+    /* Allocate all the frames, which need not be contiguous */
+    frame_list_t runs;
+    if (fm_alloc_list_zeroed(&fm, total, &runs) < 0){
+        remove_section_areas(pd, secs, num_secs);
+        return -3;
+    }
+    if (pd_reserve_frames(pd, &runs) < 0){
+        fm_dealloc_list(&fm, &runs);
+        remove_section_areas(pd, secs, num_secs);
+        return -3;
+    }
+    zero_dirty_runs(&runs);
 
-    v_addr_low = PAGE_ALIGN_DOWN(v_addr_low);
-    v_addr_high = PAGE_ALIGN_UP(v_addr_high)-1;
+    /* map each section's pages to the next frames of the list */
+    frame_iter_t it;
+    fm_iter_init(&it, &fm, &runs);
+    for (i = 0; i < num_secs; i++){
+        ms_get_own_pages(secs, num_secs, i, &first, &num_pages);
+        if (pd_map_range(pd, first, num_pages, 0, &it,
+                    secs[i].pte_f | (SET << RW_FLAG_BIT), secs[i].pde_f) < 0){
+            /* roll back the sections mapped so far */
+            for (j = 0; j < i; j++){
+                ms_get_own_pages(secs, num_secs, j, &first, &num_pages);
+                pd_unmap_range(pd, first, num_pages);
+            }
+            fm_dealloc_list(&fm, &runs);
+            remove_section_areas(pd, secs, num_secs);
+            return -4;
+        }
+    }
+    /* Update PD's frame tracker */
+    pd_alloc_frames(pd, &runs);
+    return 0;
+}
 
-    uint32_t num_pages =((v_addr_high-v_addr_low)+1)/PAGE_SIZE;
-    if (num_pages == 0) return 0;
+/** @brief Applies the page table flags of multiple memory sections to pages
+ *         mapped by vmm_map_sections
+ *
+ *  A page shared by two sections gets the flags of the first one.
+ *
+ *  @param pd The page directory
+ *  @param secs The array of memory sections
+ *  @param num_secs The number of sections
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_protect_sections(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs) {
+    if (pd == NULL || secs == NULL || num_secs == 0) return -1;
 
-    /* check for enough frames */
-    uint32_t cur_addr = v_addr_low;
-    uint32_t p_addr;
+    uint32_t i, first, num_pages;
+    for (i = 0; i < num_secs; i++){
+        ms_get_own_pages(secs, num_secs, i, &first, &num_pages);
+        /* demand-zero pages are not mapped, so they are skipped */
+        if (pd_protect_range(pd, first, num_pages, secs[i].pte_f) < 0){
+            return -2;
+        }
+    }
+    return 0;
+}
+
+
+/** @brief Registers a memory section whose pages are filled in from a file
+ *         the first time they are touched
+ *
+ *  @param pd The page directory
+ *  @param ms The memory section
+ *  @param src The bytes of the file backing the section
+ *  @param src_len The number of bytes available at src
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_map_file_section(page_directory_t *pd, mem_section_t *ms,
+        const char *src, uint32_t src_len){
+    if (pd == NULL || ms == NULL || (src == NULL && src_len > 0)) return -1;
+    if (ms->len == 0) return 0;
+    vma_t vma;
+    vma_init(&vma, ms->v_addr_start, ms->len, ms->pte_f, ms->pde_f, VMA_FILE);
+    vma.src = src;
+    vma.src_len = src_len > ms->len ? ms->len : src_len;
+    if (vma_set_insert(&pd->vmas, &vma) < 0) return -2;
+    return 0;
+}
 
-    /* Allocate all the frames */
-    if (fm_alloc(&fm, num_pages, &p_addr) < 0){
+/** @brief Registers multiple memory sections as demand-zero memory
+ *
+ *  No pages are mapped, each page gets a frame the first time it is touched
+ *  (see vmm_page_in).
+ *
+ *  @param pd The page directory to map to
+ *  @param secs The array of memory sections
+ *  @param num_secs The number of sections to map
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_map_zero_sections(page_directory_t *pd, mem_section_t *secs,
+        uint32_t num_secs){
+    if (pd == NULL || secs == NULL || num_secs == 0) return -1;
+    if (add_section_areas(pd, secs, num_secs, VMA_ANON) < 0) return -2;
+    return 0;
+}
+
+/** @brief Lets the area that starts at an address grow down
+ *
+ *  @param pd The page directory
+ *  @param start The page aligned address the area starts at
+ *  @param limit The page aligned lowest address the area may grow down to
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_set_grows_down(page_directory_t *pd, uint32_t start, uint32_t limit){
+    if (pd == NULL || !IS_PAGE_ALIGNED(start) || !IS_PAGE_ALIGNED(limit)
+            || limit < USER_MEM_START || limit > start) return -1;
+    vma_t *vma;
+    mutex_lock(&pd->m);
+    if (vma_set_find(&pd->vmas, start, &vma) < 0 || vma->start != start
+            || vma->type == VMA_FILE || vma->type == VMA_SHARED){
+        mutex_unlock(&pd->m);
         return -2;
     }
-    /* Update PD's frame tracker */
-    if (pd_alloc_frame(pd, p_addr, num_pages) < 0){
-        fm_dealloc(&fm, p_addr);
+    vma->grow_limit = limit;
+    mutex_unlock(&pd->m);
+    return 0;
+}
+
+/** @brief Grows the grow-down area right above an address down to it
+ *
+ *  addr may lie at most VMM_STACK_REACH_PAGES pages below the area. The area
+ *  grows by VMM_STACK_GROWTH_PAGES pages, or by as many as it takes to cover
+ *  addr, but never past its limit or into the area below it. A stack is
+ *  written to as soon as it grows, so the new pages are mapped to zeroed
+ *  frames right away rather than faulting in one by one.
+ *
+ *  @param pd The page directory
+ *  @param addr The address that was touched
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_grow_stack(page_directory_t *pd, uint32_t addr){
+    if (pd == NULL) return -1;
+    uint32_t i, page = PAGE_ALIGN_DOWN(addr);
+    mutex_lock(&pd->m);
+    /* the first area that ends at or after addr */
+    if (vma_set_first_overlap(&pd->vmas, page, 0xFFFFFFFF, &i) < 0){
+        mutex_unlock(&pd->m);
+        return -2;
+    }
+    vma_t *vma = &pd->vmas.vmas[i];
+    if (vma->start <= page){
+        /* another thread grew it already */
+        mutex_unlock(&pd->m);
+        return 0;
+    }
+    if (vma->grow_limit == 0 || page < vma->grow_limit
+            || vma->start - page > VMM_STACK_REACH_PAGES * PAGE_SIZE){
+        mutex_unlock(&pd->m);
         return -3;
     }
 
-    /* map each page to the corresponding physical page */
-    int i;
-    uint32_t p_addr_start = p_addr;
-    if (pd_begin_mapping(pd) < 0){
-        fm_dealloc(&fm, p_addr_start);
-        pd_dealloc_frame(pd, p_addr_start, NULL);
-        return -3;
+    uint32_t step = VMM_STACK_GROWTH_PAGES * PAGE_SIZE;
+    uint32_t new_start = (vma->start - page > step) ? page : vma->start - step;
+    if (new_start < vma->grow_limit) new_start = vma->grow_limit;
+    if (i > 0){
+        /* stay clear of the pages of the area below */
+        uint32_t floor = PAGE_ALIGN_UP(VMA_LAST(&pd->vmas.vmas[i-1]) + 1);
+        if (new_start < floor) new_start = floor;
     }
-    for (i = 0; i < num_pages; i++){
-        uint32_t pte_f, pde_f;
-        mem_section_t *ms = NULL;
-        if (ms_get_bounding_section(secs, num_secs, cur_addr,
-                    cur_addr + (PAGE_SIZE-1), &ms) < 0){
-            pd_abort_mapping(pd);
-            fm_dealloc(&fm, p_addr_start);
-            pd_dealloc_frame(pd, p_addr_start, NULL);
-            return -3;
-        }
-        if (ms == NULL){
-            /* a page does not belong to any memory section,
-             * but is bounded by v_addr_high and v_addr_low so it should
-             * be mapped to read only */
-            pte_f = PTE_FLAG_DEFAULT;
-            pde_f = PDE_FLAG_DEFAULT;
-        } else {
-            /* retrieve memory section's flags */
-            pte_f = ms->pte_f;
-            pde_f = ms->pde_f;
-        }
-        /* create the mapping */
-        if (pd_create_mapping(pd, cur_addr, p_addr,
-                    pte_f, pde_f) < 0){
-            pd_abort_mapping(pd);
-            fm_dealloc(&fm, p_addr_start);
-            pd_dealloc_frame(pd, p_addr_start, NULL);
-            return -4;
-        }
-        cur_addr += PAGE_SIZE;
-        p_addr += PAGE_SIZE;
+    if (new_start > page){
+        mutex_unlock(&pd->m);
+        return -4;
     }
-    pd_commit_mapping(pd);
-    /* zero out newly mapped memory */
-    memset((void *)v_addr_low, 0, num_pages*PAGE_SIZE/sizeof(void*));
+
+    uint32_t num_pages = (vma->start - new_start) / PAGE_SIZE;
+    frame_list_t runs;
+    if (fm_alloc_list_zeroed(&fm, num_pages, &runs) < 0
+            || pd_reserve_frames(pd, &runs) < 0){
+        fm_dealloc_list(&fm, &runs);
+        mutex_unlock(&pd->m);
+        return -5;
+    }
+    zero_dirty_runs(&runs);
+    frame_iter_t it;
+    fm_iter_init(&it, &fm, &runs);
+    if (pd_map_range(pd, new_start, num_pages, 0, &it, vma->pte_f,
+                vma->pde_f) < 0){
+        fm_dealloc_list(&fm, &runs);
+        mutex_unlock(&pd->m);
+        return -6;
+    }
+    pd_alloc_frames(pd, &runs);
+    vma->len += vma->start - new_start;
+    vma->start = new_start;
+    mutex_unlock(&pd->m);
     return 0;
 }
 
-
 /** @brief Attempts to allocate a new user space page
  *
  *  Will return negative integer code if pd is NULL, if num_pages is something
@@ -164,7 +701,8 @@ int vmm_map_sections(page_directory_t *pd, mem_section_t *secs,
  *
  *  Requires base is page aligned
  *
- *  Uses non-x86 9th flag bit to signifiy that it is removeable
+ *  The pages are recorded as a removable area, so no pages are mapped and no
+ *  frames are allocated until the pages are touched (see vmm_page_in)
  *
  *  @param pd The page directory
  *  @param base The starting address to allocate from
@@ -174,124 +712,279 @@ int vmm_map_sections(page_directory_t *pd, mem_section_t *secs,
 int vmm_new_user_page(page_directory_t *pd, uint32_t base, uint32_t num_pages){
     if (pd == NULL || num_pages == 0 || num_pages > 0xFFFF)
         return -1;
-    uint32_t v_addr = base;
-    uint32_t i;
     /* check for overflow */
     if (base + (num_pages * PAGE_SIZE) - 1 < base){
         return -2;
     }
+    vma_t vma;
+    vma_init(&vma, base, num_pages * PAGE_SIZE, USER_WR, USER_WR, VMA_ANON);
+    vma.removable = true;
 
-    /* check for overlapping regions of memeory */
-    for (i = 0; i < num_pages; i++){
-        if (pd_get_mapping(pd, v_addr, NULL) == 0){
-            return -3;
-        }
-        v_addr += PAGE_SIZE;
+    /* the area is only added if it overlaps no other area */
+    mutex_lock(&pd->m);
+    if (vma_set_overlaps(&pd->vmas, base, VMA_LAST(&vma))){
+        mutex_unlock(&pd->m);
+        return -3;
     }
-    /* allocate frames and create the mapping */
-    uint32_t p_addr;
-    if (fm_alloc(&fm, num_pages, &p_addr) < 0){
-        return -2;
+    if (vma_set_insert(&pd->vmas, &vma) < 0){
+        mutex_unlock(&pd->m);
+        return -4;
     }
-    if (pd_alloc_frame(pd, p_addr, num_pages) < 0){
-        fm_dealloc(&fm, p_addr);
-        return -3;
+    mutex_unlock(&pd->m);
+    return 0;
+}
+/** @brief Gives back frames of an area whose pages were just unmapped
+ *  @param pd The page directory
+ *  @param vma The area
+ *  @param p_addr The physical address of the first frame
+ *  @param num_pages The number of frames, which may be 0
+ *  @return Void
+ */
+void release_area_frames(page_directory_t *pd, vma_t *vma, uint32_t p_addr,
+        uint32_t num_pages){
+    if (num_pages == 0 || pd_release_frames(pd, p_addr, num_pages) < 0)
+        return;
+    if (vma->type == VMA_FILE){
+        pc_unref(&pcache, p_addr, num_pages);
+    } else {
+        fm_unref(&fm, p_addr, num_pages);
     }
+}
 
-    v_addr = base;
-    uint32_t p_addr_start = p_addr;
+/** @brief Removes user pages created by vmm_new_user_page or vmm_map_file
+ *
+ *  The area recorded by vmm_new_user_page tells us both that base is in fact
+ *  the beginning of a new_pages allocation and how long it is. Only the pages
+ *  that were touched since are mapped.
+ *
+ *  @param pd The page directory
+ *  @param base The base address of the page to be deallocated
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_remove_user_page(page_directory_t *pd, uint32_t base){
+    if (pd == NULL || base < USER_MEM_START || !IS_PAGE_ALIGNED(base))
+        return -1;
+    vma_t *vma;
 
-    if (pd_begin_mapping(pd) < 0){
-        fm_dealloc(&fm, p_addr_start);
-        pd_dealloc_frame(pd, p_addr_start, NULL);
-        return -4;
+    mutex_lock(&pd->m);
+    /* check to ensure that base is the start of a new_pages allocation */
+    if (vma_set_find(&pd->vmas, base, &vma) < 0 || vma->start != base
+            || !vma->removable){
+        mutex_unlock(&pd->m);
+        return -2;
     }
-    for (i = 0; i < num_pages; i++){
-        uint32_t pte_f = USER_WR;
-        uint32_t pde_f = USER_WR;
-        /* add custom flags to denote start and stop of a user allocated
-         * page table entry */
-        if (i == 0){
-            pte_f = ADD_USER_START_FLAG(pte_f);
-        }
-        if (i == num_pages-1){
-            pte_f = ADD_USER_END_FLAG(pte_f);
+    uint32_t i, num_pages = vma->len / PAGE_SIZE;
+    uint32_t v_addr = base;
+    /* frames that follow each other are given back in one go */
+    uint32_t run_addr = 0, run_pages = 0;
+    for (i = 0; i < num_pages; i++, v_addr += PAGE_SIZE){
+        uint32_t pte;
+        if (pd_get_large_mapping(pd, v_addr, &pte) == 0){
+            /* large pages lie wholly inside the area and are never copied
+             * on write, since fork splits them */
+            uint32_t p_addr = REMOVE_LARGE_FLAGS(pte);
+            pd_remove_large(pd, v_addr);
+            release_area_frames(pd, vma, p_addr, LARGE_PAGE_PAGES);
+            i += LARGE_PAGE_PAGES - 1;
+            v_addr += LARGE_PAGE_SIZE - PAGE_SIZE;
+            continue;
         }
-        if (pd_create_mapping(pd, v_addr, p_addr, pte_f, pde_f) < 0){
-            pd_abort_mapping(pd);
-            pd_dealloc_frame(pd, p_addr_start, NULL);
-            fm_dealloc(&fm, p_addr_start);
-            return -4;
+        if (pd_get_mapping(pd, v_addr, &pte) < 0) continue;
+        uint32_t p_addr = REMOVE_FLAGS(pte);
+        /* remove mapping */
+        pd_remove_mapping(pd, v_addr);
+        /* flush mapping in tlb */
+        flush_tlb(v_addr);
+        /* pages may have been copied on write since they were allocated, so
+         * their frames need not follow each other. Pages that were never
+         * written to and pages of the RAM disk live in kernel memory and
+         * have no frame of their own */
+        if (p_addr < USER_MEM_START) continue;
+        if (p_addr == run_addr + run_pages * PAGE_SIZE){
+            run_pages++;
+            continue;
         }
+        release_area_frames(pd, vma, run_addr, run_pages);
+        run_addr = p_addr;
+        run_pages = 1;
+    }
+    release_area_frames(pd, vma, run_addr, run_pages);
+    vma_set_remove(&pd->vmas, base, NULL);
+    mutex_unlock(&pd->m);
+    return 0;
+}
 
-        v_addr += PAGE_SIZE;
-        p_addr += PAGE_SIZE;
+/** @brief Maps a file of the RAM disk read only into user space
+ *
+ *  The file is recorded as a removable file backed area, so remove_pages
+ *  unmaps it. If the file's bytes start on a page boundary, every whole page
+ *  of the file is mapped straight to the RAM disk page holding it, which lives
+ *  in the kernel's direct map forever. The remaining pages, including a last
+ *  page that the file only partly fills, are paged in on first touch through
+ *  the page cache and thus shared with every other process mapping the file.
+ *
+ *  @param pd The page directory
+ *  @param base The page aligned address to map the file at
+ *  @param src The bytes of the file
+ *  @param len The length of the file in bytes
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_map_file(page_directory_t *pd, uint32_t base, const char *src,
+        uint32_t len){
+    if (pd == NULL || src == NULL || len == 0 || base < USER_MEM_START
+            || !IS_PAGE_ALIGNED(base))
+        return -1;
+    uint32_t num_pages = (len - 1) / PAGE_SIZE + 1;
+    /* check for overflow */
+    if (base + (num_pages * PAGE_SIZE) - 1 < base){
+        return -2;
+    }
+    vma_t vma;
+    vma_init(&vma, base, num_pages * PAGE_SIZE, USER_RO, USER_WR, VMA_FILE);
+    vma.src = src;
+    vma.src_len = len;
+    vma.removable = true;
+    /* the kernel is direct mapped, so its addresses are physical ones */
+    uint32_t direct = IS_PAGE_ALIGNED((uint32_t)src) ? len / PAGE_SIZE : 0;
+
+    mutex_lock(&pd->m);
+    if (vma_set_overlaps(&pd->vmas, base, VMA_LAST(&vma))){
+        mutex_unlock(&pd->m);
+        return -3;
+    }
+    if (direct > 0 && pd_map_range(pd, base, direct, (uint32_t)src, NULL,
+                USER_RO, USER_WR) < 0){
+        mutex_unlock(&pd->m);
+        return -4;
+    }
+    if (vma_set_insert(&pd->vmas, &vma) < 0){
+        pd_unmap_range(pd, base, direct);
+        mutex_unlock(&pd->m);
+        return -5;
     }
-    pd_commit_mapping(pd);
-    memset((void *)base, 0, num_pages*PAGE_SIZE);
+    mutex_unlock(&pd->m);
     return 0;
 }
-/** @brief Removes user pages created by vmm_new_user_page
+
+/** @brief Maps the shared memory segment with a given key into user space
  *
- *  We know about how long each page is due to the flags set by
- *  vmm_new_user_page. Therefore, we can use these flags to ensure that the
- *  address given to us is in fact the beginning of a new user page and it also
- *  tells us when to stop removing pages.
+ *  The segment is created with zeroed frames if no process has it attached.
+ *  Otherwise it must be num_pages long. Every page of the segment is mapped
+ *  writable right away and recorded as a shared area.
  *
  *  @param pd The page directory
- *  @param base The base address of the page to be deallocated
+ *  @param key The key of the segment
+ *  @param base The page aligned address to map the segment at
+ *  @param num_pages The number of pages of the segment
  *  @return 0 on success, negative integer code on failure
  */
-int vmm_remove_user_page(page_directory_t *pd, uint32_t base){
-    if (pd == NULL || base < USER_MEM_START || !IS_PAGE_ALIGNED(base))
+int vmm_shm_attach(page_directory_t *pd, int key, uint32_t base,
+        uint32_t num_pages){
+    if (pd == NULL || base < USER_MEM_START || !IS_PAGE_ALIGNED(base)
+            || num_pages == 0 || num_pages > SHM_MAX_PAGES)
         return -1;
-    uint32_t pte = 0;
-    /* check to see if base is mapped */
-    if (pd_get_mapping(pd, base, &pte) < 0){
+    /* check for overflow */
+    if (base + (num_pages * PAGE_SIZE) - 1 < base){
         return -2;
     }
-    /* check to ensure that said page table is the start of a new_pages
-     * allocation */
-    if (!IS_USER_START(pte)){
+    vma_t vma;
+    vma_init(&vma, base, num_pages * PAGE_SIZE, USER_WR, USER_WR, VMA_SHARED);
+
+    mutex_lock(&pd->m);
+    if (vma_set_overlaps(&pd->vmas, base, VMA_LAST(&vma))){
+        mutex_unlock(&pd->m);
         return -3;
     }
-    /* go through all the addresses until we get an address that signifies
-     * the end of a user new_pages */
-    uint32_t v_addr = base;
-    uint32_t p_addr_base = REMOVE_FLAGS(pte);
-    pte = 0;
-
-    pd_begin_mapping(pd);
-    do {
-        if (v_addr - PAGE_SIZE > v_addr)
-            panic("Overflowed while deallocating stack space!!");
-        /* get the mapping so we can check if we're done */
-        pd_get_mapping(pd, v_addr, &pte);
-        /* remove mapping */
-        if (pd_remove_mapping(pd, v_addr) < 0){
-            pd_abort_mapping(pd);
-            return -4;
-        }
-        /* flush mapping in tlb */
-        flush_tlb((uint32_t)v_addr);
-        /* give frame back to frame manager */
-        v_addr += PAGE_SIZE;
-    } while (!IS_USER_END(pte));
-
-    uint32_t frame_size;
-    if (pd_dealloc_frame(pd, p_addr_base, &frame_size) < 0){
-        pd_abort_mapping(pd);
+    if (shm_get(&shmtab, key, num_pages, &vma.seg) < 0){
+        mutex_unlock(&pd->m);
+        return -4;
+    }
+    frame_iter_t it;
+    fm_iter_init(&it, &fm, &vma.seg->runs);
+    if (pd_map_range(pd, base, num_pages, 0, &it, USER_WR, USER_WR) < 0){
+        shm_put(&shmtab, vma.seg);
+        mutex_unlock(&pd->m);
         return -5;
     }
-    if (fm_dealloc(&fm, p_addr_base) < 0){
-        pd_alloc_frame(pd, p_addr_base, frame_size);
-        pd_abort_mapping(pd);
+    if (vma_set_insert(&pd->vmas, &vma) < 0){
+        pd_unmap_range(pd, base, num_pages);
+        flush_all_tlb();
+        shm_put(&shmtab, vma.seg);
+        mutex_unlock(&pd->m);
         return -6;
     }
-    pd_commit_mapping(pd);
+    mutex_unlock(&pd->m);
     return 0;
 }
 
+/** @brief Unmaps a shared memory segment attached by vmm_shm_attach
+ *
+ *  The segment is torn down if no other area maps it anymore.
+ *
+ *  @param pd The page directory
+ *  @param base The address the segment was attached at
+ *  @return 0 on success, negative integer code on failure
+ */
+int vmm_shm_detach(page_directory_t *pd, uint32_t base){
+    if (pd == NULL || base < USER_MEM_START || !IS_PAGE_ALIGNED(base))
+        return -1;
+    vma_t vma, *found;
+    mutex_lock(&pd->m);
+    /* check to ensure that base is where a segment was attached */
+    if (vma_set_find(&pd->vmas, base, &found) < 0 || found->start != base
+            || found->type != VMA_SHARED){
+        mutex_unlock(&pd->m);
+        return -2;
+    }
+    vma_set_remove(&pd->vmas, base, &vma);
+    pd_unmap_range(pd, base, vma.len / PAGE_SIZE);
+    flush_all_tlb();
+    mutex_unlock(&pd->m);
+    shm_put(&shmtab, vma.seg);
+    return 0;
+}
+
+/** @brief Checks that a range of user memory may be accessed on behalf of
+ *         the process
+ *
+ *  The range must be covered by user areas without gaps, and by writable ones
+ *  if it is to be written. Pages need not be mapped yet, touching them from
+ *  the kernel faults them in like it would from user mode.
+ *
+ *  @param pd The page directory
+ *  @param addr The first address of the range
+ *  @param len The length of the range in bytes
+ *  @param write Whether the range is going to be written to
+ *  @return 0 if the range may be accessed, negative integer code otherwise
+ */
+int vmm_check_user_range(page_directory_t *pd, uint32_t addr, uint32_t len,
+        bool write){
+    if (pd == NULL || len == 0) return -1;
+    uint32_t last = addr + (len - 1);
+    if (last < addr) return -2;
+    uint32_t i, cur = addr;
+    mutex_lock(&pd->m);
+    if (vma_set_first_overlap(&pd->vmas, addr, last, &i) < 0){
+        mutex_unlock(&pd->m);
+        return -3;
+    }
+    for (; i < pd->vmas.size; i++){
+        vma_t *vma = &pd->vmas.vmas[i];
+        if (vma->start > cur
+                || !(vma->pte_f & (SET << MODE_FLAG_BIT))
+                || (write && !(vma->pte_f & (SET << RW_FLAG_BIT)))){
+            break;
+        }
+        if (VMA_LAST(vma) >= last){
+            mutex_unlock(&pd->m);
+            return 0;
+        }
+        cur = VMA_LAST(vma) + 1;
+    }
+    mutex_unlock(&pd->m);
+    return -4;
+}
+
 /** @brief Completely removes the user space of a page directory
  *
  *  Deallocates all frames from the page directory, returns the frames to the
@@ -303,26 +996,47 @@ int vmm_remove_user_page(page_directory_t *pd, uint32_t base){
  */
 int vmm_clear_user_space(page_directory_t *pd){
     uint32_t i;
+    frame_run_t *runs = pd->frames.runs;
 
-    int num_frames = pd_num_frames(pd);
-    uint32_t frames[num_frames];
-    uint32_t sizes[num_frames];
-
-    pd_dealloc_all_frames(pd, frames, sizes);
-
-    /* Note: I have not implemented any way to undo fm_dealloc calls so no
+    /* Note: I have not implemented any way to undo fm_unref calls so no
      * errors are for here. If a frame is unable to be deallocated into the
      * frame manager, it is still possible for the kernel to keep running albeit
      * with less pages avaliable */
-    for (i = 0; i < num_frames; i++){
-        fm_dealloc(&fm, frames[i]);
+    for (i = 0; i < pd->frames.size; i++){
+        pc_unref(&pcache, runs[i].p_addr, runs[i].num_pages);
     }
+    pd_dealloc_all_frames(pd);
 
-    /* deallocate all frames from page directory; use the resulting list
-     * to update the frame manager */
+    /* remove all mappings from the page directory */
     pd_clear_user_space(pd);
     /* flush all mapping in tlb */
     flush_all_tlb();
 
+    /* segments are only dropped once nothing maps their frames anymore */
+    for (i = 0; i < pd->vmas.size; i++){
+        if (pd->vmas.vmas[i].type == VMA_SHARED)
+            shm_put(&shmtab, pd->vmas.vmas[i].seg);
+    }
+    vma_set_clear(&pd->vmas);
     return 0;
 }
+
+/** @brief Zeroes up to num_frames free frames for the frame manager's clean
+ *         pool, and free page table pages with the rest
+ *
+ *  Meant to be called from the timer handler while the idle thread is
+ *  running, so it must be called with interrupts disabled and never blocks.
+ *
+ *  @param num_frames The maximum number of frames to zero
+ *  @return The number of frames zeroed
+ */
+int vmm_zero_idle_frames(uint32_t num_frames){
+    uint32_t i, p_addr;
+    for (i = 0; i < num_frames; i++){
+        if (fm_get_dirty_frame(&fm, &p_addr) < 0) break;
+        pd_zero_frame(p_addr);
+        fm_put_clean_frame(&fm, p_addr);
+    }
+    /* spend whatever is left on pages for page tables */
+    return i + ptp_zero_idle(&ptpool, num_frames - i);
+}
@@ -0,0 +1,207 @@
+/** @file vm_area.c
+ *  @brief Implements the set of virtual memory areas of an address space
+ *
+ *  Every range of user memory that a process may touch is described by an
+ *  area: where it is, what its permissions are and how its pages get frames.
+ *  The areas of an address space never overlap, so we keep them in an array
+ *  sorted by address. Sorted by start address, they are also sorted by last
+ *  address, which lets every lookup binary search for the first area that
+ *  ends at or after an address. Lookups are then O(log n) in the number of
+ *  areas, and inserting or removing an area only shifts the areas after it,
+ *  which for the handful of areas a process has is cheaper than keeping a
+ *  balanced tree.
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <vm_area.h>
+
+/** @brief Finds the first area of a set that ends at or after an address
+ *  @param set The set
+ *  @param addr The address
+ *  @return The index of the area, or the size of the set if there is none
+ */
+uint32_t vma_lower_bound(vma_set_t *set, uint32_t addr){
+    uint32_t low = 0, high = set->size;
+    while (low < high){
+        uint32_t mid = low + (high - low) / 2;
+        if (VMA_LAST(&set->vmas[mid]) < addr){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/** @brief Initializes an area that is not backed by a file and may not be
+ *         removed
+ *  @param vma The area
+ *  @param start The virtual address the area starts at
+ *  @param len The length of the area in bytes
+ *  @param pte_f The page table entry flags of the area's pages
+ *  @param pde_f The page directory entry flags of the area's pages
+ *  @param type How the area's pages are backed
+ *  @return 0 on success, -1 on failure
+ */
+int vma_init(vma_t *vma, uint32_t start, uint32_t len, uint32_t pte_f,
+        uint32_t pde_f, int type){
+    if (vma == NULL) return -1;
+    vma->start = start;
+    vma->len = len;
+    vma->pte_f = pte_f;
+    vma->pde_f = pde_f;
+    vma->type = type;
+    vma->removable = false;
+    vma->src = NULL;
+    vma->src_len = 0;
+    vma->grow_limit = 0;
+    vma->seg = NULL;
+    return 0;
+}
+
+/** @brief Initializes an empty set of areas
+ *  @param set The set
+ *  @return 0 on success, negative integer code on failure
+ */
+int vma_set_init(vma_set_t *set){
+    if (set == NULL) return -1;
+    set->vmas = malloc(VMA_SET_INIT_CAP * sizeof(vma_t));
+    if (set->vmas == NULL) return -2;
+    set->size = 0;
+    set->cap = VMA_SET_INIT_CAP;
+    return 0;
+}
+
+/** @brief Adds a copy of an area to a set
+ *  @param set The set
+ *  @param vma The area
+ *  @return 0 on success, negative integer code on failure or if the area
+ *          overlaps one already in the set
+ */
+int vma_set_insert(vma_set_t *set, vma_t *vma){
+    if (set == NULL || vma == NULL || vma->len == 0) return -1;
+    /* the area may not wrap around the address space */
+    if (VMA_LAST(vma) < vma->start) return -2;
+    uint32_t i = vma_lower_bound(set, vma->start);
+    if (i < set->size && set->vmas[i].start <= VMA_LAST(vma)) return -3;
+    if (set->size == set->cap){
+        vma_t *vmas = realloc(set->vmas, 2 * set->cap * sizeof(vma_t));
+        if (vmas == NULL) return -4;
+        set->vmas = vmas;
+        set->cap *= 2;
+    }
+    memmove(&set->vmas[i+1], &set->vmas[i], (set->size - i) * sizeof(vma_t));
+    set->vmas[i] = *vma;
+    set->size++;
+    return 0;
+}
+
+/** @brief Removes the area that starts at an address from a set
+ *  @param set The set
+ *  @param start The start address of the area
+ *  @param vma Where to store the removed area (optional)
+ *  @return 0 on success, negative integer code if no area starts at start
+ */
+int vma_set_remove(vma_set_t *set, uint32_t start, vma_t *vma){
+    if (set == NULL) return -1;
+    uint32_t i = vma_lower_bound(set, start);
+    if (i == set->size || set->vmas[i].start != start) return -2;
+    if (vma != NULL) *vma = set->vmas[i];
+    set->size--;
+    memmove(&set->vmas[i], &set->vmas[i+1], (set->size - i) * sizeof(vma_t));
+    return 0;
+}
+
+/** @brief Finds the area of a set that contains an address
+ *
+ *  The area returned is only valid until the set is next modified.
+ *
+ *  @param set The set
+ *  @param addr The address
+ *  @param vma Where to store the area (optional)
+ *  @return 0 if an area was found, negative integer code otherwise
+ */
+int vma_set_find(vma_set_t *set, uint32_t addr, vma_t **vma){
+    if (set == NULL) return -1;
+    uint32_t i = vma_lower_bound(set, addr);
+    if (i == set->size || set->vmas[i].start > addr) return -2;
+    if (vma != NULL) *vma = &set->vmas[i];
+    return 0;
+}
+
+/** @brief Finds the first area of a set that overlaps a range of addresses
+ *
+ *  The following areas that overlap the range are the ones after it in the
+ *  set up until the first area that starts after high.
+ *
+ *  @param set The set
+ *  @param low The first address of the range
+ *  @param high The last address of the range
+ *  @param idx Where to store the index of the area
+ *  @return 0 if an area was found, negative integer code otherwise
+ */
+int vma_set_first_overlap(vma_set_t *set, uint32_t low, uint32_t high,
+        uint32_t *idx){
+    if (set == NULL || idx == NULL || high < low) return -1;
+    uint32_t i = vma_lower_bound(set, low);
+    if (i == set->size || set->vmas[i].start > high) return -2;
+    *idx = i;
+    return 0;
+}
+
+/** @brief Checks whether any area of a set overlaps a range of addresses
+ *  @param set The set
+ *  @param low The first address of the range
+ *  @param high The last address of the range
+ *  @return true if an area overlaps the range, false otherwise
+ */
+bool vma_set_overlaps(vma_set_t *set, uint32_t low, uint32_t high){
+    uint32_t i;
+    return (vma_set_first_overlap(set, low, high, &i) == 0);
+}
+
+/** @brief Copies every area of one set into another, empty, set
+ *  @param dest The set to copy to
+ *  @param src The set to copy from
+ *  @return 0 on success, negative integer code on failure
+ */
+int vma_set_copy(vma_set_t *dest, vma_set_t *src){
+    if (dest == NULL || src == NULL || dest->size > 0) return -1;
+    if (dest->cap < src->size){
+        vma_t *vmas = realloc(dest->vmas, src->cap * sizeof(vma_t));
+        if (vmas == NULL) return -2;
+        dest->vmas = vmas;
+        dest->cap = src->cap;
+    }
+    memcpy(dest->vmas, src->vmas, src->size * sizeof(vma_t));
+    dest->size = src->size;
+    return 0;
+}
+
+/** @brief Removes every area from a set
+ *  @param set The set
+ *  @return Void
+ */
+void vma_set_clear(vma_set_t *set){
+    if (set == NULL) return;
+    set->size = 0;
+}
+
+/** @brief Destroys a set of areas
+ *  @param set The set
+ *  @return Void
+ */
+void vma_set_destroy(vma_set_t *set){
+    if (set == NULL) return;
+    free(set->vmas);
+    set->vmas = NULL;
+    set->size = 0;
+    set->cap = 0;
+}
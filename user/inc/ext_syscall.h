@@ -0,0 +1,21 @@
+/** @file ext_syscall.h
+ *  @brief Specifies the stubs of our system calls that are not part of the
+ *         Pebbles specification
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _EXT_SYSCALL_H_
+#define _EXT_SYSCALL_H_
+
+#include <ext_syscall_int.h>
+
+int spawn(char *execname, char *argvec[]);
+int shm_attach(int key, void *base, int len);
+int shm_detach(void *base);
+int map_file(char *filename, void *base);
+int set_priority(int prio);
+
+#endif /* _EXT_SYSCALL_H_ */
@@ -0,0 +1,26 @@
+/** @file ext_syscall_int.h
+ *  @brief Defines the interrupt numbers of our system calls that are not part
+ *         of the Pebbles specification
+ *
+ *  Must be kept in sync with kern/inc/ext_syscall_int.h
+ *
+ *  @author Christopher Wei (cjwei)
+ *  @author Aatish Nayak (aatishn)
+ *  @bug No known bugs.
+ */
+
+#ifndef _EXT_SYSCALL_INT_H_
+#define _EXT_SYSCALL_INT_H_
+
+/** @brief spawn: creates a child process running a program */
+#define SPAWN_INT 0x80
+/** @brief shm_attach: maps a shared memory segment */
+#define SHM_ATTACH_INT 0x81
+/** @brief shm_detach: unmaps a shared memory segment */
+#define SHM_DETACH_INT 0x82
+/** @brief map_file: maps a RAM disk file read only */
+#define MAP_FILE_INT 0x83
+/** @brief set_priority: sets the base priority of the invoking process */
+#define SET_PRIORITY_INT 0x84
+
+#endif /* _EXT_SYSCALL_INT_H_ */
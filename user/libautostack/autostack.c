@@ -21,6 +21,11 @@
  *  In the off chance thr_init is never called, we will have memory leaks:
  *  which is not okay, but I guess it happens.
  *
+ *  The kernel now grows the stack region itself, several pages at a time,
+ *  when a fault lands just below it. This handler therefore only sees faults
+ *  the kernel could not resolve, such as ones past the kernel's stack limit,
+ *  and stays as a fallback.
+ *
  *  @author Christopher Wei (cjwei), Aatish Nayak (aatishn)
  *  @bug No known bugs
  */
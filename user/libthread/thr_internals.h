@@ -23,6 +23,10 @@
 #define THR_STATUS_ZOMBIE 2
 /** @brief Denotes a thread is currently running or sleeping */
 #define THR_STATUS_ALIVE 0
+/** @brief Lowest address the kernel grows the parent thread's stack down to
+ *         (USER_STACK_LIMIT in kern/inc/loader.h), below which thread stacks
+ *         are placed */
+#define THR_STACK_LIMIT 0xff000000
 
 
 /** @brief Used to store metadata about a thread */
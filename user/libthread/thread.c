@@ -216,8 +216,10 @@ int thr_init( unsigned int size ){
     parent_stack_top =
         (void*)((uint32_t) esp_reg - ((uint32_t) esp_reg % PAGE_SIZE));
 
-    /* Allocate stack space for parent */
-    if(new_thr_page(parent_stack_top, thread_stack_size) < 0) return -1;
+    /* The kernel grows the parent's stack as it is touched, as far down as
+     * THR_STACK_LIMIT. Thread stacks go below that, so that new_pages is
+     * never asked for pages the stack has already grown over */
+    STACK_BOTTOM = (void *)THR_STACK_LIMIT;
 
     /* Init global thread pool and associated rwlock */
     ll_init(&thread_pool);
@@ -261,7 +263,7 @@ int thr_create( void *(*func)(void *), void *args ){
                             (void *)THR_STATUS_DEAD, (void**) &dead_thread);
         if (found < 0){
             /* if nothing found, calculate new_esp and break */
-            new_esp = (void*) (parent_stack_top - thread_pool.size * \
+            new_esp = (void*) (THR_STACK_LIMIT - (thread_pool.size - 1) * \
                            thread_stack_size);
             break;
         }
@@ -0,0 +1,81 @@
+/** @file test_map_file.c
+ *  @author Christopher Wei
+ *  @brief Tests that map_file gives the same bytes as readfile, wherever the
+ *         file is mapped, and that remove_pages unmaps it
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <ext_syscall.h>
+#include <simics.h>    /* for lprintf */
+
+#define FILE "shrek.txt"
+#define BASE ((char *)0x40000000)
+#define OTHER_BASE ((char *)0x50000000)
+
+char buf[4 * PAGE_SIZE];
+
+/** @brief Checks a mapping of FILE against what readfile reads
+ *  @param base Where the file is mapped
+ *  @param len The length of the file
+ *  @return 0 if they match, -1 otherwise
+ */
+int check_mapping(char *base, int len) {
+    int i;
+    for (i = 0; i < len; i++) {
+        if (base[i] != buf[i]) return -1;
+    }
+    /* the rest of the last page is zeroes */
+    for (; i % PAGE_SIZE != 0; i++) {
+        if (base[i] != 0) return -1;
+    }
+    return 0;
+}
+
+/* Main */
+int main() {
+    int len = readfile(FILE, buf, sizeof(buf), 0);
+    if (len <= 0) {
+        lprintf("failed to read %s", FILE);
+        return -1;
+    }
+    if (map_file("no_such_file", BASE) >= 0) {
+        lprintf("mapped a file that does not exist");
+        return -1;
+    }
+    if (map_file(FILE, BASE) != len || check_mapping(BASE, len) < 0) {
+        lprintf("first mapping is wrong");
+        return -1;
+    }
+    if (map_file(FILE, BASE) >= 0) {
+        lprintf("mapped over an existing mapping");
+        return -1;
+    }
+
+    int tid = fork();
+    if (tid < 0) {
+        lprintf("failed to fork");
+        return -1;
+    }
+    if (tid == 0) {
+        /* the child inherits the mapping and may map the file again */
+        if (check_mapping(BASE, len) < 0) exit(-1);
+        if (map_file(FILE, OTHER_BASE) != len) exit(-2);
+        if (check_mapping(OTHER_BASE, len) < 0) exit(-3);
+        exit(0);
+    }
+    int status;
+    if (wait(&status) != tid || status != 0) {
+        lprintf("child failed: %d", status);
+        return -1;
+    }
+    if (remove_pages(BASE) < 0 || remove_pages(BASE) >= 0) {
+        lprintf("remove_pages misbehaved");
+        return -1;
+    }
+    lprintf("test_map_file passed");
+    return 0;
+}
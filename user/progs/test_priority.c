@@ -0,0 +1,76 @@
+/** @file test_priority.c
+ *  @author Christopher Wei
+ *  @brief Tests that set_priority checks its argument and that a thread
+ *         that sleeps still wakes up on time while CPU bound processes of
+ *         lower priority run
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <ext_syscall.h>
+#include <simics.h>    /* for lprintf */
+
+/** @brief number of priority levels of the kernel */
+#define NUM_PRIOS 8
+/** @brief number of CPU bound children */
+#define NUM_HOGS 4
+/** @brief number of times the parent sleeps */
+#define NUM_NAPS 20
+/** @brief ticks the parent sleeps each time */
+#define NAP_TICKS 2
+/** @brief max ticks the parent may wake up late */
+#define MAX_LATE 2
+
+/* Main */
+int main() {
+    if (set_priority(-1) >= 0 || set_priority(NUM_PRIOS) >= 0) {
+        lprintf("set a priority out of range");
+        return -1;
+    }
+    int old = set_priority(NUM_PRIOS - 2);
+    if (old < 0 || set_priority(old) != NUM_PRIOS - 2) {
+        lprintf("set_priority does not return the old priority");
+        return -1;
+    }
+
+    int i, tid;
+    unsigned int end = get_ticks() + 2 * NUM_NAPS * NAP_TICKS + 100;
+    for (i = 0; i < NUM_HOGS; i++) {
+        tid = fork();
+        if (tid < 0) {
+            lprintf("failed to fork");
+            return -1;
+        }
+        if (tid == 0) {
+            /* burn the CPU until the parent is surely done */
+            set_priority(NUM_PRIOS - 2);
+            while (get_ticks() < end) continue;
+            exit(0);
+        }
+    }
+
+    int late, max_late = 0;
+    for (i = 0; i < NUM_NAPS; i++) {
+        unsigned int start = get_ticks();
+        sleep(NAP_TICKS);
+        late = get_ticks() - start - NAP_TICKS;
+        if (late > max_late) max_late = late;
+    }
+
+    int status;
+    for (i = 0; i < NUM_HOGS; i++) {
+        if (wait(&status) < 0 || status != 0) {
+            lprintf("child failed");
+            return -1;
+        }
+    }
+    if (max_late > MAX_LATE) {
+        lprintf("woke up %d ticks late", max_late);
+        return -1;
+    }
+    lprintf("test_priority passed");
+    return 0;
+}
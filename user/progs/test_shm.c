@@ -0,0 +1,69 @@
+/** @file test_shm.c
+ *  @author Christopher Wei
+ *  @brief Tests that a shared memory segment is shared across fork and is
+ *         torn down once nobody has it attached
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <ext_syscall.h>
+#include <simics.h>    /* for lprintf */
+
+#define KEY 410
+#define BASE ((int *)0x40000000)
+#define LEN (2 * PAGE_SIZE)
+
+/* Main */
+int main() {
+    if (shm_attach(KEY, BASE, LEN) < 0) {
+        lprintf("failed to attach");
+        return -1;
+    }
+    if (BASE[0] != 0) {
+        lprintf("new segment is not zeroed");
+        return -1;
+    }
+    BASE[0] = 15;
+
+    int tid = fork();
+    if (tid < 0) {
+        lprintf("failed to fork");
+        return -1;
+    }
+    if (tid == 0) {
+        /* the child inherits the segment, writable and shared */
+        if (BASE[0] != 15) exit(-1);
+        BASE[PAGE_SIZE / sizeof(int)] = 410;
+        if (shm_detach(BASE) < 0) exit(-2);
+        exit(0);
+    }
+    int status;
+    if (wait(&status) != tid || status != 0) {
+        lprintf("child failed: %d", status);
+        return -1;
+    }
+    if (BASE[PAGE_SIZE / sizeof(int)] != 410) {
+        lprintf("write of the child not seen");
+        return -1;
+    }
+    /* attaching over the segment or with another length fails */
+    if (shm_attach(KEY, BASE, LEN) >= 0
+            || shm_attach(KEY, (char *)BASE + LEN, PAGE_SIZE) >= 0) {
+        lprintf("bad attach succeeded");
+        return -1;
+    }
+    if (shm_detach(BASE) < 0 || shm_detach(BASE) >= 0) {
+        lprintf("detach misbehaved");
+        return -1;
+    }
+    /* nobody has the segment anymore, so it comes back zeroed */
+    if (shm_attach(KEY, BASE, LEN) < 0 || BASE[0] != 0) {
+        lprintf("segment outlived its last user");
+        return -1;
+    }
+    lprintf("test_shm passed");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/** @file test_sleep_stress.c
+ *  @author Christopher Wei
+ *  @brief Measures sleep/wake throughput with many threads sleeping at once
+ *
+ *  Every thread sleeps for a few ticks over and over, with the lengths
+ *  spread out so that some thread wakes up on nearly every tick and the
+ *  longest sleeps go around the kernel's sleep wheel. Reports the number of
+ *  sleeps completed per tick and the worst lateness of a wakeup.
+ *
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <thread.h>
+#include <simics.h>    /* for lprintf */
+
+/** @brief number of sleeping threads */
+#define NUM_SLEEPERS 256
+/** @brief number of times each thread sleeps */
+#define NUM_ROUNDS 20
+/** @brief sleeps last from 1 to SPREAD ticks */
+#define SPREAD 300
+/** @brief stack size of each thread */
+#define STACK_SIZE 4096
+
+/** @brief worst lateness each thread saw, in ticks */
+int late[NUM_SLEEPERS];
+
+/** @brief Sleeps NUM_ROUNDS times and records the worst lateness
+ *  @param arg The index of the thread
+ *  @return NULL
+ */
+void *sleeper(void *arg) {
+    int i, idx = (int)arg;
+    for (i = 0; i < NUM_ROUNDS; i++) {
+        int ticks = 1 + (idx * 7 + i * 13) % SPREAD;
+        unsigned int start = get_ticks();
+        sleep(ticks);
+        int l = get_ticks() - start - ticks;
+        if (l > late[idx]) late[idx] = l;
+    }
+    return NULL;
+}
+
+/* Main */
+int main() {
+    if (thr_init(STACK_SIZE) < 0) {
+        lprintf("thr_init failed");
+        return -1;
+    }
+    int tids[NUM_SLEEPERS];
+    int i;
+    unsigned int start = get_ticks();
+    for (i = 0; i < NUM_SLEEPERS; i++) {
+        if ((tids[i] = thr_create(sleeper, (void *)i)) < 0) {
+            lprintf("failed to create sleeper %d", i);
+            return -1;
+        }
+    }
+    int max_late = 0;
+    for (i = 0; i < NUM_SLEEPERS; i++) {
+        thr_join(tids[i], NULL);
+        if (late[i] > max_late) max_late = late[i];
+    }
+    unsigned int elapsed = get_ticks() - start;
+    lprintf("test_sleep_stress: %d sleeps in %d ticks (%d per 100 ticks), "
+            "worst lateness %d ticks", NUM_SLEEPERS * NUM_ROUNDS,
+            (int)elapsed, (int)(NUM_SLEEPERS * NUM_ROUNDS * 100 / elapsed),
+            max_late);
+    thr_exit(NULL);
+    return 0;
+}
@@ -0,0 +1,45 @@
+/** @file test_spawn.c
+ *  @author Christopher Wei
+ *  @brief Tests spawn, which creates a child running a program without
+ *         forking
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <ext_syscall.h>
+#include <simics.h>    /* for lprintf */
+#include <stdlib.h>
+
+/* Main */
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        /* we are the spawned child */
+        exit(atoi(argv[1]));
+    }
+
+    char *args[] = {"test_spawn", "42", 0};
+    if (spawn("no_such_program", args) >= 0) {
+        lprintf("spawned a program that does not exist");
+        return -1;
+    }
+    if (spawn("test_spawn", (char **)0xdeadbeef) >= 0) {
+        lprintf("spawned with a bad argument vector");
+        return -1;
+    }
+
+    int tid = spawn("test_spawn", args);
+    if (tid < 0) {
+        lprintf("failed to spawn: %d", tid);
+        return -1;
+    }
+    int status;
+    if (wait(&status) != tid || status != 42) {
+        lprintf("child did not report its status");
+        return -1;
+    }
+    lprintf("test_spawn passed");
+    return 0;
+}
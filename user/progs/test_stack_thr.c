@@ -0,0 +1,64 @@
+/** @file test_stack_thr.c
+ *  @author Christopher Wei
+ *  @brief Tests that threads can be created after the kernel has grown the
+ *         stack well past its initial 8KB
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <simics.h>    /* for lprintf */
+#include <thread.h>
+
+/** @brief Stack space of each thread */
+#define STACK_SIZE 4096
+/** @brief Levels of recursion, each of which uses a page of stack */
+#define DEPTH 64
+/** @brief Value the child thread exits with */
+#define CHILD_RETURN 42
+
+/** @brief Recurses DEPTH levels deep, touching a page of stack on each
+ *  @param depth The number of levels left
+ *  @return The sum of the depths, so that the frames are not optimized out
+ */
+int recurse(int depth) {
+    volatile char buf[PAGE_SIZE];
+    buf[0] = (char)depth;
+    if (depth == 0) return 0;
+    return recurse(depth - 1) + buf[0];
+}
+
+/** @brief Body of the child thread
+ *  @param arg Unused
+ *  @return CHILD_RETURN
+ */
+void *child(void *arg) {
+    return (void *)CHILD_RETURN;
+}
+
+/* Main */
+int main(int argc, char **argv) {
+    if (recurse(DEPTH) != DEPTH * (DEPTH + 1) / 2) {
+        lprintf("stack did not hold its contents while growing");
+        return -1;
+    }
+    if (thr_init(STACK_SIZE) < 0) {
+        lprintf("thr_init failed after the stack grew");
+        return -1;
+    }
+    int tid = thr_create(child, NULL);
+    if (tid < 0) {
+        lprintf("thr_create failed after the stack grew: %d", tid);
+        return -1;
+    }
+    void *status;
+    if (thr_join(tid, &status) < 0 || status != (void *)CHILD_RETURN) {
+        lprintf("child thread did not report its status");
+        return -1;
+    }
+    lprintf("test_stack_thr passed");
+    thr_exit((void *)0);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/** @file test_tid_reuse.c
+ *  @author Christopher Wei
+ *  @brief Tests that tids of reaped threads are not handed out unchanged
+ *         and that a stale tid no longer finds a thread
+ *
+ *  Creates and joins many more threads than the kernel's id tables have
+ *  slots per leaf, one at a time, so that their slots get reused.
+ *
+ *  @public yes
+ *  @for p3
+ *  @status done
+ */
+
+/* Includes */
+#include <syscall.h>
+#include <thread.h>
+#include <simics.h>    /* for lprintf */
+
+/** @brief number of threads created one after the other */
+#define NUM_THREADS 2000
+/** @brief stack size of each thread */
+#define STACK_SIZE 4096
+
+/** @brief tid of every thread created */
+int tids[NUM_THREADS];
+
+/** @brief Returns right away
+ *  @param arg Unused
+ *  @return NULL
+ */
+void *quick(void *arg) {
+    return NULL;
+}
+
+/* Main */
+int main() {
+    if (thr_init(STACK_SIZE) < 0) {
+        lprintf("thr_init failed");
+        return -1;
+    }
+    int i, j;
+    for (i = 0; i < NUM_THREADS; i++) {
+        if ((tids[i] = thr_create(quick, NULL)) < 0) {
+            lprintf("failed to create thread %d", i);
+            return -1;
+        }
+        if (thr_join(tids[i], NULL) < 0) {
+            lprintf("failed to join thread %d", i);
+            return -1;
+        }
+        for (j = 0; j < i; j++) {
+            if (tids[j] == tids[i]) {
+                lprintf("tid %d handed out twice", tids[i]);
+                return -1;
+            }
+        }
+    }
+    /* let the reaper catch up */
+    sleep(10);
+    if (yield(tids[0]) >= 0 || make_runnable(tids[0]) >= 0) {
+        lprintf("stale tid %d still finds a thread", tids[0]);
+        return -1;
+    }
+    lprintf("test_tid_reuse passed");
+    thr_exit(NULL);
+    return 0;
+}